@@ -0,0 +1,80 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time of the branch and bound search of the correlative matcher over the default window,
+// compared with the period of the docking controller.
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "scitos2_charging_dock/correlative_matcher_2d.hpp"
+
+using scitos2_charging_dock::CorrelativeGrid2D;
+using scitos2_charging_dock::CorrelativeMatcher2D;
+using scitos2_charging_dock::Pcloud;
+
+// A V-shaped profile similar to the docking station, 1 meter in front of the sensor
+Pcloud createTemplate()
+{
+  Pcloud cloud;
+  cloud.header.frame_id = "test_link";
+  for (int i = -20; i <= 20; i++) {
+    float y = 0.01f * i;
+    cloud.push_back(pcl::PointXYZ(1.0f + 0.5f * std::abs(y), y, 0.0f));
+  }
+  return cloud;
+}
+
+Pcloud transformCloud(const Pcloud & cloud, float x, float y, float yaw)
+{
+  Pcloud transformed;
+  for (const auto & point : cloud) {
+    transformed.push_back(
+      pcl::PointXYZ(
+        std::cos(yaw) * point.x - std::sin(yaw) * point.y + x,
+        std::sin(yaw) * point.x + std::cos(yaw) * point.y + y, 0.0f));
+  }
+  return transformed;
+}
+
+int main(int argc, char ** argv)
+{
+  // Period of the docking controller in ms, 50 Hz as in the example parameters
+  const double controller_period = argc > 1 ? std::atof(argv[1]) : 20.0;
+
+  auto target = createTemplate();
+  auto grid = std::make_shared<const CorrelativeGrid2D>(target, 0.02f);
+  auto source = transformCloud(target, 0.2f, -0.25f, -0.2f);
+
+  CorrelativeMatcher2D matcher;
+  matcher.setSearchGridTarget(grid);
+  const int iterations = 20;
+  int matched = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    matched += matcher.match(source) ? 1 : 0;
+  }
+  auto elapsed = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count() / iterations;
+
+  const bool fits = elapsed < controller_period;
+  std::cout << elapsed << " ms per search, " << matched << "/" << iterations << " matched, " <<
+    (fits ? "within" : "over") << " the controller period of " << controller_period << " ms" <<
+    std::endl;
+  return fits && matched == iterations ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time of the refinement of a cluttered scan with the PCL and SE(2) matchers and several
+// numbers of threads.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "nav2_util/node_utils.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "scitos2_charging_dock/perception.hpp"
+
+class PerceptionBenchmark : public scitos2_charging_dock::Perception
+{
+public:
+  PerceptionBenchmark(
+    const rclcpp_lifecycle::LifecycleNode::SharedPtr & node, const std::string & name)
+  : Perception(node, name, nullptr)
+  {
+  }
+
+  bool refineAllClustersPoses(
+    scitos2_charging_dock::Clusters & clusters,
+    const scitos2_charging_dock::DockTemplate & dock_template,
+    scitos2_charging_dock::Cluster & dock)
+  {
+    return scitos2_charging_dock::Perception::refineAllClustersPoses(
+      clusters, dock_template, getParameters(), dock);
+  }
+};
+
+// A V-shaped dock template
+scitos2_charging_dock::Pcloud create_dock_template()
+{
+  scitos2_charging_dock::Pcloud cloud;
+  cloud.header.frame_id = "test_link";
+  for (int i = -20; i <= 20; i++) {
+    float y = 0.01f * i;
+    cloud.push_back(pcl::PointXYZ(0.5f * std::abs(y), y, 0.0f));
+  }
+  return cloud;
+}
+
+// A scan of a cluttered room: the dock and walls, boxes and furniture of similar width
+// around the expected pose of the dock
+scitos2_charging_dock::Clusters create_cluttered_clusters(
+  const scitos2_charging_dock::Pcloud & dock, int num_clutter)
+{
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<float> offset(-0.15f, 0.15f);
+  std::uniform_real_distribution<float> angle(-0.6f, 0.6f);
+  std::normal_distribution<float> noise(0.0f, 0.003f);
+
+  scitos2_charging_dock::Clusters clusters;
+  for (int c = 0; c <= num_clutter; c++) {
+    scitos2_charging_dock::Cluster cluster;
+    cluster.id = c;
+    cluster.cloud.header.frame_id = "test_link";
+    float x = c == 0 ? 0.02f : offset(generator);
+    float y = c == 0 ? -0.01f : offset(generator);
+    float yaw = c == 0 ? 0.05f : angle(generator);
+    for (int i = -20; i <= 20; i++) {
+      // The first cluster is the dock, the rest are flat or curved segments
+      float py = 0.01f * i;
+      float px = c == 0 ? dock[i + 20].x : (c % 2) * 0.0005f * i * i;
+      cluster.cloud.push_back(
+        pcl::PointXYZ(
+          std::cos(yaw) * px - std::sin(yaw) * py + x + noise(generator),
+          std::sin(yaw) * px + std::cos(yaw) * py + y + noise(generator), 0.0f));
+    }
+    clusters.push_back(cluster);
+  }
+  return clusters;
+}
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  auto cloud_template = create_dock_template();
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25);
+  geometry_msgs::msg::Pose initial_pose;
+
+  const int num_scans = 20;
+  for (const std::string matcher : {"pcl", "se2"}) {
+    double serial_time = 0.0;
+    for (int threads : {1, 2, 4}) {
+      // Create a perception with the number of threads
+      auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_benchmark");
+      nav2_util::declare_parameter_if_not_declared(
+        node, "benchmark.perception.max_threads", rclcpp::ParameterValue(threads));
+      nav2_util::declare_parameter_if_not_declared(
+        node, "benchmark.perception.matcher", rclcpp::ParameterValue(matcher));
+      auto perception = std::make_shared<PerceptionBenchmark>(node, "benchmark");
+      perception->setInitialEstimate(initial_pose, "test_link");
+
+      // Refine the same cluttered scans
+      size_t found = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (int scan = 0; scan < num_scans; scan++) {
+        auto clusters = create_cluttered_clusters(cloud_template, 15);
+        scitos2_charging_dock::Cluster dock;
+        found += perception->refineAllClustersPoses(clusters, dock_template, dock) ? 1 : 0;
+      }
+      double elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count() / num_scans;
+      if (threads == 1) {
+        serial_time = elapsed;
+      }
+      std::cout << "matcher: " << matcher << ", threads: " << threads << ", time per scan: " <<
+        elapsed << " ms, speedup: " << serial_time / elapsed << ", found: " << found << "/" <<
+        num_scans << std::endl;
+    }
+  }
+
+  rclcpp::shutdown();
+  return 0;
+}
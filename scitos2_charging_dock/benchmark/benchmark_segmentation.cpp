@@ -0,0 +1,77 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time of the segmentation of full turn scans of 720 and 1440 beams.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+#include "scitos2_charging_dock/segmentation.hpp"
+
+// Create a full turn laser scan of a room with a box in front of the sensor
+sensor_msgs::msg::LaserScan create_room_scan(int num_beams)
+{
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.frame_id = "laser";
+  scan.angle_min = -M_PI;
+  scan.angle_increment = 2 * M_PI / num_beams;
+  scan.angle_max = scan.angle_min + (num_beams - 1) * scan.angle_increment;
+  scan.range_min = 0.05;
+  scan.range_max = 10.0;
+  for (int i = 0; i < num_beams; i++) {
+    double angle = scan.angle_min + i * scan.angle_increment;
+    double range = 3.0 / std::max(std::abs(std::cos(angle)), std::abs(std::sin(angle)));
+    if (std::abs(angle) < 0.2) {
+      range = 1.0;
+    }
+    // Some beams without return
+    if (i % 50 == 0) {
+      range = std::numeric_limits<float>::infinity();
+    }
+    scan.ranges.push_back(range);
+  }
+  return scan;
+}
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_benchmark");
+  scitos2_charging_dock::Segmentation segmentation(node, "benchmark");
+
+  const int iterations = 200;
+  for (int num_beams : {720, 1440}) {
+    auto scan = create_room_scan(num_beams);
+    scitos2_charging_dock::Clusters clusters;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+      clusters.clear();
+      segmentation.performSegmentation(scan, clusters);
+    }
+    auto elapsed = std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start).count();
+    std::cout << num_beams << " beams: " << elapsed / iterations << " us per scan, " <<
+      clusters.size() << " clusters" << std::endl;
+  }
+
+  rclcpp::shutdown();
+  return 0;
+}
@@ -17,14 +17,21 @@
 #ifndef SCITOS2_CHARGING_DOCK__CHARGING_DOCK_HPP_
 #define SCITOS2_CHARGING_DOCK__CHARGING_DOCK_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "geometry_msgs/msg/pose_stamped.hpp"
 #include "opennav_docking_core/charging_dock.hpp"
 #include "opennav_docking/pose_filter.hpp"
 #include "scitos2_charging_dock/perception.hpp"
+#include "scitos2_charging_dock/scan_merger.hpp"
 #include "sensor_msgs/msg/battery_state.hpp"
 #include "sensor_msgs/msg/laser_scan.hpp"
 #include "tf2_ros/buffer.h"
@@ -32,6 +39,20 @@
 namespace scitos2_charging_dock
 {
 
+/**
+ * @struct scitos2_charging_dock::DockDetection
+ * @brief Result of the perception of a scan.
+ */
+struct DockDetection
+{
+  // Detected dock pose
+  geometry_msgs::msg::PoseStamped pose;
+  // Time in seconds the processed scan waited since it arrived
+  double queue_delay{0.0};
+  // Time in seconds spent processing the scan
+  double processing_time{0.0};
+};
+
 class ChargingDock : public opennav_docking_core::ChargingDock
 {
 public:
@@ -42,6 +63,11 @@ public:
   : opennav_docking_core::ChargingDock()
   {}
 
+  /**
+   * @brief Destructor
+   */
+  ~ChargingDock();
+
   /**
    * @param  parent pointer to user's node
    * @param  name The name of this planner
@@ -59,12 +85,12 @@ public:
   /**
    * @brief Method to active Behavior and any threads involved in execution.
    */
-  virtual void activate() {}
+  virtual void activate();
 
   /**
    * @brief Method to deactive Behavior and any threads involved in execution.
    */
-  virtual void deactivate() {}
+  virtual void deactivate();
 
   /**
    * @brief Method to obtain the dock's staging pose. This method should likely
@@ -104,13 +130,37 @@ public:
   virtual bool hasStoppedCharging();
 
 protected:
-  // Subscribe to a scan topic
-  rclcpp::Subscription<sensor_msgs::msg::LaserScan>::SharedPtr scan_sub_;
+  /**
+   * @brief Start the thread that processes the scans in the background.
+   */
+  void startPerceptionWorker();
+
+  /**
+   * @brief Stop the thread that processes the scans in the background.
+   */
+  void stopPerceptionWorker();
+
+  /**
+   * @brief Add a scan to the ring of the latest scans and wake up the perception thread.
+   *
+   * @param scan The scan, merged if there are several lasers
+   */
+  void addScan(sensor_msgs::msg::LaserScan::ConstSharedPtr scan);
+
+  /**
+   * @brief Loop of the perception thread. It processes one of the scans received since the last
+   * one processed, selected by the perception, so the others are dropped. The scans are only
+   * processed during a docking attempt, i.e. after an initial estimate and while the docking
+   * keeps asking for the dock pose.
+   */
+  void perceptionLoop();
+
+  // Subscribe to the scan topics, merged if there are several
+  std::vector<rclcpp::Subscription<sensor_msgs::msg::LaserScan>::SharedPtr> scan_subs_;
+  std::unique_ptr<ScanMerger> scan_merger_;
   rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr dock_pose_pub_;
   rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr filtered_dock_pose_pub_;
   rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr staging_pose_pub_;
-  // It will contain latest message
-  sensor_msgs::msg::LaserScan scan_;
   // This is the actual dock pose once it has the specified translation/rotation applied
   geometry_msgs::msg::PoseStamped dock_pose_;
 
@@ -135,6 +185,29 @@ protected:
 
   // Perception
   std::unique_ptr<Perception> perception_;
+  // Serializes the perception between the worker and the initial estimates
+  std::mutex perception_mutex_;
+
+  // Process the scans in a background thread instead of in getRefinedPose
+  bool background_perception_{false};
+  std::atomic<bool> has_initial_estimate_{false};
+  // Last time the docking asked for the dock pose, the attempt is over if it stops asking
+  std::atomic<std::chrono::steady_clock::time_point> last_pose_request_{};
+  std::thread perception_thread_;
+  std::mutex scan_mutex_;
+  std::condition_variable scan_cv_;
+  bool perception_worker_stop_{false};
+  // Ring of the latest scans, shared immutable so they are never copied, the time each one
+  // arrived and the number of them not processed yet
+  std::deque<sensor_msgs::msg::LaserScan::ConstSharedPtr> scans_;
+  std::deque<std::chrono::steady_clock::time_point> scan_arrivals_;
+  size_t scan_buffer_size_{3};
+  size_t new_scans_{0};
+  // Latest result of the background perception, accessed atomically
+  std::shared_ptr<const DockDetection> detection_;
+  // Number of scans processed and dropped by the background perception
+  size_t processed_scans_{0};
+  size_t dropped_scans_{0};
 
   rclcpp_lifecycle::LifecycleNode::SharedPtr node_;
   std::shared_ptr<tf2_ros::Buffer> tf2_buffer_;
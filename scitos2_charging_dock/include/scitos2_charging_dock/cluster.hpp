@@ -19,9 +19,15 @@
 // PCL
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
-#include <pcl/common/centroid.h>
+
+// Eigen
+#include <Eigen/Geometry>
 
 // C++
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <vector>
 
 // ROS
@@ -33,31 +39,204 @@ namespace scitos2_charging_dock
 
 using Pcloud = pcl::PointCloud<pcl::PointXYZ>;
 
+/**
+ * @class scitos2_charging_dock::ClusterStatistics
+ * @brief Running statistics of the points of a cluster, accumulated as the cluster is built.
+ */
+struct ClusterStatistics
+{
+  // Number of points
+  size_t count{0};
+  // Sums of the coordinates
+  double sum_x{0.0};
+  double sum_y{0.0};
+  double sum_z{0.0};
+  // Bounding box of the points
+  float min_x{std::numeric_limits<float>::max()};
+  float max_x{std::numeric_limits<float>::lowest()};
+  float min_y{std::numeric_limits<float>::max()};
+  float max_y{std::numeric_limits<float>::lowest()};
+  // First and last points
+  pcl::PointXYZ first{0.0f, 0.0f, 0.0f};
+  pcl::PointXYZ last{0.0f, 0.0f, 0.0f};
+
+  /**
+   * @brief Add a point at the end of the cluster.
+   *
+   * @param point The point to add.
+   */
+  void add(const pcl::PointXYZ & point)
+  {
+    if (count == 0) {
+      first = point;
+    }
+    last = point;
+    count++;
+    sum_x += point.x;
+    sum_y += point.y;
+    sum_z += point.z;
+    min_x = std::min(min_x, point.x);
+    max_x = std::max(max_x, point.x);
+    min_y = std::min(min_y, point.y);
+    max_y = std::max(max_y, point.y);
+  }
+};
+
 /**
  * @class scitos2_charging_dock::Cluster
  * @brief Class to represent a cluster of points.
+ * The points are either a range [scan_begin, scan_end) of the points of the scan, shared by
+ * all the clusters of the same segmentation, or its own pointcloud once materialized.
  */
 struct Cluster
 {
   // Identifier of the cluster
-  int id;
-  // Original pointcloud of the cluster.
+  int id{0};
+  // Points of the scan the cluster is a range of. Null if the cluster owns its points.
+  std::shared_ptr<const Pcloud> scan_points;
+  // First point of the cluster in the points of the scan.
+  size_t scan_begin{0};
+  // Past the last point of the cluster in the points of the scan.
+  size_t scan_end{0};
+  // Original pointcloud of the cluster, only filled once materialized.
   pcl::PointCloud<pcl::PointXYZ> cloud;
   // Score of the ICP.
-  double score;
+  double score{0.0};
+  // Number of iterations of the ICP.
+  int iterations{0};
   // Pose of the dock.
   geometry_msgs::msg::PoseStamped pose;
 
+  /**
+   * @brief Make the cluster a range of the points of a scan.
+   *
+   * @param points The points of the scan.
+   * @param begin First point of the cluster.
+   * @param end Past the last point of the cluster.
+   */
+  void assign(const std::shared_ptr<const Pcloud> & points, size_t begin, size_t end)
+  {
+    cloud.clear();
+    scan_points = points;
+    scan_begin = begin;
+    scan_end = end;
+    updateStatistics();
+  }
+
+  /**
+   * @brief Make the cluster a range of the points of a scan whose statistics are already known.
+   *
+   * @param points The points of the scan.
+   * @param begin First point of the cluster.
+   * @param end Past the last point of the cluster.
+   * @param statistics Statistics of the points of the range.
+   */
+  void assign(
+    const std::shared_ptr<const Pcloud> & points, size_t begin, size_t end,
+    const ClusterStatistics & statistics)
+  {
+    cloud.clear();
+    scan_points = points;
+    scan_begin = begin;
+    scan_end = end;
+    statistics_ = statistics;
+  }
+
+  /**
+   * @brief Get the statistics of the points of the cluster. The points of the scan are
+   * immutable, so the statistics of a range are computed once. The pointcloud may be edited in
+   * place, so the statistics of a cluster that owns its points are recomputed on every call.
+   *
+   * @return const ClusterStatistics & The statistics.
+   */
+  const ClusterStatistics & statistics() const
+  {
+    if (!scan_points) {
+      updateStatistics();
+    }
+    return statistics_;
+  }
+
+  /**
+   * @brief Copy the range of the points of the scan into the pointcloud of the cluster.
+   * It does nothing if the cluster already owns its points.
+   */
+  void materialize()
+  {
+    if (!scan_points) {
+      return;
+    }
+    cloud.header = scan_points->header;
+    cloud.points.assign(
+      scan_points->points.begin() + scan_begin, scan_points->points.begin() + scan_end);
+    cloud.width = static_cast<uint32_t>(cloud.points.size());
+    cloud.height = 1;
+    cloud.is_dense = scan_points->is_dense;
+    scan_points.reset();
+    scan_begin = scan_end = 0;
+  }
+
+  /**
+   * @brief Copy the range of the points of the scan into the pointcloud of the cluster, moving
+   * them by a transform in the same pass. The points are moved in place if the cluster already
+   * owns them.
+   *
+   * @param transform The transform to apply to the points.
+   */
+  void materialize(const Eigen::Affine3f & transform)
+  {
+    if (scan_points) {
+      cloud.header = scan_points->header;
+      cloud.points.resize(scan_end - scan_begin);
+      cloud.width = static_cast<uint32_t>(cloud.points.size());
+      cloud.height = 1;
+      cloud.is_dense = scan_points->is_dense;
+    }
+    const pcl::PointXYZ * source = data();
+    const size_t n = static_cast<size_t>(size());
+    for (size_t i = 0; i < n; i++) {
+      const auto & point = source[i];
+      const Eigen::Vector3f moved = transform * Eigen::Vector3f(point.x, point.y, point.z);
+      cloud.points[i] = pcl::PointXYZ(moved.x(), moved.y(), moved.z());
+    }
+    scan_points.reset();
+    scan_begin = scan_end = 0;
+  }
+
+  /**
+   * @brief Get the header of the points of the cluster.
+   * @return const pcl::PCLHeader & The header.
+   */
+  const pcl::PCLHeader & header() const
+  {
+    return scan_points ? scan_points->header : cloud.header;
+  }
+
+  /**
+   * @brief Get the points of the cluster.
+   * @return const pcl::PointXYZ * The first point of the cluster.
+   */
+  const pcl::PointXYZ * data() const
+  {
+    return scan_points ? scan_points->points.data() + scan_begin : cloud.points.data();
+  }
+
   /**
    * @brief Get the size of the cluster.
    * @return int The size of the cluster.
    */
-  int size() const {return cloud.size();}
+  int size() const {return scan_points ? scan_end - scan_begin : cloud.size();}
 
   /**
    * @brief Clear the cluster.
    */
-  void clear() {cloud.clear();}
+  void clear()
+  {
+    scan_points.reset();
+    scan_begin = scan_end = 0;
+    cloud.clear();
+    statistics_ = ClusterStatistics();
+  }
 
   /**
    * @brief Push a point at the end of the cluster.
@@ -66,6 +245,7 @@ struct Cluster
    */
   void push_back(geometry_msgs::msg::Point point)
   {
+    materialize();
     pcl::PointXYZ pcl_point;
     pcl_point.x = point.x;
     pcl_point.y = point.y;
@@ -80,12 +260,14 @@ struct Cluster
    */
   geometry_msgs::msg::Point centroid() const
   {
-    Eigen::Vector4f centroid_vec_4f(0, 0, 0, 0);
-    pcl::compute3DCentroid(cloud, centroid_vec_4f);
     geometry_msgs::msg::Point centroid;
-    centroid.x = static_cast<double>(centroid_vec_4f[0]);
-    centroid.y = static_cast<double>(centroid_vec_4f[1]);
-    centroid.z = static_cast<double>(centroid_vec_4f[2]);
+    const auto & stats = statistics();
+    if (stats.count == 0) {
+      return centroid;
+    }
+    centroid.x = stats.sum_x / stats.count;
+    centroid.y = stats.sum_y / stats.count;
+    centroid.z = stats.sum_z / stats.count;
     return centroid;
   }
 
@@ -107,13 +289,7 @@ struct Cluster
    */
   double width() const
   {
-    if (cloud.empty()) {
-      return 0.0;
-    }
-
-    double dx = cloud.back().x - cloud.front().x;
-    double dy = cloud.back().y - cloud.front().y;
-    return std::hypot(dx, dy);
+    return std::sqrt(width_squared());
   }
 
   /**
@@ -122,7 +298,10 @@ struct Cluster
    */
   double width_squared() const
   {
-    return width() * width();
+    const auto & stats = statistics();
+    double dx = stats.last.x - stats.first.x;
+    double dy = stats.last.y - stats.first.y;
+    return dx * dx + dy * dy;
   }
 
   /**
@@ -134,12 +313,13 @@ struct Cluster
   bool valid(double ideal_size) const
   {
     // If there are no points this cannot be valid.
-    if (cloud.empty()) {
+    if (size() == 0) {
       return false;
     }
 
     // Check overall size.
-    if (width() > 1.25 * ideal_size || width() < ideal_size / 2.0) {
+    const double cluster_width = width();
+    if (cluster_width > 1.25 * ideal_size || cluster_width < ideal_size / 2.0) {
       return false;
     }
 
@@ -148,6 +328,23 @@ struct Cluster
 
   friend bool operator<(const Cluster c1, const Cluster c2) {return c1.score < c2.score;}
   friend bool operator>(const Cluster c1, const Cluster c2) {return c1.score > c2.score;}
+
+private:
+  /**
+   * @brief Recompute the statistics of the points of the cluster.
+   */
+  void updateStatistics() const
+  {
+    statistics_ = ClusterStatistics();
+    const int n = size();
+    const pcl::PointXYZ * points = data();
+    for (int i = 0; i < n; i++) {
+      statistics_.add(points[i]);
+    }
+  }
+
+  // Statistics of the range of the scan, cached so filtering and ranking do not traverse them
+  mutable ClusterStatistics statistics_;
 };
 }  // namespace scitos2_charging_dock
 
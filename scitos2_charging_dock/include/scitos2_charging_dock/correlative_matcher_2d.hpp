@@ -0,0 +1,266 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_CHARGING_DOCK__CORRELATIVE_MATCHER_2D_HPP_
+#define SCITOS2_CHARGING_DOCK__CORRELATIVE_MATCHER_2D_HPP_
+
+// C++
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Eigen
+#include <Eigen/Core>
+
+// ROS
+#include "scitos2_charging_dock/cluster.hpp"
+
+namespace scitos2_charging_dock
+{
+
+/**
+ * @class scitos2_charging_dock::CorrelativeGrid2D
+ * @brief Likelihood field of a 2D cloud over a regular grid, with a pyramid of coarser levels
+ * for the branch and bound search. Each cell of the finest level stores a gaussian of the
+ * distance to the nearest point, and each cell of level h stores the maximum of the 2^h x 2^h
+ * cells of the finest level starting at it, so it bounds the score of any translation inside
+ * that block.
+ */
+class CorrelativeGrid2D
+{
+public:
+  /**
+   * @brief Build the likelihood field and its pyramid. Only the x and y coordinates are used.
+   *
+   * @param cloud The cloud
+   * @param resolution The size of the cells of the finest level
+   * @param levels The number of levels of the pyramid
+   */
+  CorrelativeGrid2D(const Pcloud & cloud, float resolution = 0.02f, int levels = 5);
+
+  /**
+   * @brief Restore a grid from its levels, e.g. loaded from a file.
+   *
+   * @param origin The corner of the first cell of the finest level
+   * @param resolution The size of the cells of the finest level
+   * @param width The number of columns of the finest level
+   * @param height The number of rows of the finest level
+   * @param levels The values of each level of the pyramid, row by row
+   */
+  CorrelativeGrid2D(
+    const Eigen::Vector2f & origin, float resolution, int width, int height,
+    std::vector<std::vector<float>> levels)
+  : origin_(origin), resolution_(resolution), width_(width), height_(height),
+    levels_(std::move(levels)) {}
+
+  /**
+   * @brief Check if the grid has no cells.
+   *
+   * @return bool If the grid has no cells
+   */
+  bool empty() const {return width_ == 0 || height_ == 0;}
+
+  /**
+   * @brief Get the number of levels of the pyramid.
+   *
+   * @return int The number of levels
+   */
+  int levels() const {return static_cast<int>(levels_.size());}
+
+  /**
+   * @brief Get the size of the cells of the finest level.
+   *
+   * @return float The resolution
+   */
+  float resolution() const {return resolution_;}
+
+  /**
+   * @brief Get the corner of the first cell of the finest level.
+   *
+   * @return const Eigen::Vector2f & The origin
+   */
+  const Eigen::Vector2f & origin() const {return origin_;}
+
+  /**
+   * @brief Get the number of columns of the finest level.
+   *
+   * @return int The width
+   */
+  int width() const {return width_;}
+
+  /**
+   * @brief Get the number of rows of the finest level.
+   *
+   * @return int The height
+   */
+  int height() const {return height_;}
+
+  /**
+   * @brief Get the values of a level of the pyramid. Each level is padded before the origin by
+   * the size of its blocks minus one cell.
+   *
+   * @param level The level of the pyramid
+   * @return const std::vector<float> & The values, row by row
+   */
+  const std::vector<float> & levelValues(int level) const {return levels_[level];}
+
+  /**
+   * @brief Get the index of the cell of the finest level that contains a point.
+   *
+   * @param point The point
+   * @return Eigen::Vector2i The index of the cell, possibly outside the grid
+   */
+  Eigen::Vector2i cell(const Eigen::Vector2f & point) const;
+
+  /**
+   * @brief Get the value of a cell. Cells outside the grid have no likelihood.
+   *
+   * @param level The level of the pyramid
+   * @param ix The column of the cell in the finest level
+   * @param iy The row of the cell in the finest level
+   * @return float The value of the cell
+   */
+  float value(int level, int ix, int iy) const
+  {
+    // The levels are padded before the origin by the size of their blocks
+    const int padding = (1 << level) - 1;
+    const int jx = ix + padding;
+    const int jy = iy + padding;
+    const int level_width = width_ + padding;
+    if (jx < 0 || jy < 0 || jx >= level_width || jy >= height_ + padding) {
+      return 0.0f;
+    }
+    return levels_[level][jy * level_width + jx];
+  }
+
+protected:
+  Eigen::Vector2f origin_{Eigen::Vector2f::Zero()};
+  float resolution_;
+  int width_{0};
+  int height_{0};
+  std::vector<std::vector<float>> levels_;
+};
+
+/**
+ * @class scitos2_charging_dock::CorrelativeMatcher2D
+ * @brief Exhaustive search of the planar transform (x, y, yaw) inside a window that maximizes
+ * the likelihood of a source cloud in the field of a target cloud. The search is done with
+ * branch and bound over the pyramid of the grid, so it returns the same optimum as the brute
+ * force search at the finest level while scoring only a small part of the translations.
+ * It does not need a close initial estimate, so its result seeds the iterative matchers.
+ */
+class CorrelativeMatcher2D
+{
+public:
+  /**
+   * @brief Construct for scitos2_charging_dock::CorrelativeMatcher2D
+   */
+  CorrelativeMatcher2D() = default;
+
+  /**
+   * @brief Set the half size of the translation window.
+   *
+   * @param window The maximum translation along x and y
+   */
+  void setLinearWindow(double window) {linear_window_ = window;}
+
+  /**
+   * @brief Set the half size of the rotation window.
+   *
+   * @param window The maximum rotation
+   */
+  void setAngularWindow(double window) {angular_window_ = window;}
+
+  /**
+   * @brief Set the minimum score to accept a transform.
+   *
+   * @param score The minimum mean likelihood of the source points
+   */
+  void setMinScore(double score) {min_score_ = score;}
+
+  /**
+   * @brief Set the likelihood grid of the target cloud.
+   *
+   * @param grid The grid, shared read-only between matchers
+   */
+  void setSearchGridTarget(std::shared_ptr<const CorrelativeGrid2D> grid) {target_ = grid;}
+
+  /**
+   * @brief Search the transform that moves the source onto the target.
+   *
+   * @param source The source cloud
+   * @return bool If a transform with at least the minimum score was found
+   */
+  bool match(const Pcloud & source);
+
+  /**
+   * @brief Get the mean likelihood of the source points at the best transform.
+   *
+   * @return double The score between 0 and 1
+   */
+  double getScore() const {return score_;}
+
+  /**
+   * @brief Get the best transform as a 3D homogeneous matrix.
+   *
+   * @return Eigen::Matrix4f The transform
+   */
+  Eigen::Matrix4f getFinalTransformation() const;
+
+protected:
+  // Node of the search: a block of 2^level x 2^level translations at a rotation
+  struct Candidate
+  {
+    int rotation;
+    int x;
+    int y;
+    int level;
+    float score;
+  };
+
+  /**
+   * @brief Score a candidate with the level of the pyramid of its block.
+   *
+   * @param candidate The candidate to score
+   */
+  void scoreCandidate(Candidate & candidate) const;
+
+  /**
+   * @brief Search the subtree of a candidate for a transform better than the best one.
+   *
+   * @param candidate The candidate
+   */
+  void branchAndBound(const Candidate & candidate);
+
+  // Parameters
+  double linear_window_{0.5};
+  double angular_window_{0.35};
+  double min_score_{0.5};
+  std::shared_ptr<const CorrelativeGrid2D> target_;
+
+  // Cells of the source points at each rotation of the search
+  std::vector<double> rotations_;
+  std::vector<std::vector<Eigen::Vector2i>> rotated_cells_;
+  int linear_steps_{0};
+
+  // Results
+  Candidate best_{0, 0, 0, 0, 0.0f};
+  double score_{0.0};
+  bool found_{false};
+};
+
+}  // namespace scitos2_charging_dock
+
+#endif  // SCITOS2_CHARGING_DOCK__CORRELATIVE_MATCHER_2D_HPP_
@@ -16,13 +16,17 @@
 #ifndef SCITOS2_CHARGING_DOCK__DOCK_SAVER_HPP_
 #define SCITOS2_CHARGING_DOCK__DOCK_SAVER_HPP_
 
+#include <deque>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "nav2_util/lifecycle_node.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "scitos2_msgs/srv/save_dock.hpp"
 #include "scitos2_charging_dock/perception.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
 #include "tf2_ros/buffer.h"
 
 namespace scitos2_charging_dock
@@ -82,20 +86,82 @@ public:
   nav2_util::CallbackReturn on_shutdown(const rclcpp_lifecycle::State & state) override;
 
   /**
-   * @brief Callback for saving the dock to a PCD file.
+   * @brief Callback for saving the dock to a PCD file. The request is answered at once if the
+   * buffer of the scan topic has enough recent scans, otherwise the response is deferred until
+   * they are received or the timeout expires.
    *
+   * @param request_header SaveDock service request header, to send the deferred response
    * @param request SaveDock service request
+   */
+  void saveDockCallback(
+    const std::shared_ptr<rmw_request_id_t> request_header,
+    const std::shared_ptr<scitos2_msgs::srv::SaveDock::Request> request);
+
+protected:
+  // A request waiting for scans
+  struct PendingRequest
+  {
+    std::shared_ptr<rmw_request_id_t> header;
+    std::string scan_topic;
+    std::string filename;
+    std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> scans;
+    rclcpp::TimerBase::SharedPtr timer;
+  };
+
+  /**
+   * @brief Callback for the scans of a topic. The scan is buffered and given to the requests
+   * waiting for that topic.
+   *
+   * @param topic The scan topic
+   * @param scan The scan
+   */
+  void scanCallback(const std::string & topic, sensor_msgs::msg::LaserScan::ConstSharedPtr scan);
+
+  /**
+   * @brief Save the dock from the scans of a request and send its response.
+   *
+   * @param pending The request
+   */
+  void finishRequest(PendingRequest & pending);
+
+  /**
+   * @brief Save the dock captured in some scans to a PCD file.
+   *
+   * @param scans The scans
+   * @param filename The path to the file
    * @param response SaveDock service response
    * @return bool True if the dock was saved successfully
    */
-  bool saveDockCallback(
-    const std::shared_ptr<scitos2_msgs::srv::SaveDock::Request> request,
-    std::shared_ptr<scitos2_msgs::srv::SaveDock::Response> response);
+  bool saveDock(
+    const std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> & scans,
+    const std::string & filename, scitos2_msgs::srv::SaveDock::Response & response);
+
+  /**
+   * @brief Extract the pointcloud of the dock from a scan, the cluster in front of the robot.
+   *
+   * @param scan The scan
+   * @param dock The pointcloud of the dock
+   * @return bool If the scan has any cluster
+   */
+  bool extractDockPointcloud(const sensor_msgs::msg::LaserScan & scan, Pcloud & dock);
 
-protected:
   // The timeout for saving the dock in service
   std::shared_ptr<rclcpp::Duration> save_dock_timeout_;
 
+  // The number of scans fused into the dock and the distance between its points
+  int capture_scans_{1};
+  double capture_resolution_{0.0};
+
+  // The maximum age of a buffered scan to answer a request with it
+  std::shared_ptr<rclcpp::Duration> scan_max_age_;
+
+  // The scan subscriptions, created on the first request of each topic, and their recent scans
+  std::map<std::string, rclcpp::Subscription<sensor_msgs::msg::LaserScan>::SharedPtr> scan_subs_;
+  std::map<std::string, std::deque<sensor_msgs::msg::LaserScan::ConstSharedPtr>> scan_buffers_;
+
+  // The requests waiting for scans
+  std::vector<std::shared_ptr<PendingRequest>> pending_requests_;
+
   // Perception module to interact with scans and point clouds
   std::shared_ptr<Perception> perception_;
 
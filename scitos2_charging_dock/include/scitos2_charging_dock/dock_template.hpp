@@ -0,0 +1,250 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_CHARGING_DOCK__DOCK_TEMPLATE_HPP_
+#define SCITOS2_CHARGING_DOCK__DOCK_TEMPLATE_HPP_
+
+// PCL
+#include <pcl/search/kdtree.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "scitos2_charging_dock/cluster.hpp"
+#include "scitos2_charging_dock/correlative_matcher_2d.hpp"
+#include "scitos2_charging_dock/scan_matcher_2d.hpp"
+#include "scitos2_charging_dock/shape_descriptor.hpp"
+
+namespace scitos2_charging_dock
+{
+
+/**
+ * @struct scitos2_charging_dock::DockTemplateLevel
+ * @brief Level of the resolution pyramid of the dock template with its own search structures.
+ */
+struct DockTemplateLevel
+{
+  // Resampled pointcloud of the dock
+  Pcloud::ConstPtr cloud;
+  // KD-tree of the pointcloud for the PCL matcher
+  pcl::search::KdTree<pcl::PointXYZ>::Ptr tree;
+  // Nearest neighbour grid of the pointcloud for the SE(2) matcher
+  std::shared_ptr<const NearestGrid2D> grid;
+  // Mean distance between consecutive points
+  double spacing{0.0};
+};
+
+/**
+ * @class scitos2_charging_dock::DockTemplate
+ * @brief Pointcloud of the dock with the search structures used to match the clusters
+ * against it. They are built once when the template is loaded and shared read-only.
+ */
+struct DockTemplate
+{
+  // Pointcloud of the dock
+  Pcloud::ConstPtr cloud;
+  // KD-tree of the pointcloud for the PCL matcher
+  pcl::search::KdTree<pcl::PointXYZ>::Ptr tree;
+  // Nearest neighbour grid of the pointcloud for the SE(2) matcher
+  std::shared_ptr<const NearestGrid2D> grid;
+  // Likelihood field of the pointcloud for the correlative search
+  std::shared_ptr<const CorrelativeGrid2D> likelihood;
+  // Shape signature of the pointcloud to discard clusters before matching
+  ShapeDescriptor descriptor;
+  // Circle around the pointcloud, used to locate the dock in the scan
+  pcl::PointXYZ center{0.0f, 0.0f, 0.0f};
+  double radius{0.0};
+  // Resolution pyramid, from the pointcloud itself to the coarsest level
+  std::vector<DockTemplateLevel> levels;
+  // Parameters the search structures were built with
+  double correspondence_distance{0.0};
+  int requested_levels{0};
+
+  /**
+   * @brief Create an empty dock template.
+   */
+  DockTemplate() = default;
+
+  /**
+   * @brief Create a dock template and build its search structures.
+   *
+   * @param dock The pointcloud of the dock
+   * @param max_correspondence_distance The distance covered by the nearest neighbour grid
+   * @param num_levels The number of levels of the resolution pyramid, each one with twice the
+   * spacing of the previous one
+   */
+  DockTemplate(const Pcloud & dock, double max_correspondence_distance, int num_levels = 1)
+  : correspondence_distance(max_correspondence_distance), requested_levels(num_levels)
+  {
+    // The finest level is the pointcloud itself
+    const double dock_spacing = spacing(dock);
+    levels.push_back(createLevel(dock, dock_spacing, max_correspondence_distance));
+    cloud = levels.front().cloud;
+    tree = levels.front().tree;
+    grid = levels.front().grid;
+
+    // The coarser levels are resampled along the profile of the dock
+    for (int level = 1; level < num_levels && dock_spacing > 0.0; level++) {
+      const double level_spacing = std::ldexp(dock_spacing, level);
+      Pcloud resampled = resample(dock, level_spacing);
+      if (resampled.size() < 3) {
+        break;
+      }
+      levels.push_back(createLevel(resampled, level_spacing, max_correspondence_distance));
+    }
+
+    likelihood = std::make_shared<CorrelativeGrid2D>(dock);
+    descriptor = ShapeDescriptor(dock);
+
+    ClusterStatistics statistics;
+    for (const auto & point : dock.points) {
+      statistics.add(point);
+    }
+    if (statistics.count > 0) {
+      center.x = static_cast<float>(statistics.sum_x / statistics.count);
+      center.y = static_cast<float>(statistics.sum_y / statistics.count);
+    }
+    for (const auto & point : dock.points) {
+      radius = std::max(
+        radius, static_cast<double>(std::hypot(point.x - center.x, point.y - center.y)));
+    }
+  }
+
+  /**
+   * @brief Check if the template has no points.
+   *
+   * @return bool If the template has no points
+   */
+  bool empty() const {return !cloud || cloud->empty();}
+
+  /**
+   * @brief Get the width of the template.
+   *
+   * @return double The width of the template
+   */
+  double width() const
+  {
+    if (empty()) {
+      return 0.0;
+    }
+
+    double dx = cloud->back().x - cloud->front().x;
+    double dy = cloud->back().y - cloud->front().y;
+    return std::hypot(dx, dy);
+  }
+
+  /**
+   * @brief Select the coarsest level that is not sparser than a cluster, so the matching does
+   * not spend time on more template points than the cluster can resolve.
+   *
+   * @param cluster_spacing The mean distance between consecutive points of the cluster
+   * @return size_t The index of the level
+   */
+  size_t selectLevel(double cluster_spacing) const
+  {
+    size_t selected = 0;
+    for (size_t level = 1; level < levels.size(); level++) {
+      if (levels[level].spacing <= cluster_spacing) {
+        selected = level;
+      }
+    }
+    return selected;
+  }
+
+  /**
+   * @brief Get the mean distance between consecutive points of an ordered pointcloud.
+   *
+   * @param points The pointcloud
+   * @return double The mean distance, 0 with less than two points
+   */
+  static double spacing(const Pcloud & points)
+  {
+    if (points.size() < 2) {
+      return 0.0;
+    }
+    double length = 0.0;
+    for (size_t i = 1; i < points.size(); i++) {
+      length += std::hypot(points[i].x - points[i - 1].x, points[i].y - points[i - 1].y);
+    }
+    return length / static_cast<double>(points.size() - 1);
+  }
+
+  /**
+   * @brief Resample an ordered pointcloud at a constant distance along its profile.
+   *
+   * @param points The pointcloud
+   * @param step The distance between the resampled points
+   * @return Pcloud The resampled pointcloud, including both ends
+   */
+  static Pcloud resample(const Pcloud & points, double step)
+  {
+    Pcloud resampled;
+    resampled.header = points.header;
+    if (points.empty() || step <= 0.0) {
+      return resampled;
+    }
+
+    resampled.push_back(points.front());
+    double next = step, travelled = 0.0;
+    for (size_t i = 1; i < points.size(); i++) {
+      const auto & a = points[i - 1];
+      const auto & b = points[i];
+      const double length = std::hypot(b.x - a.x, b.y - a.y);
+      while (length > 0.0 && next <= travelled + length) {
+        const float t = static_cast<float>((next - travelled) / length);
+        resampled.push_back(
+          pcl::PointXYZ(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.z + t * (b.z - a.z)));
+        next += step;
+      }
+      travelled += length;
+    }
+    // Keep the end of the profile, unless the last point is already close to it
+    const auto & last = resampled.back();
+    if (std::hypot(points.back().x - last.x, points.back().y - last.y) > 0.5 * step) {
+      resampled.push_back(points.back());
+    }
+    return resampled;
+  }
+
+protected:
+  /**
+   * @brief Build the search structures of a level of the pyramid.
+   *
+   * @param points The pointcloud of the level
+   * @param level_spacing The distance between consecutive points
+   * @param max_correspondence_distance The distance covered by the nearest neighbour grid
+   * @return DockTemplateLevel The level
+   */
+  static DockTemplateLevel createLevel(
+    const Pcloud & points, double level_spacing, double max_correspondence_distance)
+  {
+    DockTemplateLevel level;
+    auto level_cloud = std::make_shared<Pcloud>(points);
+    level.cloud = level_cloud;
+    level.tree = std::make_shared<pcl::search::KdTree<pcl::PointXYZ>>();
+    level.tree->setInputCloud(level_cloud);
+    level.grid = std::make_shared<NearestGrid2D>(
+      points, static_cast<float>(max_correspondence_distance));
+    level.spacing = level_spacing;
+    return level;
+  }
+};
+
+}  // namespace scitos2_charging_dock
+
+#endif  // SCITOS2_CHARGING_DOCK__DOCK_TEMPLATE_HPP_
@@ -0,0 +1,77 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_CHARGING_DOCK__DOCK_TEMPLATE_FILE_HPP_
+#define SCITOS2_CHARGING_DOCK__DOCK_TEMPLATE_FILE_HPP_
+
+// C++
+#include <cstdint>
+#include <string>
+
+#include "scitos2_charging_dock/dock_template.hpp"
+
+namespace scitos2_charging_dock
+{
+
+/**
+ * @class scitos2_charging_dock::DockTemplateFile
+ * @brief Precompiled binary format of the dock template. It stores the pointcloud of every
+ * level of the pyramid together with the shape descriptor, the nearest neighbour grids and the
+ * likelihood field, so a template is ready to match right after it is loaded instead of
+ * rebuilding the grids on every configure. The file is written next to the PCD of the dock and
+ * read through a read-only memory mapping.
+ */
+class DockTemplateFile
+{
+public:
+  // Version of the format, increased on every incompatible change
+  static constexpr uint32_t VERSION = 1;
+
+  /**
+   * @brief Get the path of the precompiled template of a PCD file.
+   *
+   * @param pcd_path The path of the PCD file
+   * @return std::string The path with the extension replaced by .sdt
+   */
+  static std::string path(const std::string & pcd_path);
+
+  /**
+   * @brief Write a dock template to a file. The file is written to a temporary path and then
+   * renamed, so readers never see a partial file.
+   *
+   * @param filepath The path of the file
+   * @param dock_template The dock template
+   * @return bool If the file was written
+   */
+  static bool write(const std::string & filepath, const DockTemplate & dock_template);
+
+  /**
+   * @brief Read a dock template from a file. Files of another version, byte order or build
+   * parameters are rejected.
+   *
+   * @param filepath The path of the file
+   * @param max_correspondence_distance The distance covered by the nearest neighbour grids
+   * @param num_levels The number of levels of the pyramid
+   * @param dock_template The dock template
+   * @return bool If the file was read
+   */
+  static bool read(
+    const std::string & filepath, double max_correspondence_distance, int num_levels,
+    DockTemplate & dock_template);
+};
+
+}  // namespace scitos2_charging_dock
+
+#endif  // SCITOS2_CHARGING_DOCK__DOCK_TEMPLATE_FILE_HPP_
@@ -20,6 +20,7 @@
 #include <pcl/point_types.h>
 
 // C++
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -30,7 +31,10 @@
 #include "rclcpp/rclcpp.hpp"
 #include "rcl_interfaces/msg/set_parameters_result.hpp"
 #include "scitos2_charging_dock/cluster.hpp"
+#include "scitos2_charging_dock/dock_template.hpp"
+#include "scitos2_charging_dock/dock_template_file.hpp"
 #include "scitos2_charging_dock/segmentation.hpp"
+#include "scitos2_charging_dock/worker_pool.hpp"
 #include "sensor_msgs/msg/laser_scan.hpp"
 #include "sensor_msgs/msg/point_cloud2.hpp"
 #include "tf2/LinearMath/Transform.h"
@@ -64,7 +68,7 @@ public:
   ~Perception();
 
   /**
-   * @brief Store the dock pointcloud to a PCD file.
+   * @brief Store the dock pointcloud to a PCD file, together with its precompiled template.
    *
    * @param filepath The path to the file
    * @param dock The dock to store
@@ -72,14 +76,49 @@ public:
    */
   bool storeDockPointcloud(std::string filepath, const Pcloud & dock);
 
+  /**
+   * @brief Fuse the pointclouds of the dock captured in several scans into a dense template.
+   * The pointclouds are registered to the densest one, merged in the order of their bearing
+   * relative to the direction of the dock, smoothed over as many neighbours as fused scans and
+   * resampled at a constant distance along the profile. The pointclouds that do not match the
+   * reference are discarded.
+   *
+   * @param clouds The pointclouds of the dock, in the frame of the sensor
+   * @param resolution The distance between the points of the template, the mean spacing of the
+   * reference if not positive
+   * @param dock The fused pointcloud
+   * @param mean_residual The mean distance of the registered points to the fused profile
+   * @param max_residual The maximum distance of the registered points to the fused profile
+   * @return size_t The number of fused pointclouds
+   */
+  size_t fuseDockPointclouds(
+    const std::vector<Pcloud> & clouds, double resolution, Pcloud & dock,
+    double & mean_residual, double & max_residual);
+
   /**
    * @brief Get the dock pose from the scan.
+   * A scan with the same stamp and frame as the last processed one is not processed again:
+   * the last detection is returned, propagated to the current time if enabled.
+   * While tracking, the matching starts from the last detection with few iterations and
+   * falls back to the initial estimate if the dock is lost. The search structures of the
+   * template are rebuilt first if the correspondence distance changed.
    *
    * @param scan The scan to process
    * @return geometry_msgs::msg::PoseStamped The dock pose
    */
   geometry_msgs::msg::PoseStamped getDockPose(const sensor_msgs::msg::LaserScan & scan);
 
+  /**
+   * @brief Select the scan to process among the most recent ones: the newest scan whose
+   * transform to the frame of the initial estimate is already available at its stamp, so it is
+   * matched without waiting for the transform. The newest scan is selected if none has it.
+   *
+   * @param scans The scans, from the oldest to the newest
+   * @return sensor_msgs::msg::LaserScan::ConstSharedPtr The selected scan, null if none
+   */
+  sensor_msgs::msg::LaserScan::ConstSharedPtr selectScan(
+    const std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> & scans);
+
   /**
    * @brief Set the initial estimate of the dock pose.
    *
@@ -97,24 +136,183 @@ public:
   Clusters extractClustersFromScan(const sensor_msgs::msg::LaserScan & scan);
 
 protected:
+  /**
+   * @brief Parameters of the detection that can change at runtime. The parameter callback
+   * writes them under the lock and each scan is processed with a copy, which the worker threads
+   * share.
+   */
+  struct Parameters
+  {
+    // Debug flag for visualization
+    bool debug;
+    // Only use the first detection
+    bool use_first_detection;
+    // Matcher used to refine the clusters: "pcl" or "se2"
+    std::string matcher;
+    // ICP parameters
+    int icp_max_iter;
+    // Maximum number of iterations of each coarser level of the pyramid of the template
+    int coarse_max_iter;
+    double icp_min_score;
+    double icp_max_corr_dis;
+    double icp_max_trans_eps;
+    double icp_max_eucl_fit_eps;
+    // Maximum time to refine the clusters of a scan in seconds, 0 for no limit
+    double time_budget;
+    // Shape filter parameters
+    bool shape_filter;
+    double shape_extent_tolerance;
+    double shape_max_distance;
+    // Track the dock from the last detection, with a minimum number of iterations
+    bool tracking;
+    int tracking_min_iter;
+    // Correlative search to seed the matching when the estimate is poor
+    bool correlative_search;
+    double correlative_linear_window;
+    double correlative_angular_window;
+    double correlative_min_score;
+    // Propagate the last detection between scans with the odometry, up to a maximum age in
+    // seconds
+    bool propagate_detection;
+    double propagation_max_age;
+    // Correct the motion of the sensor between the beams of a scan
+    bool motion_compensation;
+    // Region of interest around the expected dock pose
+    bool region_of_interest;
+    double roi_angle_margin;
+    double roi_range_margin;
+  };
+
+  /**
+   * @brief Extract clusters from a scan.
+   *
+   * @param scan The scan to process
+   * @param params The parameters of the detection
+   * @return Clusters The clusters
+   */
+  Clusters extractClustersFromScan(
+    const sensor_msgs::msg::LaserScan & scan, const Parameters & params);
+
+  /**
+   * @brief Get a copy of the parameters of the detection, taken under the lock.
+   *
+   * @return Parameters The parameters
+   */
+  Parameters getParameters();
+
   /**
    * @brief Refine the cluster pose using Iterative Closest Point.
+   * The cluster is aligned to the template, so it must be in the frame of the template,
+   * i.e. moved by the inverse of the initial estimate or, while tracking, the last detection.
+   * Unless tracking, the correlative search can seed the matching inside a window around it.
+   * The matching runs coarse to fine over the pyramid of the template, with fewer iterations
+   * on the coarser levels.
    *
    * @param cluster The cluster to perform ICP on
-   * @param cloud_template The template to match with the cluster
-   * @return bool If the ICP was successful and the template is aligned with the cluster
+   * @param dock_template The template to match with the cluster
+   * @param params The parameters of the detection
+   * @param deadline Time after which the refinement is cancelled
+   * @return bool If the ICP was successful and the cluster is aligned with the template
+   */
+  bool refineClusterPose(
+    Cluster & cluster, const DockTemplate & dock_template, const Parameters & params,
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+  /**
+   * @brief Align a pointcloud to a level of the template with the configured matcher.
+   *
+   * @param source The pointcloud, in the frame of the template
+   * @param template_level The level of the template
+   * @param params The parameters of the detection
+   * @param max_iterations The maximum number of iterations
+   * @param deadline Time after which the alignment is cancelled
+   * @param transformation The transform that moves the pointcloud onto the template
+   * @param score The fitness score of the alignment
+   * @param iterations The number of iterations of the alignment
+   * @return bool If the alignment converged
    */
-  bool refineClusterPose(Cluster & cluster, const Pcloud & cloud_template);
+  bool alignToTemplate(
+    const Pcloud & source, const DockTemplateLevel & template_level, const Parameters & params,
+    int max_iterations, std::chrono::steady_clock::time_point deadline,
+    Eigen::Matrix4f & transformation, double & score, int & iterations);
 
   /**
    * @brief Refine all the clusters poses using Iterative Closest Point to find the dock.
+   * The clusters are refined concurrently on the worker pool and the dock is the cluster
+   * with the lowest score, or the lowest identifier on ties.
    *
    * @param clusters The clusters to perform ICP on
-   * @param dock_template A cluster with a cloud template to match with the clusters
+   * @param dock_template The template to match with the clusters
+   * @param params The parameters of the detection
    * @param dock The dock found
    * @return bool If the dock is found
    */
-  bool refineAllClustersPoses(Clusters & clusters, const Cluster & dock_template, Cluster & dock);
+  bool refineAllClustersPoses(
+    Clusters & clusters, const DockTemplate & dock_template, const Parameters & params,
+    Cluster & dock);
+
+  /**
+   * @brief Get the transform from the frame of a scan to the frame of the matching pose at
+   * the stamp of the scan.
+   *
+   * @param header The header of the points of the scan
+   * @param tf_scan The transform
+   * @return bool If the transform is available
+   */
+  bool lookupScanTransform(const pcl::PCLHeader & header, tf2::Transform & tf_scan);
+
+  /**
+   * @brief Estimate the velocity of the sensor during a scan from its motion relative to the
+   * fixed frame during the previous scan period.
+   *
+   * @param scan The scan
+   * @param vx Linear velocity along x in the frame of the sensor in m/s
+   * @param vy Linear velocity along y in the frame of the sensor in m/s
+   * @param wz Angular velocity in rad/s
+   * @return bool If the motion of the sensor is available
+   */
+  bool estimateSensorVelocity(
+    const sensor_msgs::msg::LaserScan & scan, double & vx, double & vy, double & wz);
+
+  /**
+   * @brief Move the last detection to the current time with the odometry, i.e. the motion of
+   * its frame relative to the fixed frame since the scan where it was detected. A detection in
+   * the fixed frame or older than the maximum age is not propagated.
+   *
+   * @param params The parameters of the detection
+   * @return geometry_msgs::msg::PoseStamped The propagated dock pose, or the last detection
+   * with its original stamp if it is not propagated
+   */
+  geometry_msgs::msg::PoseStamped propagateDetection(const Parameters & params);
+
+  /**
+   * @brief Move the last detection to the given time with the odometry.
+   *
+   * @param time The time to move the detection to
+   * @param dock_pose The moved detection
+   * @return bool If the transform is available
+   */
+  bool predictDetection(const tf2::TimePoint & time, geometry_msgs::msg::PoseStamped & dock_pose);
+
+  /**
+   * @brief Get the maximum number of iterations of the matching, which is adapted to the recent
+   * iterations while tracking.
+   *
+   * @param params The parameters of the detection
+   * @return int The maximum number of iterations
+   */
+  int getIterationCap(const Parameters & params) const;
+
+  /**
+   * @brief Restrict the segmentation to an angular and range window of the scan around the last
+   * detection, or the initial estimate before it. The window widens after each scan without
+   * the dock and covers the whole scan if the expected pose is not available.
+   *
+   * @param scan The scan to segment
+   * @param params The parameters of the detection
+   */
+  void updateRegionOfInterest(
+    const sensor_msgs::msg::LaserScan & scan, const Parameters & params);
 
   /**
    * @brief Load the dock template from a PCD file.
@@ -125,6 +323,16 @@ protected:
    */
   bool loadDockPointcloud(std::string filepath, Pcloud & dock);
 
+  /**
+   * @brief Load the dock template and its search structures. The precompiled template next to
+   * the PCD file is used if it is not older than the PCD file and was built with the same
+   * parameters, otherwise the template is built from the PCD file.
+   *
+   * @param filepath The path to the PCD file
+   * @return bool If the template was loaded
+   */
+  bool loadDockTemplate(std::string filepath);
+
   /**
    * @brief Create a PointCloud2 message from a PCL pointcloud.
    *
@@ -133,6 +341,27 @@ protected:
    */
   sensor_msgs::msg::PointCloud2 createPointCloud2Msg(const Pcloud & cloud);
 
+  /**
+   * @brief Create a PointCloud2 message from a coloured PCL pointcloud.
+   *
+   * @param cloud The pointcloud
+   * @return sensor_msgs::msg::PointCloud2 The PointCloud2 message
+   */
+  sensor_msgs::msg::PointCloud2 createPointCloud2Msg(
+    const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+
+  /**
+   * @brief Check if a debug publisher has subscribers, so the debug clouds are only built when
+   * someone listens.
+   *
+   * @param publisher The publisher
+   * @param params The parameters of the detection
+   * @return bool If debug is enabled and the publisher has subscribers
+   */
+  bool hasSubscribers(
+    const rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr & publisher,
+    const Parameters & params) const;
+
   /**
    * @brief Convert a Eigen matrix to a tf2 Transform.
    *
@@ -148,27 +377,42 @@ protected:
   rcl_interfaces::msg::SetParametersResult
   dynamicParametersCallback(std::vector<rclcpp::Parameter> parameters);
 
-  // Debug flag for visualization
-  bool debug_;
-  // ICP parameters
-  int icp_max_iter_;
-  double icp_min_score_;
-  double icp_max_corr_dis_;
-  double icp_max_trans_eps_;
-  double icp_max_eucl_fit_eps_;
+  // Parameters of the detection, only accessed under the lock
+  Parameters params_;
+  // Number of clusters checked and rejected by the shape filter
+  size_t shape_checked_{0};
+  size_t shape_rejected_{0};
   // Initial estimate of the dock pose
   geometry_msgs::msg::PoseStamped initial_estimate_pose_;
+  // Pose the clusters are matched from: the initial estimate or the tracked detection
+  geometry_msgs::msg::PoseStamped matching_pose_;
+  // If the current matching starts from the last detection
+  bool tracking_active_{false};
+  // Moving average of the iterations used to track the dock, negative if unknown
+  double tracking_iterations_{-1.0};
   // Segmentation
   std::unique_ptr<Segmentation> segmentation_;
+  // Pool of threads to refine the clusters
+  std::unique_ptr<WorkerPool> worker_pool_;
 
-  // A cluster with the dock template pointcloud
-  Cluster dock_template_;
+  // The dock template pointcloud and its search structures
+  DockTemplate dock_template_;
+  // Number of levels of the resolution pyramid of the template
+  int template_levels_;
   // Last detected dock
   Cluster detected_dock_;
   // Dock found
   bool dock_found_;
-  // Only use the first detection
-  bool use_first_detection_{false};
+  // Stamp and frame of the last processed scan
+  bool scan_processed_{false};
+  builtin_interfaces::msg::Time last_scan_stamp_;
+  std::string last_scan_frame_;
+  // Stamp of the scan where the dock was last detected
+  builtin_interfaces::msg::Time detection_stamp_;
+  // Frame fixed in the world used to propagate the detection and correct the motion of the sensor
+  std::string fixed_frame_;
+  // Consecutive scans processed without finding the dock
+  int roi_misses_{0};
 
   std::string name_;
   rclcpp::Clock::SharedPtr clock_;
@@ -179,6 +423,8 @@ protected:
   rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr target_cloud_pub_;
   rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr dock_cloud_pub_;
   rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr dock_template_pub_;
+  // Template cloud last published, it is only published again when it changes
+  Pcloud::ConstPtr published_template_;
 
   // Dynamic parameters handler
   rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr dyn_params_handler_;
@@ -0,0 +1,291 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_CHARGING_DOCK__SCAN_MATCHER_2D_HPP_
+#define SCITOS2_CHARGING_DOCK__SCAN_MATCHER_2D_HPP_
+
+// C++
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Eigen
+#include <Eigen/Core>
+
+// ROS
+#include "scitos2_charging_dock/cluster.hpp"
+
+namespace scitos2_charging_dock
+{
+
+/**
+ * @class scitos2_charging_dock::NearestGrid2D
+ * @brief Precomputed nearest neighbour field over a regular grid around an ordered 2D cloud.
+ * Each cell stores the index of the point nearest to its center, so a query inside the grid is
+ * a lookup followed by a short walk along the neighbours of the cloud. Queries outside the grid
+ * fall back to a linear search.
+ */
+class NearestGrid2D
+{
+public:
+  using Point = Eigen::Vector2f;
+  using Points = std::vector<Point>;
+
+  /**
+   * @brief Build the grid around a cloud. Only the x and y coordinates are used.
+   *
+   * @param cloud The cloud
+   * @param margin The distance to cover around the bounding box of the cloud
+   * @param resolution The size of the cells
+   */
+  NearestGrid2D(const Pcloud & cloud, float margin, float resolution = 0.005f);
+
+  /**
+   * @brief Restore a grid from its points and cells, e.g. loaded from a file.
+   *
+   * @param points The points of the cloud
+   * @param origin The corner of the first cell
+   * @param resolution The size of the cells
+   * @param width The number of columns
+   * @param height The number of rows
+   * @param cells The index of the nearest point of each cell, row by row
+   */
+  NearestGrid2D(
+    Points points, const Point & origin, float resolution, int width, int height,
+    std::vector<uint32_t> cells)
+  : points_(std::move(points)), origin_(origin), resolution_(resolution), width_(width),
+    height_(height), cells_(std::move(cells)) {}
+
+  /**
+   * @brief Check if the grid has no points.
+   *
+   * @return bool If the grid has no points
+   */
+  bool empty() const {return points_.empty();}
+
+  /**
+   * @brief Get the points of the cloud.
+   *
+   * @return const Points & The points
+   */
+  const Points & points() const {return points_;}
+
+  /**
+   * @brief Get the corner of the first cell.
+   *
+   * @return const Point & The origin
+   */
+  const Point & origin() const {return origin_;}
+
+  /**
+   * @brief Get the size of the cells.
+   *
+   * @return float The resolution
+   */
+  float resolution() const {return resolution_;}
+
+  /**
+   * @brief Get the number of columns.
+   *
+   * @return int The width
+   */
+  int width() const {return width_;}
+
+  /**
+   * @brief Get the number of rows.
+   *
+   * @return int The height
+   */
+  int height() const {return height_;}
+
+  /**
+   * @brief Get the index of the nearest point of each cell.
+   *
+   * @return const std::vector<uint32_t> & The cells, row by row
+   */
+  const std::vector<uint32_t> & cells() const {return cells_;}
+
+  /**
+   * @brief Find the nearest point of the cloud.
+   *
+   * @param point The query point
+   * @param distance_sq The squared distance to the nearest point
+   * @return size_t The index of the nearest point
+   */
+  size_t nearest(const Point & point, float & distance_sq) const;
+
+  /**
+   * @brief Find the closest point on the segments around the nearest point of the cloud.
+   *
+   * @param point The query point
+   * @param distance_sq The squared distance to the closest point
+   * @return Point The closest point
+   */
+  Point closest(const Point & point, float & distance_sq) const;
+
+protected:
+  Points points_;
+  Point origin_{Point::Zero()};
+  float resolution_;
+  int width_{0};
+  int height_{0};
+  std::vector<uint32_t> cells_;
+};
+
+/**
+ * @class scitos2_charging_dock::ScanMatcher2D
+ * @brief Iterative Closest Point restricted to planar motions (x, y, yaw).
+ * Each source point is paired with the closest point on the segments of the ordered target
+ * around its nearest neighbour, and each iteration solves the rigid SE(2) transform in closed
+ * form from the centroids and the cross-covariance of the correspondences. The interface
+ * mirrors pcl::IterativeClosestPoint so both matchers can be used interchangeably.
+ */
+class ScanMatcher2D
+{
+public:
+  using Point = Eigen::Vector2f;
+  using Points = std::vector<Point>;
+
+  /**
+   * @brief Construct for scitos2_charging_dock::ScanMatcher2D
+   */
+  ScanMatcher2D() = default;
+
+  /**
+   * @brief Destroy the ScanMatcher2D object
+   */
+  ~ScanMatcher2D() = default;
+
+  /**
+   * @brief Set the maximum number of iterations.
+   *
+   * @param max_iterations The maximum number of iterations
+   */
+  void setMaximumIterations(int max_iterations) {max_iterations_ = max_iterations;}
+
+  /**
+   * @brief Set the maximum distance between two points to be considered a correspondence.
+   *
+   * @param distance The maximum correspondence distance
+   */
+  void setMaxCorrespondenceDistance(double distance) {max_correspondence_distance_ = distance;}
+
+  /**
+   * @brief Set the squared increment of the transformation below which the matcher stops.
+   *
+   * @param epsilon The transformation epsilon
+   */
+  void setTransformationEpsilon(double epsilon) {transformation_epsilon_ = epsilon;}
+
+  /**
+   * @brief Set the change of the mean squared error below which the matcher stops.
+   *
+   * @param epsilon The euclidean fitness epsilon
+   */
+  void setEuclideanFitnessEpsilon(double epsilon) {euclidean_fitness_epsilon_ = epsilon;}
+
+  /**
+   * @brief Set the time after which the alignment is cancelled without converging.
+   *
+   * @param deadline The deadline
+   */
+  void setDeadline(std::chrono::steady_clock::time_point deadline) {deadline_ = deadline;}
+
+  /**
+   * @brief Set the cloud to be aligned. Only the x and y coordinates are used.
+   *
+   * @param cloud The source cloud
+   */
+  void setInputSource(const Pcloud & cloud);
+
+  /**
+   * @brief Set the cloud to align to. Only the x and y coordinates are used.
+   * A nearest neighbour grid covering the correspondence distance is built for it.
+   *
+   * @param cloud The target cloud
+   */
+  void setInputTarget(const Pcloud & cloud);
+
+  /**
+   * @brief Set a prebuilt nearest neighbour grid as the target, so it can be shared
+   * between several alignments.
+   *
+   * @param grid The target grid
+   */
+  void setSearchGridTarget(std::shared_ptr<const NearestGrid2D> grid) {target_ = grid;}
+
+  /**
+   * @brief Align the source to the target.
+   *
+   * @param output The source cloud transformed with the final transformation, on the plane
+   */
+  void align(Pcloud & output);
+
+  /**
+   * @brief Check if the last alignment converged.
+   *
+   * @return bool If the alignment converged
+   */
+  bool hasConverged() const {return converged_;}
+
+  /**
+   * @brief Get the mean squared distance from the aligned source points to their nearest
+   * target points. Same semantics as pcl::Registration::getFitnessScore.
+   *
+   * @return double The fitness score
+   */
+  double getFitnessScore() const {return fitness_score_;}
+
+  /**
+   * @brief Get the number of iterations of the last alignment.
+   *
+   * @return int The number of iterations
+   */
+  int getIterations() const {return iterations_;}
+
+  /**
+   * @brief Get the final transformation as a 3D homogeneous matrix.
+   *
+   * @return Eigen::Matrix4f The final transformation
+   */
+  Eigen::Matrix4f getFinalTransformation() const;
+
+protected:
+  // Parameters
+  int max_iterations_{300};
+  double max_correspondence_distance_{0.25};
+  double transformation_epsilon_{0.0};
+  double euclidean_fitness_epsilon_{0.0};
+  std::chrono::steady_clock::time_point deadline_{std::chrono::steady_clock::time_point::max()};
+
+  // Input clouds
+  pcl::PCLHeader source_header_;
+  Points source_;
+  std::shared_ptr<const NearestGrid2D> target_;
+
+  // Results
+  Eigen::Matrix2f rotation_{Eigen::Matrix2f::Identity()};
+  Eigen::Vector2f translation_{Eigen::Vector2f::Zero()};
+  double fitness_score_{std::numeric_limits<double>::max()};
+  int iterations_{0};
+  bool converged_{false};
+};
+
+}  // namespace scitos2_charging_dock
+
+#endif  // SCITOS2_CHARGING_DOCK__SCAN_MATCHER_2D_HPP_
@@ -0,0 +1,99 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_CHARGING_DOCK__SCAN_MERGER_HPP_
+#define SCITOS2_CHARGING_DOCK__SCAN_MERGER_HPP_
+
+// C++
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ROS
+#include "rclcpp/rclcpp.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
+#include "tf2/LinearMath/Transform.h"
+#include "tf2_ros/buffer.h"
+
+namespace scitos2_charging_dock
+{
+
+/**
+ * @class scitos2_charging_dock::ScanMerger
+ * @brief Merge the scans of several lasers, e.g. a front and a rear laser, into a single
+ * scan around a common frame, so the dock is perceived by whichever laser sees it. The beams
+ * are moved with the extrinsic transform of each laser, looked up once and cached, and binned
+ * by their angle in the common frame keeping the nearest return. Only the latest scan of each
+ * laser close in time to the newest one is merged, without correcting the motion of the robot
+ * between them, so the sync tolerance bounds the lag of the older beams.
+ */
+class ScanMerger
+{
+public:
+  /**
+   * @brief Create a scan merger.
+   *
+   * @param tf The tf buffer
+   * @param frame The common frame of the merged scans
+   * @param sources The number of lasers
+   * @param sync_tolerance The maximum time difference between the merged scans in seconds
+   */
+  ScanMerger(
+    std::shared_ptr<tf2_ros::Buffer> tf, const std::string & frame, size_t sources,
+    double sync_tolerance);
+
+  /**
+   * @brief Add the latest scan of a laser and merge it with the latest scans of the others.
+   * It is safe to call from several threads.
+   *
+   * @param source The index of the laser
+   * @param scan The scan
+   * @return sensor_msgs::msg::LaserScan::ConstSharedPtr The merged scan, stamped with the given
+   * scan, or null if it is not newer than the other scans and the last merged scan, or if no
+   * extrinsic transform is available yet
+   */
+  sensor_msgs::msg::LaserScan::ConstSharedPtr addScan(
+    size_t source, sensor_msgs::msg::LaserScan::ConstSharedPtr scan);
+
+protected:
+  /**
+   * @brief Get the transform from the frame of a laser to the common frame. The lasers are
+   * fixed to the robot, so it is looked up once and cached.
+   *
+   * @param sensor_frame The frame of the laser
+   * @param extrinsic The transform
+   * @return bool If the transform is available
+   */
+  bool lookupExtrinsic(const std::string & sensor_frame, tf2::Transform & extrinsic);
+
+  std::shared_ptr<tf2_ros::Buffer> tf_buffer_;
+  std::string frame_;
+  double sync_tolerance_;
+  rclcpp::Logger logger_{rclcpp::get_logger("ScanMerger")};
+
+  std::mutex mutex_;
+  // Latest scan of each laser
+  std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> latest_scans_;
+  // Stamp of the last merged scan
+  rclcpp::Time last_stamp_{0, 0, RCL_ROS_TIME};
+  // Extrinsic transform of each laser frame
+  std::unordered_map<std::string, tf2::Transform> extrinsics_;
+};
+
+}  // namespace scitos2_charging_dock
+
+#endif  // SCITOS2_CHARGING_DOCK__SCAN_MERGER_HPP_
@@ -54,7 +54,9 @@ public:
   ~Segmentation() = default;
 
   /**
-   * @brief Perform a segmentation using a euclidean distance base clustering.
+   * @brief Perform a segmentation using a euclidean distance base clustering. In a full turn,
+   * e.g. merged from several lasers, a segment over the seam of the scan is not split.
+   * The parameters changed meanwhile are applied to the next scan.
    *
    * @param scan The laserscan to clustering
    * @param clusters The clusters obtained
@@ -68,7 +70,33 @@ public:
    * @param clusters The clusters to filter
    * @return Clusters The filtered clusters
    */
-  Clusters filterClusters(const Clusters & clusters);
+  Clusters filterClusters(Clusters clusters);
+
+  /**
+   * @brief Set the velocity of the sensor during the next scans, used to correct the motion
+   * of the sensor between the beams. Zero disables the correction.
+   *
+   * @param vx Linear velocity along x in the frame of the sensor in m/s
+   * @param vy Linear velocity along y in the frame of the sensor in m/s
+   * @param wz Angular velocity in rad/s
+   */
+  void setSensorVelocity(double vx, double vy, double wz);
+
+  /**
+   * @brief Restrict the next scans to a window around the expected position of the dock.
+   * Only the beams inside the window are converted and clustered.
+   *
+   * @param angle_min Start angle of the window in the frame of the sensor in rad
+   * @param angle_max End angle of the window in the frame of the sensor in rad
+   * @param range_min Minimum range of the window in m
+   * @param range_max Maximum range of the window in m
+   */
+  void setRegionOfInterest(double angle_min, double angle_max, double range_min, double range_max);
+
+  /**
+   * @brief Remove the window, so the whole scan is segmented.
+   */
+  void clearRegionOfInterest();
 
   /**
    * @brief Callback executed when a parameter change is detected
@@ -88,12 +116,20 @@ protected:
   geometry_msgs::msg::Point fromPolarToCartesian(double range, double angle);
 
   /**
-   * @brief Convert a laserscan to a vector of points.
+   * @brief Update the cached cosine and sine of the beams if the geometry of the scan changed.
+   *
+   * @param scan The laserscan
+   */
+  void updateTrigonometricTables(const sensor_msgs::msg::LaserScan & scan);
+
+  /**
+   * @brief Convert the valid ranges of a laserscan to points. A window of interest over the
+   * seam of a full turn continues at the first beams.
    *
    * @param scan The laserscan to convert
-   * @return std::vector<geometry_msgs::msg::Point> The points
+   * @return Pcloud The points
    */
-  std::vector<geometry_msgs::msg::Point> scanToPoints(const sensor_msgs::msg::LaserScan & scan);
+  Pcloud scanToPoints(const sensor_msgs::msg::LaserScan & scan);
 
   /**
    * @brief Calculate the euclidean distance between two points.
@@ -113,8 +149,7 @@ protected:
    * @param threshold The threshold to consider a jump
    * @return bool If there is a jump
    */
-  bool isJumpBetweenPoints(
-    const geometry_msgs::msg::Point & p1, const geometry_msgs::msg::Point & p2, double threshold);
+  bool isJumpBetweenPoints(const pcl::PointXYZ & p1, const pcl::PointXYZ & p2, double threshold);
 
   // Dynamic parameters handler
   rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr dyn_params_handler_;
@@ -137,6 +172,27 @@ protected:
   double min_cluster_width_;
   // Maximum width of the cluster
   double max_cluster_width_;
+
+  // Cosine and sine of the beams, keyed by the geometry of the scan
+  float table_angle_min_{0.0f};
+  float table_angle_increment_{0.0f};
+  std::vector<float> cos_table_;
+  std::vector<float> sin_table_;
+  // Cartesian coordinates of all the beams of the last scan
+  std::vector<float> beam_x_;
+  std::vector<float> beam_y_;
+  // Velocity of the sensor to correct the motion between the beams
+  float velocity_x_{0.0f};
+  float velocity_y_{0.0f};
+  float velocity_yaw_{0.0f};
+  // Window of the scan to segment
+  bool roi_enabled_{false};
+  double roi_angle_min_{0.0};
+  double roi_angle_max_{0.0};
+  float roi_range_min_{0.0f};
+  float roi_range_max_{0.0f};
+  // If the last converted points cover a full turn, so the last one is next to the first one
+  bool closed_scan_{false};
 };
 
 }  // namespace scitos2_charging_dock
@@ -0,0 +1,173 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_CHARGING_DOCK__SHAPE_DESCRIPTOR_HPP_
+#define SCITOS2_CHARGING_DOCK__SHAPE_DESCRIPTOR_HPP_
+
+// C++
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+// Eigen
+#include <Eigen/Core>
+
+#include "scitos2_charging_dock/cluster.hpp"
+
+namespace scitos2_charging_dock
+{
+
+/**
+ * @class scitos2_charging_dock::ShapeDescriptor
+ * @brief Rigid invariant 2D signature of an ordered cloud, cheap enough to reject clusters
+ * before matching. It combines the extents along the principal axes with the turning function
+ * of the outline, i.e. the direction of the tangent relative to the chord from the first to the
+ * last point, sampled at constant arc length.
+ */
+struct ShapeDescriptor
+{
+  // Number of segments of the resampled outline
+  static constexpr int SEGMENTS = 16;
+
+  // Extent along the major principal axis
+  double major_extent{0.0};
+  // Extent along the minor principal axis
+  double minor_extent{0.0};
+  // Direction of each segment of the outline relative to the chord
+  std::array<double, SEGMENTS> turning_function{};
+
+  /**
+   * @brief Create an empty descriptor.
+   */
+  ShapeDescriptor() = default;
+
+  /**
+   * @brief Compute the descriptor of an ordered cloud. Only the x and y coordinates are used.
+   *
+   * @param cloud The cloud
+   */
+  explicit ShapeDescriptor(const Pcloud & cloud)
+  : ShapeDescriptor(cloud.points.data(), cloud.size()) {}
+
+  /**
+   * @brief Compute the descriptor of an ordered range of points.
+   *
+   * @param points The first point
+   * @param size The number of points
+   */
+  ShapeDescriptor(const pcl::PointXYZ * points, size_t size)
+  {
+    if (size < 2) {
+      return;
+    }
+
+    // Principal axes from the covariance of the points
+    Eigen::Vector2d mean = Eigen::Vector2d::Zero();
+    for (size_t i = 0; i < size; i++) {
+      mean += Eigen::Vector2d(points[i].x, points[i].y);
+    }
+    mean /= static_cast<double>(size);
+    Eigen::Matrix2d covariance = Eigen::Matrix2d::Zero();
+    for (size_t i = 0; i < size; i++) {
+      const Eigen::Vector2d d = Eigen::Vector2d(points[i].x, points[i].y) - mean;
+      covariance += d * d.transpose();
+    }
+    // Closed-form orientation of the major axis of a 2x2 covariance
+    const double theta =
+      0.5 * std::atan2(2.0 * covariance(0, 1), covariance(0, 0) - covariance(1, 1));
+    const Eigen::Vector2d major_axis(std::cos(theta), std::sin(theta));
+    const Eigen::Vector2d minor_axis(-std::sin(theta), std::cos(theta));
+
+    // Extents of the points projected on the axes
+    double min_major = 0.0, max_major = 0.0, min_minor = 0.0, max_minor = 0.0;
+    for (size_t i = 0; i < size; i++) {
+      const Eigen::Vector2d d = Eigen::Vector2d(points[i].x, points[i].y) - mean;
+      min_major = std::min(min_major, d.dot(major_axis));
+      max_major = std::max(max_major, d.dot(major_axis));
+      min_minor = std::min(min_minor, d.dot(minor_axis));
+      max_minor = std::max(max_minor, d.dot(minor_axis));
+    }
+    major_extent = max_major - min_major;
+    minor_extent = max_minor - min_minor;
+
+    // Resample the outline at constant arc length so the histogram does not depend on the
+    // density of the points
+    std::vector<double> arc_length(size, 0.0);
+    for (size_t i = 1; i < size; i++) {
+      arc_length[i] = arc_length[i - 1] +
+        std::hypot(points[i].x - points[i - 1].x, points[i].y - points[i - 1].y);
+    }
+    if (arc_length.back() <= 0.0) {
+      return;
+    }
+    std::array<Eigen::Vector2d, SEGMENTS + 1> samples;
+    size_t segment = 1;
+    for (int s = 0; s <= SEGMENTS; s++) {
+      const double target = arc_length.back() * s / SEGMENTS;
+      while (segment < size - 1 && arc_length[segment] < target) {
+        segment++;
+      }
+      const double length = arc_length[segment] - arc_length[segment - 1];
+      const double t = length > 0.0 ? (target - arc_length[segment - 1]) / length : 0.0;
+      const auto & a = points[segment - 1];
+      const auto & b = points[segment];
+      samples[s] = Eigen::Vector2d(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y));
+    }
+
+    // Direction of the segments relative to the chord
+    const Eigen::Vector2d chord = samples[SEGMENTS] - samples[0];
+    for (int s = 0; s < SEGMENTS; s++) {
+      const Eigen::Vector2d u = samples[s + 1] - samples[s];
+      turning_function[s] = std::atan2(chord.x() * u.y() - chord.y() * u.x(), chord.dot(u));
+    }
+  }
+
+  /**
+   * @brief Get the distance between the turning functions of two descriptors.
+   *
+   * @param other The other descriptor
+   * @return double The mean absolute difference of the directions in radians
+   */
+  double turningDistance(const ShapeDescriptor & other) const
+  {
+    double distance = 0.0;
+    for (int s = 0; s < SEGMENTS; s++) {
+      distance += std::abs(
+        std::remainder(turning_function[s] - other.turning_function[s], 2.0 * M_PI));
+    }
+    return distance / SEGMENTS;
+  }
+
+  /**
+   * @brief Check if the shape of a cluster can match the shape of this descriptor.
+   *
+   * @param other The descriptor of the cluster
+   * @param extent_tolerance The maximum difference of the extents in meters
+   * @param max_turning_distance The maximum distance between the turning functions
+   * @return bool If the shapes are compatible
+   */
+  bool matches(
+    const ShapeDescriptor & other, double extent_tolerance, double max_turning_distance) const
+  {
+    return std::abs(major_extent - other.major_extent) <= extent_tolerance &&
+           std::abs(minor_extent - other.minor_extent) <= extent_tolerance &&
+           turningDistance(other) <= max_turning_distance;
+  }
+};
+
+}  // namespace scitos2_charging_dock
+
+#endif  // SCITOS2_CHARGING_DOCK__SHAPE_DESCRIPTOR_HPP_
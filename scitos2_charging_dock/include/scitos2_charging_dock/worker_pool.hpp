@@ -0,0 +1,169 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_CHARGING_DOCK__WORKER_POOL_HPP_
+#define SCITOS2_CHARGING_DOCK__WORKER_POOL_HPP_
+
+// C++
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace scitos2_charging_dock
+{
+
+/**
+ * @class scitos2_charging_dock::WorkerPool
+ * @brief Fixed set of threads that run the iterations of a loop concurrently.
+ * The calling thread also takes iterations, so a pool of one thread runs the loop serially.
+ */
+class WorkerPool
+{
+public:
+  /**
+   * @brief Create the pool.
+   *
+   * @param num_threads The number of threads, including the calling thread
+   */
+  explicit WorkerPool(size_t num_threads)
+  {
+    for (size_t i = 1; i < num_threads; i++) {
+      threads_.emplace_back([this]() {workerLoop();});
+    }
+  }
+
+  /**
+   * @brief Stop and join the threads of the pool.
+   */
+  ~WorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto & thread : threads_) {
+      thread.join();
+    }
+  }
+
+  /**
+   * @brief Get the number of threads, including the calling thread.
+   *
+   * @return size_t The number of threads
+   */
+  size_t size() const {return threads_.size() + 1;}
+
+  /**
+   * @brief Run task(i) for every i in [0, n) and wait until all of them finish.
+   *
+   * @param n The number of iterations
+   * @param task The task to run for each iteration
+   */
+  void parallelFor(size_t n, const std::function<void(size_t)> & task)
+  {
+    if (threads_.empty() || n <= 1) {
+      for (size_t i = 0; i < n; i++) {
+        task(i);
+      }
+      return;
+    }
+
+    auto loop = std::make_shared<Loop>(task, n);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      loop_ = loop;
+    }
+    work_cv_.notify_all();
+
+    runTasks(*loop);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&]() {return loop->pending == 0;});
+    loop_.reset();
+  }
+
+protected:
+  /**
+   * @brief State of a loop shared by the threads that run it.
+   */
+  struct Loop
+  {
+    Loop(const std::function<void(size_t)> & loop_task, size_t n)
+    : task(loop_task), size(n), pending(n) {}
+
+    const std::function<void(size_t)> & task;
+    const size_t size;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> pending;
+  };
+
+  /**
+   * @brief Wait for loops and take iterations from them until the pool stops.
+   */
+  void workerLoop()
+  {
+    std::shared_ptr<Loop> last_loop;
+    while (true) {
+      std::shared_ptr<Loop> loop;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [&]() {return stop_ || (loop_ && loop_ != last_loop);});
+        if (stop_) {
+          return;
+        }
+        loop = loop_;
+      }
+      runTasks(*loop);
+      last_loop = loop;
+    }
+  }
+
+  /**
+   * @brief Take iterations of a loop until there are none left.
+   *
+   * @param loop The loop
+   */
+  void runTasks(Loop & loop)
+  {
+    while (true) {
+      const size_t i = loop.next.fetch_add(1);
+      if (i >= loop.size) {
+        return;
+      }
+      loop.task(i);
+      if (loop.pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_cv_.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  bool stop_{false};
+  // Loop being run
+  std::shared_ptr<Loop> loop_;
+};
+
+}  // namespace scitos2_charging_dock
+
+#endif  // SCITOS2_CHARGING_DOCK__WORKER_POOL_HPP_
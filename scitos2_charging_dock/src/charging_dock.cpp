@@ -14,7 +14,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "nav2_util/node_utils.hpp"
 #include "scitos2_charging_dock/charging_dock.hpp"
@@ -52,6 +57,16 @@ void ChargingDock::configure(
     node_, name + ".external_detection_rotation_roll", rclcpp::ParameterValue(-1.57));
   nav2_util::declare_parameter_if_not_declared(
     node_, name + ".filter_coef", rclcpp::ParameterValue(0.1));
+  nav2_util::declare_parameter_if_not_declared(
+    node_, name + ".background_perception", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node_, name + ".scan_buffer_size", rclcpp::ParameterValue(3));
+  nav2_util::declare_parameter_if_not_declared(
+    node_, name + ".scan_topics", rclcpp::ParameterValue(std::vector<std::string>{"scan"}));
+  nav2_util::declare_parameter_if_not_declared(
+    node_, name + ".scan_frame", rclcpp::ParameterValue("base_link"));
+  nav2_util::declare_parameter_if_not_declared(
+    node_, name + ".scan_sync_tolerance", rclcpp::ParameterValue(0.1));
 
   // This is how close robot should get to pose
   nav2_util::declare_parameter_if_not_declared(
@@ -76,6 +91,25 @@ void ChargingDock::configure(
   node_->get_parameter(name + ".docking_threshold", docking_threshold_);
   node_->get_parameter(name + ".staging_x_offset", staging_x_offset_);
   node_->get_parameter(name + ".staging_yaw_offset", staging_yaw_offset_);
+  node_->get_parameter(name + ".background_perception", background_perception_);
+  int scan_buffer_size;
+  node_->get_parameter(name + ".scan_buffer_size", scan_buffer_size);
+  scan_buffer_size_ = static_cast<size_t>(std::max(scan_buffer_size, 1));
+  std::vector<std::string> scan_topics;
+  node_->get_parameter(name + ".scan_topics", scan_topics);
+  if (scan_topics.empty()) {
+    scan_topics.push_back("scan");
+  }
+
+  // The scans of several lasers are merged around a common frame before the perception
+  if (scan_topics.size() > 1) {
+    std::string scan_frame;
+    double scan_sync_tolerance;
+    node_->get_parameter(name + ".scan_frame", scan_frame);
+    node_->get_parameter(name + ".scan_sync_tolerance", scan_sync_tolerance);
+    scan_merger_ = std::make_unique<ScanMerger>(
+      tf2_buffer_, scan_frame, scan_topics.size(), scan_sync_tolerance);
+  }
 
   // Setup perception
   perception_ = std::make_unique<Perception>(node_, name, tf2_buffer_);
@@ -94,11 +128,19 @@ void ChargingDock::configure(
     });
 
   dock_pose_.header.stamp = rclcpp::Time(0);
-  scan_sub_ = node_->create_subscription<sensor_msgs::msg::LaserScan>(
-    "scan", rclcpp::SensorDataQoS(),
-    [this](const sensor_msgs::msg::LaserScan::SharedPtr scan) {
-      scan_ = *scan;
-    });
+  for (size_t source = 0; source < scan_topics.size(); source++) {
+    scan_subs_.push_back(
+      node_->create_subscription<sensor_msgs::msg::LaserScan>(
+        scan_topics[source], rclcpp::SensorDataQoS(),
+        [this, source](sensor_msgs::msg::LaserScan::ConstSharedPtr scan) {
+          if (scan_merger_) {
+            scan = scan_merger_->addScan(source, std::move(scan));
+          }
+          if (scan) {
+            addScan(std::move(scan));
+          }
+        }));
+  }
 
   dock_pose_pub_ = node_->create_publisher<geometry_msgs::msg::PoseStamped>("dock_pose", 1);
   filtered_dock_pose_pub_ = node_->create_publisher<geometry_msgs::msg::PoseStamped>(
@@ -106,11 +148,126 @@ void ChargingDock::configure(
   staging_pose_pub_ = node_->create_publisher<geometry_msgs::msg::PoseStamped>("staging_pose", 1);
 }
 
+ChargingDock::~ChargingDock()
+{
+  stopPerceptionWorker();
+}
+
+void ChargingDock::activate()
+{
+  if (background_perception_) {
+    startPerceptionWorker();
+  }
+}
+
+void ChargingDock::deactivate()
+{
+  stopPerceptionWorker();
+}
+
+void ChargingDock::startPerceptionWorker()
+{
+  if (perception_thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock_scan(scan_mutex_);
+    perception_worker_stop_ = false;
+    new_scans_ = 0;
+  }
+  perception_thread_ = std::thread(&ChargingDock::perceptionLoop, this);
+}
+
+void ChargingDock::stopPerceptionWorker()
+{
+  {
+    std::lock_guard<std::mutex> lock_scan(scan_mutex_);
+    perception_worker_stop_ = true;
+  }
+  scan_cv_.notify_all();
+  if (perception_thread_.joinable()) {
+    perception_thread_.join();
+  }
+}
+
+void ChargingDock::addScan(sensor_msgs::msg::LaserScan::ConstSharedPtr scan)
+{
+  // Keep the scan in the ring without copying it, the oldest one is released
+  {
+    std::lock_guard<std::mutex> lock_scan(scan_mutex_);
+    scans_.push_back(std::move(scan));
+    scan_arrivals_.push_back(std::chrono::steady_clock::now());
+    if (scans_.size() > scan_buffer_size_) {
+      scans_.pop_front();
+      scan_arrivals_.pop_front();
+    }
+    new_scans_ = std::min(new_scans_ + 1, scans_.size());
+  }
+  if (background_perception_) {
+    scan_cv_.notify_one();
+  }
+}
+
+void ChargingDock::perceptionLoop()
+{
+  std::unique_lock<std::mutex> lock_scan(scan_mutex_);
+  while (!perception_worker_stop_) {
+    scan_cv_.wait(lock_scan, [this]() {return perception_worker_stop_ || new_scans_ > 0;});
+    if (perception_worker_stop_) {
+      break;
+    }
+
+    // Take the scans received since the last one processed
+    std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> scans(
+      scans_.end() - new_scans_, scans_.end());
+    std::vector<std::chrono::steady_clock::time_point> arrivals(
+      scan_arrivals_.end() - new_scans_, scan_arrivals_.end());
+    new_scans_ = 0;
+
+    // Do not hold the lock while processing so the scan callback never blocks
+    lock_scan.unlock();
+    {
+      std::lock_guard<std::mutex> lock_perception(perception_mutex_);
+      // The scans are only processed while the docking provides an initial estimate and keeps
+      // asking for the dock pose, a request older than the detection timeout ends the attempt
+      const auto start = std::chrono::steady_clock::now();
+      const bool requested = start - last_pose_request_.load() <=
+        std::chrono::duration<double>(external_detection_timeout_);
+      if (has_initial_estimate_ && requested) {
+        auto scan = perception_->selectScan(scans);
+        const auto selected = std::find(scans.begin(), scans.end(), scan) - scans.begin();
+        dropped_scans_ += scans.size() - 1;
+        auto detection = std::make_shared<DockDetection>();
+        detection->pose = perception_->getDockPose(*scan);
+        const auto end = std::chrono::steady_clock::now();
+        detection->queue_delay =
+          std::chrono::duration<double>(start - arrivals[selected]).count();
+        detection->processing_time = std::chrono::duration<double>(end - start).count();
+        std::atomic_store(&detection_, std::shared_ptr<const DockDetection>(detection));
+        processed_scans_++;
+        RCLCPP_DEBUG(
+          node_->get_logger(),
+          "Scan processed in %.1f ms after waiting %.1f ms (%lu processed, %lu dropped)",
+          detection->processing_time * 1e3, detection->queue_delay * 1e3, processed_scans_,
+          dropped_scans_);
+      }
+    }
+    lock_scan.lock();
+  }
+}
+
 geometry_msgs::msg::PoseStamped ChargingDock::getStagingPose(
   const geometry_msgs::msg::Pose & pose, const std::string & frame)
 {
   // Send the initial estimate to the perception module
-  perception_->setInitialEstimate(pose, frame);
+  {
+    std::lock_guard<std::mutex> lock_perception(perception_mutex_);
+    perception_->setInitialEstimate(pose, frame);
+    has_initial_estimate_ = true;
+    last_pose_request_ = std::chrono::steady_clock::now();
+    // The detections of the previous estimate are no longer valid
+    std::atomic_store(&detection_, std::shared_ptr<const DockDetection>());
+  }
 
   // Compute the staging pose with given offsets
   const double yaw = tf2::getYaw(pose.orientation);
@@ -132,7 +289,28 @@ geometry_msgs::msg::PoseStamped ChargingDock::getStagingPose(
 bool ChargingDock::getRefinedPose(geometry_msgs::msg::PoseStamped & pose, std::string /*id*/)
 {
   // Get current detections, transform to frame, and apply offsets
-  geometry_msgs::msg::PoseStamped detected = perception_->getDockPose(scan_);
+  geometry_msgs::msg::PoseStamped detected;
+  if (background_perception_) {
+    // Keep the perception thread processing the scans while the docking asks for the pose
+    last_pose_request_ = std::chrono::steady_clock::now();
+    // Only read the latest result so the controller never waits for the perception
+    auto detection = std::atomic_load(&detection_);
+    if (detection) {
+      detected = detection->pose;
+    }
+  } else {
+    // Only the pointers of the scans are copied, the callback keeps receiving meanwhile
+    std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> scans;
+    {
+      std::lock_guard<std::mutex> lock_scan(scan_mutex_);
+      scans.assign(scans_.begin(), scans_.end());
+    }
+    std::lock_guard<std::mutex> lock_perception(perception_mutex_);
+    auto scan = perception_->selectScan(scans);
+    if (scan) {
+      detected = perception_->getDockPose(*scan);
+    }
+  }
 
   // Validate that external pose is new enough
   auto timeout = rclcpp::Duration::from_seconds(external_detection_timeout_);
@@ -198,6 +376,10 @@ bool ChargingDock::isCharging()
 
 bool ChargingDock::isDocked()
 {
+  // The docking attempt is over, so the perception thread stops processing the scans
+  if (is_charging_) {
+    has_initial_estimate_ = false;
+  }
   return is_charging_;
 }
 
@@ -208,6 +390,10 @@ bool ChargingDock::disableCharging()
 
 bool ChargingDock::hasStoppedCharging()
 {
+  // The undocking is over, so the staging pose is not an estimate of the dock anymore
+  if (!isCharging()) {
+    has_initial_estimate_ = false;
+  }
   return !isCharging();
 }
 
@@ -0,0 +1,248 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "scitos2_charging_dock/correlative_matcher_2d.hpp"
+
+namespace scitos2_charging_dock
+{
+
+CorrelativeGrid2D::CorrelativeGrid2D(const Pcloud & cloud, float resolution, int levels)
+: resolution_(resolution)
+{
+  if (cloud.empty() || resolution <= 0.0f) {
+    return;
+  }
+
+  // Bounding box of the cloud with the tail of the gaussian
+  const float sigma = resolution;
+  const float margin = 3.0f * sigma;
+  Eigen::Vector2f min_point(cloud.front().x, cloud.front().y), max_point = min_point;
+  for (const auto & point : cloud) {
+    min_point = min_point.cwiseMin(Eigen::Vector2f(point.x, point.y));
+    max_point = max_point.cwiseMax(Eigen::Vector2f(point.x, point.y));
+  }
+  origin_ = min_point - Eigen::Vector2f(margin, margin);
+  const Eigen::Vector2f size = max_point - min_point + 2.0f * Eigen::Vector2f(margin, margin);
+  width_ = static_cast<int>(std::ceil(size.x() / resolution_)) + 1;
+  height_ = static_cast<int>(std::ceil(size.y() / resolution_)) + 1;
+
+  // Finest level: likelihood of the center of each cell
+  const float inv_two_sigma_sq = 1.0f / (2.0f * sigma * sigma);
+  std::vector<float> finest(width_ * height_, 0.0f);
+  for (int iy = 0; iy < height_; iy++) {
+    for (int ix = 0; ix < width_; ix++) {
+      const Eigen::Vector2f center =
+        origin_ + resolution_ * Eigen::Vector2f(ix + 0.5f, iy + 0.5f);
+      float best_distance_sq = std::numeric_limits<float>::max();
+      for (const auto & point : cloud) {
+        best_distance_sq = std::min(
+          best_distance_sq, (Eigen::Vector2f(point.x, point.y) - center).squaredNorm());
+      }
+      finest[iy * width_ + ix] = std::exp(-best_distance_sq * inv_two_sigma_sq);
+    }
+  }
+
+  // Coarser levels: maximum over the block of 2^h x 2^h cells starting at each cell, computed
+  // separately along the rows and the columns
+  levels_.resize(std::max(levels, 1));
+  levels_[0] = finest;
+  for (int level = 1; level < static_cast<int>(levels_.size()); level++) {
+    const int block = 1 << level;
+    const int padding = block - 1;
+    const int level_width = width_ + padding;
+    const int level_height = height_ + padding;
+
+    std::vector<float> rows(level_width * height_, 0.0f);
+    for (int iy = 0; iy < height_; iy++) {
+      for (int jx = 0; jx < level_width; jx++) {
+        const int begin = std::max(jx - padding, 0);
+        const int end = std::min(jx - padding + block, width_);
+        float maximum = 0.0f;
+        for (int ix = begin; ix < end; ix++) {
+          maximum = std::max(maximum, finest[iy * width_ + ix]);
+        }
+        rows[iy * level_width + jx] = maximum;
+      }
+    }
+
+    auto & grid = levels_[level];
+    grid.assign(level_width * level_height, 0.0f);
+    for (int jy = 0; jy < level_height; jy++) {
+      const int begin = std::max(jy - padding, 0);
+      const int end = std::min(jy - padding + block, height_);
+      for (int jx = 0; jx < level_width; jx++) {
+        float maximum = 0.0f;
+        for (int iy = begin; iy < end; iy++) {
+          maximum = std::max(maximum, rows[iy * level_width + jx]);
+        }
+        grid[jy * level_width + jx] = maximum;
+      }
+    }
+  }
+}
+
+Eigen::Vector2i CorrelativeGrid2D::cell(const Eigen::Vector2f & point) const
+{
+  return Eigen::Vector2i(
+    static_cast<int>(std::floor((point.x() - origin_.x()) / resolution_)),
+    static_cast<int>(std::floor((point.y() - origin_.y()) / resolution_)));
+}
+
+bool CorrelativeMatcher2D::match(const Pcloud & source)
+{
+  best_ = Candidate{0, 0, 0, 0, 0.0f};
+  score_ = 0.0;
+  found_ = false;
+  rotations_.clear();
+  rotated_cells_.clear();
+  if (source.empty() || !target_ || target_->empty()) {
+    return false;
+  }
+
+  // The angular step moves the farthest point by about one cell
+  const float resolution = target_->resolution();
+  float max_range = 0.0f;
+  for (const auto & point : source) {
+    max_range = std::max(max_range, std::hypot(point.x, point.y));
+  }
+  double angular_step = angular_window_;
+  if (max_range > resolution) {
+    angular_step = std::acos(
+      1.0 - static_cast<double>(resolution * resolution) / (2.0 * max_range * max_range));
+  }
+  const int angular_steps = angular_step > 0.0 ?
+    static_cast<int>(std::ceil(angular_window_ / angular_step)) : 0;
+  linear_steps_ = static_cast<int>(std::ceil(linear_window_ / resolution));
+
+  // Rotate the source once per rotation, the translations are offsets of the cells
+  for (int k = -angular_steps; k <= angular_steps; k++) {
+    const double yaw = angular_steps > 0 ? k * angular_window_ / angular_steps : 0.0;
+    const float c = static_cast<float>(std::cos(yaw));
+    const float s = static_cast<float>(std::sin(yaw));
+    std::vector<Eigen::Vector2i> cells;
+    cells.reserve(source.size());
+    for (const auto & point : source) {
+      cells.push_back(
+        target_->cell(Eigen::Vector2f(c * point.x - s * point.y, s * point.x + c * point.y)));
+    }
+    rotations_.push_back(yaw);
+    rotated_cells_.push_back(std::move(cells));
+  }
+
+  // Candidates at the coarsest level, covering the whole window
+  const int top = target_->levels() - 1;
+  const int block = 1 << top;
+  std::vector<Candidate> candidates;
+  for (size_t r = 0; r < rotations_.size(); r++) {
+    for (int x = -linear_steps_; x <= linear_steps_; x += block) {
+      for (int y = -linear_steps_; y <= linear_steps_; y += block) {
+        Candidate candidate{static_cast<int>(r), x, y, top, 0.0f};
+        scoreCandidate(candidate);
+        candidates.push_back(candidate);
+      }
+    }
+  }
+  std::sort(
+    candidates.begin(), candidates.end(),
+    [](const Candidate & a, const Candidate & b) {return a.score > b.score;});
+
+  // Only the transforms above the minimum score are explored
+  best_.score = static_cast<float>(min_score_);
+  for (const auto & candidate : candidates) {
+    if (candidate.score <= best_.score) {
+      break;
+    }
+    branchAndBound(candidate);
+  }
+
+  if (found_) {
+    score_ = best_.score;
+  }
+  return found_;
+}
+
+void CorrelativeMatcher2D::scoreCandidate(Candidate & candidate) const
+{
+  const auto & cells = rotated_cells_[candidate.rotation];
+  float sum = 0.0f;
+  for (const auto & cell : cells) {
+    sum += target_->value(candidate.level, cell.x() + candidate.x, cell.y() + candidate.y);
+  }
+  candidate.score = sum / static_cast<float>(cells.size());
+}
+
+void CorrelativeMatcher2D::branchAndBound(const Candidate & candidate)
+{
+  if (candidate.level == 0) {
+    best_ = candidate;
+    found_ = true;
+    return;
+  }
+
+  // Split the block in four and explore the most promising children first
+  const int level = candidate.level - 1;
+  const int half = 1 << level;
+  std::vector<Candidate> children;
+  children.reserve(4);
+  for (int dx : {0, half}) {
+    for (int dy : {0, half}) {
+      const int x = candidate.x + dx;
+      const int y = candidate.y + dy;
+      if (x > linear_steps_ || y > linear_steps_) {
+        continue;
+      }
+      Candidate child{candidate.rotation, x, y, level, 0.0f};
+      scoreCandidate(child);
+      children.push_back(child);
+    }
+  }
+  std::sort(
+    children.begin(), children.end(),
+    [](const Candidate & a, const Candidate & b) {return a.score > b.score;});
+
+  for (const auto & child : children) {
+    // The score of a block bounds the score of all its translations
+    if (child.score <= best_.score) {
+      break;
+    }
+    branchAndBound(child);
+  }
+}
+
+Eigen::Matrix4f CorrelativeMatcher2D::getFinalTransformation() const
+{
+  Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+  if (!found_) {
+    return transformation;
+  }
+  const double yaw = rotations_[best_.rotation];
+  const float resolution = target_->resolution();
+  transformation(0, 0) = static_cast<float>(std::cos(yaw));
+  transformation(0, 1) = static_cast<float>(-std::sin(yaw));
+  transformation(1, 0) = static_cast<float>(std::sin(yaw));
+  transformation(1, 1) = static_cast<float>(std::cos(yaw));
+  transformation(0, 3) = best_.x * resolution;
+  transformation(1, 3) = best_.y * resolution;
+  return transformation;
+}
+
+}  // namespace scitos2_charging_dock
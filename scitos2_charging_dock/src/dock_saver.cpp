@@ -13,7 +13,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <mutex>
+#include <vector>
 
 #include "angles/angles.h"
 #include "sensor_msgs/msg/laser_scan.hpp"
@@ -28,6 +30,9 @@ DockSaver::DockSaver(const rclcpp::NodeOptions & options)
 
   // Declare the node parameters
   declare_parameter("save_dock_timeout", 2.0);
+  declare_parameter("capture_scans", 1);
+  declare_parameter("capture_resolution", 0.0);
+  declare_parameter("scan_max_age", 0.5);
 }
 
 DockSaver::~DockSaver()
@@ -44,11 +49,20 @@ DockSaver::on_configure(const rclcpp_lifecycle::State & /*state*/)
 
   save_dock_timeout_ = std::make_shared<rclcpp::Duration>(
     rclcpp::Duration::from_seconds(get_parameter("save_dock_timeout").as_double()));
+  capture_scans_ = std::max(1, static_cast<int>(get_parameter("capture_scans").as_int()));
+  capture_resolution_ = get_parameter("capture_resolution").as_double();
+  scan_max_age_ = std::make_shared<rclcpp::Duration>(
+    rclcpp::Duration::from_seconds(get_parameter("scan_max_age").as_double()));
 
-  // Create a service that saves the pointcloud from a dock to a file
+  // Create a service that saves the pointcloud from a dock to a file. The response is deferred
+  // until the scans are received, so the executor is not blocked meanwhile
   save_dock_service_ = create_service<scitos2_msgs::srv::SaveDock>(
     service_prefix + save_dock_service_name_,
-    std::bind(&DockSaver::saveDockCallback, this, std::placeholders::_1, std::placeholders::_2));
+    [this](
+      const std::shared_ptr<rmw_request_id_t> request_header,
+      const std::shared_ptr<scitos2_msgs::srv::SaveDock::Request> request) {
+      saveDockCallback(request_header, request);
+    });
 
   // Setup TF buffer and perception
   tf2_buffer_ = std::make_shared<tf2_ros::Buffer>(get_clock());
@@ -84,6 +98,14 @@ DockSaver::on_cleanup(const rclcpp_lifecycle::State & /*state*/)
 {
   RCLCPP_INFO(get_logger(), "Cleaning up");
 
+  // Answer the requests still waiting for scans
+  for (auto & pending : pending_requests_) {
+    pending->scans.clear();
+    finishRequest(*pending);
+  }
+  pending_requests_.clear();
+  scan_subs_.clear();
+  scan_buffers_.clear();
   save_dock_service_.reset();
 
   return nav2_util::CallbackReturn::SUCCESS;
@@ -96,82 +118,178 @@ DockSaver::on_shutdown(const rclcpp_lifecycle::State & /*state*/)
   return nav2_util::CallbackReturn::SUCCESS;
 }
 
-bool DockSaver::saveDockCallback(
-  const std::shared_ptr<scitos2_msgs::srv::SaveDock::Request> request,
-  std::shared_ptr<scitos2_msgs::srv::SaveDock::Response> response)
+void DockSaver::saveDockCallback(
+  const std::shared_ptr<rmw_request_id_t> request_header,
+  const std::shared_ptr<scitos2_msgs::srv::SaveDock::Request> request)
 {
   RCLCPP_INFO(
     get_logger(), "Saving dock pointcloud from %s topic to file: %s", request->scan_topic.c_str(),
     request->dock_url.c_str());
 
+  auto pending = std::make_shared<PendingRequest>();
+  pending->header = request_header;
+
   // Correct scan_topic if necessary
-  std::string scan_topic = request->scan_topic;
-  if (scan_topic == "") {
-    scan_topic = "scan";
+  pending->scan_topic = request->scan_topic;
+  if (pending->scan_topic == "") {
+    pending->scan_topic = "scan";
     RCLCPP_WARN(
-      get_logger(), "Scan topic unspecified. Using default scan topic: %s.", scan_topic.c_str());
+      get_logger(), "Scan topic unspecified. Using default scan topic: %s.",
+      pending->scan_topic.c_str());
   }
 
   // Checking dock file name
-  std::string filename = request->dock_url;
-  if (filename == "") {
-    filename = "dock_" + std::to_string(static_cast<int>(get_clock()->now().seconds()));
+  pending->filename = request->dock_url;
+  if (pending->filename == "") {
+    pending->filename = "dock_" + std::to_string(static_cast<int>(get_clock()->now().seconds()));
     RCLCPP_WARN(
-      get_logger(), "Dock file unspecified. Dock will be saved to %s file", filename.c_str());
+      get_logger(), "Dock file unspecified. Dock will be saved to %s file",
+      pending->filename.c_str());
+  }
+
+  // Answer right away with the buffered scans if they are recent enough
+  const auto now = get_clock()->now();
+  for (const auto & scan : scan_buffers_[pending->scan_topic]) {
+    if (now - rclcpp::Time(scan->header.stamp, now.get_clock_type()) <= *scan_max_age_) {
+      pending->scans.push_back(scan);
+    }
+  }
+  if (pending->scans.size() >= static_cast<size_t>(capture_scans_)) {
+    pending->scans.erase(pending->scans.begin(), pending->scans.end() - capture_scans_);
+    finishRequest(*pending);
+    return;
+  }
+
+  // Otherwise wait for the scans, the subscription is kept for the next requests
+  if (!scan_subs_.count(pending->scan_topic)) {
+    const std::string topic = pending->scan_topic;
+    scan_subs_[topic] = create_subscription<sensor_msgs::msg::LaserScan>(
+      topic, rclcpp::SensorDataQoS(),
+      [this, topic](sensor_msgs::msg::LaserScan::ConstSharedPtr scan) {
+        scanCallback(topic, scan);
+      });
+  }
+
+  // Each scan has its own timeout, the dock is saved from the received scans when it expires
+  const auto timeout = save_dock_timeout_->to_chrono<std::chrono::nanoseconds>() * capture_scans_;
+  std::weak_ptr<PendingRequest> weak_pending = pending;
+  pending->timer = create_wall_timer(
+    timeout, [this, weak_pending]() {
+      if (auto expired = weak_pending.lock()) {
+        if (!expired->scans.empty()) {
+          RCLCPP_WARN(
+            get_logger(), "Only %lu of %d scans received, saving the dock from them",
+            expired->scans.size(), capture_scans_);
+        }
+        finishRequest(*expired);
+        pending_requests_.erase(
+          std::remove(pending_requests_.begin(), pending_requests_.end(), expired),
+          pending_requests_.end());
+      }
+    });
+  pending_requests_.push_back(pending);
+}
+
+void DockSaver::scanCallback(
+  const std::string & topic, sensor_msgs::msg::LaserScan::ConstSharedPtr scan)
+{
+  // Keep the most recent scans for the next requests
+  auto & buffer = scan_buffers_[topic];
+  buffer.push_back(scan);
+  while (buffer.size() > static_cast<size_t>(capture_scans_)) {
+    buffer.pop_front();
   }
 
-  // Create a callback function that receives the scan from subscribed topic
-  std::promise<sensor_msgs::msg::LaserScan::SharedPtr> prom;
-  std::future<sensor_msgs::msg::LaserScan::SharedPtr> future_result = prom.get_future();
-  auto scanCallback = [&prom](
-    const sensor_msgs::msg::LaserScan::SharedPtr msg) -> void {
-      prom.set_value(msg);
-    };
-
-  // Create new CallbackGroup for scan subscription
-  auto callback_group = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive, false);
-  auto option = rclcpp::SubscriptionOptions();
-  option.callback_group = callback_group;
-
-  auto scan_sub = create_subscription<sensor_msgs::msg::LaserScan>(
-    scan_topic, rclcpp::SensorDataQoS(), scanCallback, option);
-
-  // Create SingleThreadedExecutor to spin scan_sub in callback_group
-  rclcpp::executors::SingleThreadedExecutor executor;
-  executor.add_callback_group(callback_group, get_node_base_interface());
-  // Spin until dock message received
-  auto timeout = save_dock_timeout_->to_chrono<std::chrono::nanoseconds>();
-  auto status = executor.spin_until_future_complete(future_result, timeout);
-  if (status != rclcpp::FutureReturnCode::SUCCESS) {
-    RCLCPP_ERROR(get_logger(), "Failed to spin scan subscription");
+  // Complete the requests waiting for this topic
+  for (auto it = pending_requests_.begin(); it != pending_requests_.end(); ) {
+    auto & pending = **it;
+    if (pending.scan_topic == topic) {
+      pending.scans.push_back(scan);
+      if (pending.scans.size() >= static_cast<size_t>(capture_scans_)) {
+        finishRequest(pending);
+        it = pending_requests_.erase(it);
+        continue;
+      }
+    }
+    ++it;
+  }
+}
+
+void DockSaver::finishRequest(PendingRequest & pending)
+{
+  if (pending.timer) {
+    pending.timer->cancel();
+  }
+  auto response = std::make_shared<scitos2_msgs::srv::SaveDock::Response>();
+  saveDock(pending.scans, pending.filename, *response);
+  save_dock_service_->send_response(*pending.header, *response);
+}
+
+bool DockSaver::saveDock(
+  const std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> & scans,
+  const std::string & filename, scitos2_msgs::srv::SaveDock::Response & response)
+{
+  if (scans.empty()) {
+    RCLCPP_ERROR(get_logger(), "Failed to receive any scan");
     return false;
   }
-  // scan_sub is no more needed
-  scan_sub.reset();
 
-  // Scan message received. Extracting dock pointcloud
-  sensor_msgs::msg::LaserScan::SharedPtr scan_msg = future_result.get();
+  // Scan messages received. Extracting the dock pointcloud of each one
+  std::vector<Pcloud> docks;
+  for (const auto & scan_msg : scans) {
+    Pcloud dock;
+    if (extractDockPointcloud(*scan_msg, dock)) {
+      docks.push_back(dock);
+    }
+  }
+
+  if (docks.empty()) {
+    RCLCPP_ERROR(get_logger(), "No clusters found in the scan");
+    return false;
+  }
+
+  // A single scan is stored as captured, several are fused into a denser template
+  Pcloud dock = docks.front();
+  if (docks.size() > 1) {
+    double mean_residual, max_residual;
+    if (perception_->fuseDockPointclouds(
+        docks, capture_resolution_, dock, mean_residual, max_residual) == 0)
+    {
+      RCLCPP_ERROR(get_logger(), "Failed to fuse the scans of the dock");
+      return false;
+    }
+    response.mean_residual = mean_residual;
+    response.max_residual = max_residual;
+  }
 
+  // Store the dock pointcloud to a file
+  response.point_count = static_cast<uint32_t>(dock.size());
+  response.result = perception_->storeDockPointcloud(filename, dock);
+
+  return response.result;
+}
+
+bool DockSaver::extractDockPointcloud(const sensor_msgs::msg::LaserScan & scan, Pcloud & dock)
+{
   // Extract clusters from the scan
-  auto clusters = perception_->extractClustersFromScan(*scan_msg);
+  auto clusters = perception_->extractClustersFromScan(scan);
 
   if (clusters.empty()) {
-    RCLCPP_ERROR(get_logger(), "No clusters found in the scan");
     return false;
   }
 
   // Find the cluster in front of the robot
   std::vector<double> angles;
-  for (auto cluster : clusters) {
-    double angle = std::atan2(cluster.centroid().y, cluster.centroid().x);
+  for (const auto & cluster : clusters) {
+    const auto centroid = cluster.centroid();
+    double angle = std::atan2(centroid.y, centroid.x);
     angles.push_back(angles::normalize_angle_positive(angle));
   }
   auto min_angle = std::min_element(angles.begin(), angles.end());
   int idx = std::distance(angles.begin(), min_angle);
 
-  // Store the dock pointcloud to a file
-  response->result = perception_->storeDockPointcloud(filename, clusters[idx].cloud);
-
+  clusters[idx].materialize();
+  dock = clusters[idx].cloud;
   return true;
 }
 }  // namespace scitos2_charging_dock
@@ -0,0 +1,365 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// C++
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "scitos2_charging_dock/dock_template_file.hpp"
+
+namespace scitos2_charging_dock
+{
+
+namespace
+{
+
+constexpr char MAGIC[4] = {'S', 'D', 'T', '\0'};
+// Written in the native byte order, so files of another byte order are detected
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/**
+ * @brief Append the binary representation of plain values to a buffer.
+ */
+class Writer
+{
+public:
+  template<typename T>
+  void put(const T & value) {putArray(&value, 1);}
+
+  template<typename T>
+  void putArray(const T * values, size_t count)
+  {
+    const char * bytes = reinterpret_cast<const char *>(values);
+    buffer_.insert(buffer_.end(), bytes, bytes + count * sizeof(T));
+  }
+
+  const std::vector<char> & buffer() const {return buffer_;}
+
+private:
+  std::vector<char> buffer_;
+};
+
+/**
+ * @brief Read plain values from a memory region, failing instead of reading past its end.
+ */
+class Reader
+{
+public:
+  Reader(const char * data, size_t size)
+  : data_(data), size_(size) {}
+
+  template<typename T>
+  bool get(T & value) {return getArray(&value, 1);}
+
+  template<typename T>
+  bool getArray(T * values, size_t count)
+  {
+    if (count > (size_ - offset_) / sizeof(T)) {
+      return false;
+    }
+    std::memcpy(values, data_ + offset_, count * sizeof(T));
+    offset_ += count * sizeof(T);
+    return true;
+  }
+
+  template<typename T>
+  bool getVector(std::vector<T> & values, size_t count)
+  {
+    // Check the size before allocating, a corrupt count must not exhaust the memory
+    if (count > (size_ - offset_) / sizeof(T)) {
+      return false;
+    }
+    values.resize(count);
+    return getArray(values.data(), count);
+  }
+
+private:
+  const char * data_;
+  size_t size_;
+  size_t offset_{0};
+};
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+  explicit MappedFile(const std::string & filepath)
+  {
+    const int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat status;
+    if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+      void * data = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = static_cast<const char *>(data);
+        size_ = static_cast<size_t>(status.st_size);
+      }
+    }
+    // The mapping stays valid after closing the descriptor
+    ::close(fd);
+  }
+
+  ~MappedFile()
+  {
+    if (data_) {
+      ::munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  const char * data() const {return data_;}
+  size_t size() const {return size_;}
+
+private:
+  const char * data_{nullptr};
+  size_t size_{0};
+};
+
+void writeNearestGrid(Writer & writer, const NearestGrid2D & grid)
+{
+  writer.put(grid.origin().x());
+  writer.put(grid.origin().y());
+  writer.put(grid.resolution());
+  writer.put(static_cast<int32_t>(grid.width()));
+  writer.put(static_cast<int32_t>(grid.height()));
+  writer.putArray(grid.cells().data(), grid.cells().size());
+}
+
+std::shared_ptr<const NearestGrid2D> readNearestGrid(Reader & reader, const Pcloud & cloud)
+{
+  float origin_x, origin_y, resolution;
+  int32_t width, height;
+  if (!reader.get(origin_x) || !reader.get(origin_y) || !reader.get(resolution) ||
+    !reader.get(width) || !reader.get(height) || width < 0 || height < 0 || resolution <= 0.0f)
+  {
+    return nullptr;
+  }
+  std::vector<uint32_t> cells;
+  if (!reader.getVector(cells, static_cast<size_t>(width) * static_cast<size_t>(height))) {
+    return nullptr;
+  }
+  for (const auto & cell : cells) {
+    if (cell >= cloud.size()) {
+      return nullptr;
+    }
+  }
+
+  NearestGrid2D::Points points;
+  points.reserve(cloud.size());
+  for (const auto & point : cloud) {
+    points.emplace_back(point.x, point.y);
+  }
+  return std::make_shared<NearestGrid2D>(
+    std::move(points), NearestGrid2D::Point(origin_x, origin_y), resolution, width, height,
+    std::move(cells));
+}
+
+void writeLikelihood(Writer & writer, const CorrelativeGrid2D & grid)
+{
+  writer.put(grid.origin().x());
+  writer.put(grid.origin().y());
+  writer.put(grid.resolution());
+  writer.put(static_cast<int32_t>(grid.width()));
+  writer.put(static_cast<int32_t>(grid.height()));
+  writer.put(static_cast<uint32_t>(grid.levels()));
+  for (int level = 0; level < grid.levels(); level++) {
+    writer.putArray(grid.levelValues(level).data(), grid.levelValues(level).size());
+  }
+}
+
+std::shared_ptr<const CorrelativeGrid2D> readLikelihood(Reader & reader)
+{
+  float origin_x, origin_y, resolution;
+  int32_t width, height;
+  uint32_t num_levels;
+  if (!reader.get(origin_x) || !reader.get(origin_y) || !reader.get(resolution) ||
+    !reader.get(width) || !reader.get(height) || !reader.get(num_levels) ||
+    width < 0 || height < 0 || resolution <= 0.0f || num_levels > 16)
+  {
+    return nullptr;
+  }
+  // Each level is padded before the origin by the size of its blocks
+  std::vector<std::vector<float>> levels(num_levels);
+  for (uint32_t level = 0; level < num_levels; level++) {
+    const size_t padding = (size_t{1} << level) - 1;
+    const size_t count = (width + padding) * (height + padding);
+    if (!reader.getVector(levels[level], count)) {
+      return nullptr;
+    }
+  }
+  return std::make_shared<CorrelativeGrid2D>(
+    Eigen::Vector2f(origin_x, origin_y), resolution, width, height, std::move(levels));
+}
+
+}  // namespace
+
+std::string DockTemplateFile::path(const std::string & pcd_path)
+{
+  return std::filesystem::path(pcd_path).replace_extension(".sdt").string();
+}
+
+bool DockTemplateFile::write(const std::string & filepath, const DockTemplate & dock_template)
+{
+  if (dock_template.empty() || !dock_template.likelihood) {
+    return false;
+  }
+
+  Writer writer;
+  writer.putArray(MAGIC, sizeof(MAGIC));
+  writer.put(VERSION);
+  writer.put(BYTE_ORDER_MARK);
+  writer.put(dock_template.correspondence_distance);
+  writer.put(static_cast<int32_t>(dock_template.requested_levels));
+
+  // Shape and extent of the dock
+  const auto & descriptor = dock_template.descriptor;
+  writer.put(descriptor.major_extent);
+  writer.put(descriptor.minor_extent);
+  writer.putArray(descriptor.turning_function.data(), descriptor.turning_function.size());
+  writer.put(dock_template.center.x);
+  writer.put(dock_template.center.y);
+  writer.put(dock_template.center.z);
+  writer.put(dock_template.radius);
+
+  // Levels of the pyramid, the first one is the pointcloud of the dock
+  writer.put(static_cast<uint32_t>(dock_template.levels.size()));
+  for (const auto & level : dock_template.levels) {
+    writer.put(level.spacing);
+    writer.put(static_cast<uint32_t>(level.cloud->size()));
+    for (const auto & point : *level.cloud) {
+      writer.put(point.x);
+      writer.put(point.y);
+      writer.put(point.z);
+    }
+    writeNearestGrid(writer, *level.grid);
+  }
+  writeLikelihood(writer, *dock_template.likelihood);
+
+  // Replace the file at once, so the processes that map it never read a partial file
+  const std::string temporary = filepath + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(writer.buffer().data(), static_cast<std::streamsize>(writer.buffer().size()));
+    if (!file) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  if (std::rename(temporary.c_str(), filepath.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool DockTemplateFile::read(
+  const std::string & filepath, double max_correspondence_distance, int num_levels,
+  DockTemplate & dock_template)
+{
+  MappedFile file(filepath);
+  if (!file.data()) {
+    return false;
+  }
+  Reader reader(file.data(), file.size());
+
+  // Header, the grids depend on the parameters they were built with
+  char magic[4];
+  uint32_t version, byte_order;
+  double correspondence_distance;
+  int32_t requested_levels;
+  if (!reader.getArray(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+    !reader.get(version) || version != VERSION ||
+    !reader.get(byte_order) || byte_order != BYTE_ORDER_MARK ||
+    !reader.get(correspondence_distance) ||
+    correspondence_distance != max_correspondence_distance ||
+    !reader.get(requested_levels) || requested_levels != num_levels)
+  {
+    return false;
+  }
+
+  DockTemplate result;
+  result.correspondence_distance = correspondence_distance;
+  result.requested_levels = requested_levels;
+  auto & descriptor = result.descriptor;
+  if (!reader.get(descriptor.major_extent) || !reader.get(descriptor.minor_extent) ||
+    !reader.getArray(descriptor.turning_function.data(), descriptor.turning_function.size()) ||
+    !reader.get(result.center.x) || !reader.get(result.center.y) ||
+    !reader.get(result.center.z) || !reader.get(result.radius))
+  {
+    return false;
+  }
+
+  uint32_t stored_levels;
+  if (!reader.get(stored_levels) || stored_levels == 0 ||
+    stored_levels > static_cast<uint32_t>(std::max(num_levels, 1)))
+  {
+    return false;
+  }
+  for (uint32_t l = 0; l < stored_levels; l++) {
+    DockTemplateLevel level;
+    uint32_t size;
+    std::vector<float> coordinates;
+    if (!reader.get(level.spacing) || !reader.get(size) || size == 0 ||
+      !reader.getVector(coordinates, 3 * static_cast<size_t>(size)))
+    {
+      return false;
+    }
+    auto cloud = std::make_shared<Pcloud>();
+    cloud->reserve(size);
+    for (size_t i = 0; i < coordinates.size(); i += 3) {
+      cloud->push_back(pcl::PointXYZ(coordinates[i], coordinates[i + 1], coordinates[i + 2]));
+    }
+    level.grid = readNearestGrid(reader, *cloud);
+    if (!level.grid) {
+      return false;
+    }
+    // The KD-tree of PCL cannot be serialized, it is cheap to build for a few points
+    level.tree = std::make_shared<pcl::search::KdTree<pcl::PointXYZ>>();
+    level.tree->setInputCloud(cloud);
+    level.cloud = cloud;
+    result.levels.push_back(std::move(level));
+  }
+  result.likelihood = readLikelihood(reader);
+  if (!result.likelihood) {
+    return false;
+  }
+
+  result.cloud = result.levels.front().cloud;
+  result.tree = result.levels.front().tree;
+  result.grid = result.levels.front().grid;
+  dock_template = std::move(result);
+  return true;
+}
+
+}  // namespace scitos2_charging_dock
@@ -14,12 +14,24 @@
 // limitations under the License.
 
 // PCL
+#include <pcl/common/centroid.h>
 #include <pcl/common/eigen.h>
+#include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/registration/icp.h>
 
+// C++
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
 // TF
 #include "tf2/transform_datatypes.h"
+#include "tf2/utils.h"
 #include "tf2_geometry_msgs/tf2_geometry_msgs.hpp"
 
 // ROS
@@ -34,6 +46,27 @@
 namespace scitos2_charging_dock
 {
 
+namespace
+{
+
+/**
+ * @brief PCL Iterative Closest Point that reports the iterations of the last alignment.
+ */
+class CountedIterativeClosestPoint
+  : public pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ>
+{
+public:
+  int getIterations() const {return nr_iterations_;}
+};
+
+// Colours of the clusters in the debug cloud, repeated by their identifier
+constexpr std::array<std::array<uint8_t, 3>, 8> CLUSTER_COLORS = {{
+  {230, 25, 75}, {60, 180, 75}, {255, 225, 25}, {0, 130, 200},
+  {245, 130, 48}, {145, 30, 180}, {70, 240, 240}, {240, 50, 230}
+}};
+
+}  // namespace
+
 Perception::Perception(
   const rclcpp_lifecycle::LifecycleNode::SharedPtr & node,
   const std::string & name, std::shared_ptr<tf2_ros::Buffer> tf)
@@ -44,7 +77,7 @@ Perception::Perception(
   tf_buffer_ = tf;
 
   nav2_util::declare_parameter_if_not_declared(
-    node, name_ + ".perception.icp_min_score", rclcpp::ParameterValue(0.01));
+    node, name_ + ".perception.icp_min_score", rclcpp::ParameterValue(0.0025));
   nav2_util::declare_parameter_if_not_declared(
     node, name_ + ".perception.icp_max_iter", rclcpp::ParameterValue(300));
   nav2_util::declare_parameter_if_not_declared(
@@ -59,26 +92,105 @@ Perception::Perception(
     node, name_ + ".perception.dock_template", rclcpp::ParameterValue(""));
   nav2_util::declare_parameter_if_not_declared(
     node, name_ + ".perception.use_first_detection", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.matcher", rclcpp::ParameterValue("pcl"));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.max_threads", rclcpp::ParameterValue(1));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.template_levels", rclcpp::ParameterValue(1));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.coarse_max_iter", rclcpp::ParameterValue(20));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.time_budget", rclcpp::ParameterValue(0.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.shape_filter", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.shape_extent_tolerance", rclcpp::ParameterValue(0.05));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.shape_max_distance", rclcpp::ParameterValue(0.3));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.propagate_detection", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.propagation_max_age", rclcpp::ParameterValue(0.5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.fixed_frame", rclcpp::ParameterValue("odom"));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.motion_compensation", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.region_of_interest", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.roi_angle_margin", rclcpp::ParameterValue(0.1));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.roi_range_margin", rclcpp::ParameterValue(0.3));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.tracking", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.tracking_min_iter", rclcpp::ParameterValue(5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.correlative_search", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.correlative_linear_window", rclcpp::ParameterValue(0.5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.correlative_angular_window", rclcpp::ParameterValue(0.35));
+  nav2_util::declare_parameter_if_not_declared(
+    node, name_ + ".perception.correlative_min_score", rclcpp::ParameterValue(0.5));
 
-  node->get_parameter(name_ + ".perception.icp_min_score", icp_min_score_);
-  node->get_parameter(name_ + ".perception.icp_max_iter", icp_max_iter_);
-  node->get_parameter(name_ + ".perception.icp_max_corr_dis", icp_max_corr_dis_);
-  node->get_parameter(name_ + ".perception.icp_max_trans_eps", icp_max_trans_eps_);
-  node->get_parameter(name_ + ".perception.icp_max_eucl_fit_eps", icp_max_eucl_fit_eps_);
-  node->get_parameter(name_ + ".perception.enable_debug", debug_);
-  node->get_parameter(name_ + ".perception.use_first_detection", use_first_detection_);
+  node->get_parameter(name_ + ".perception.icp_min_score", params_.icp_min_score);
+  node->get_parameter(name_ + ".perception.icp_max_iter", params_.icp_max_iter);
+  node->get_parameter(name_ + ".perception.icp_max_corr_dis", params_.icp_max_corr_dis);
+  node->get_parameter(name_ + ".perception.icp_max_trans_eps", params_.icp_max_trans_eps);
+  node->get_parameter(
+    name_ + ".perception.icp_max_eucl_fit_eps", params_.icp_max_eucl_fit_eps);
+  node->get_parameter(name_ + ".perception.enable_debug", params_.debug);
+  node->get_parameter(
+    name_ + ".perception.use_first_detection", params_.use_first_detection);
+  node->get_parameter(name_ + ".perception.matcher", params_.matcher);
+  if (params_.matcher != "pcl" && params_.matcher != "se2") {
+    RCLCPP_WARN(logger_, "Unknown matcher '%s', using 'pcl'", params_.matcher.c_str());
+    params_.matcher = "pcl";
+  }
+  int max_threads;
+  node->get_parameter(name_ + ".perception.max_threads", max_threads);
+  node->get_parameter(name_ + ".perception.template_levels", template_levels_);
+  node->get_parameter(name_ + ".perception.coarse_max_iter", params_.coarse_max_iter);
+  node->get_parameter(name_ + ".perception.time_budget", params_.time_budget);
+  node->get_parameter(name_ + ".perception.shape_filter", params_.shape_filter);
+  node->get_parameter(
+    name_ + ".perception.shape_extent_tolerance", params_.shape_extent_tolerance);
+  node->get_parameter(name_ + ".perception.shape_max_distance", params_.shape_max_distance);
+  node->get_parameter(
+    name_ + ".perception.propagate_detection", params_.propagate_detection);
+  node->get_parameter(
+    name_ + ".perception.propagation_max_age", params_.propagation_max_age);
+  node->get_parameter(name_ + ".perception.fixed_frame", fixed_frame_);
+  node->get_parameter(
+    name_ + ".perception.motion_compensation", params_.motion_compensation);
+  node->get_parameter(name_ + ".perception.region_of_interest", params_.region_of_interest);
+  node->get_parameter(name_ + ".perception.roi_angle_margin", params_.roi_angle_margin);
+  node->get_parameter(name_ + ".perception.roi_range_margin", params_.roi_range_margin);
+  node->get_parameter(name_ + ".perception.tracking", params_.tracking);
+  node->get_parameter(name_ + ".perception.tracking_min_iter", params_.tracking_min_iter);
+  node->get_parameter(name_ + ".perception.correlative_search", params_.correlative_search);
+  node->get_parameter(
+    name_ + ".perception.correlative_linear_window", params_.correlative_linear_window);
+  node->get_parameter(
+    name_ + ".perception.correlative_angular_window", params_.correlative_angular_window);
+  node->get_parameter(
+    name_ + ".perception.correlative_min_score", params_.correlative_min_score);
+  worker_pool_ = std::make_unique<WorkerPool>(std::max(max_threads, 1));
 
   // Load the dock template
   std::string dock_template;
   node->get_parameter(name_ + ".perception.dock_template", dock_template);
-  loadDockPointcloud(dock_template, dock_template_.cloud);
+  loadDockTemplate(dock_template);
 
   // Publishers
-  if (debug_) {
+  if (params_.debug) {
     target_cloud_pub_ = node->create_publisher<sensor_msgs::msg::PointCloud2>("dock/target", 1);
     dock_cloud_pub_ = node->create_publisher<sensor_msgs::msg::PointCloud2>("dock/cloud", 1);
+    // The template does not change, so it is published once to the late subscribers too
     dock_template_pub_ = node->create_publisher<sensor_msgs::msg::PointCloud2>(
-      "dock/template", 1);
+      "dock/template", rclcpp::QoS(1).transient_local());
   }
 
   dyn_params_handler_ = node->add_on_set_parameters_callback(
@@ -93,28 +205,166 @@ Perception::Perception(
 
 Perception::~Perception()
 {
+  worker_pool_.reset();
   segmentation_.reset();
   tf_buffer_.reset();
 }
 
 geometry_msgs::msg::PoseStamped Perception::getDockPose(const sensor_msgs::msg::LaserScan & scan)
 {
-  // Extract clusters from the scan
-  auto clusters = extractClustersFromScan(scan);
+  // The whole scan is processed with the same parameters, even if they change meanwhile
+  const Parameters params = getParameters();
 
-  // Refine the pose of each cluster to get the dock pose
   // If we only wants the first detection, just update the timestamp
-  if (use_first_detection_ && dock_found_) {
+  if (params.use_first_detection && dock_found_) {
     detected_dock_.pose.header.stamp = clock_->now();
+    return detected_dock_.pose;
+  }
+
+  // The controller asks faster than the laser publishes, so the scan may be already processed
+  if (scan_processed_ && scan.header.stamp == last_scan_stamp_ &&
+    scan.header.frame_id == last_scan_frame_)
+  {
+    return params.propagate_detection && dock_found_ ?
+      propagateDetection(params) : detected_dock_.pose;
+  }
+  scan_processed_ = true;
+  last_scan_stamp_ = scan.header.stamp;
+  last_scan_frame_ = scan.header.frame_id;
+
+  // The search structures of the template cover the correspondence distance, so they are
+  // rebuilt when it changes. The worker threads are idle between scans
+  if (!dock_template_.empty() &&
+    dock_template_.correspondence_distance != params.icp_max_corr_dis)
+  {
+    RCLCPP_INFO(
+      logger_, "Rebuilding the dock template for a correspondence distance of %f m",
+      params.icp_max_corr_dis);
+    dock_template_ = DockTemplate(
+      *dock_template_.cloud, params.icp_max_corr_dis, template_levels_);
+  }
+
+  // Extract clusters from the scan
+  auto clusters = extractClustersFromScan(scan, params);
+
+  // While tracking, the matching starts from the last detection moved to this scan
+  tracking_active_ = params.tracking && dock_found_;
+  matching_pose_ = initial_estimate_pose_;
+  if (tracking_active_) {
+    predictDetection(tf2_ros::fromMsg(scan.header.stamp), matching_pose_);
+  }
+  // The refinement modifies the clusters, so keep them to search again if the track is lost
+  Clusters untracked_clusters;
+  if (tracking_active_) {
+    untracked_clusters = clusters;
+  }
+
+  // Refine the pose of each cluster to get the dock pose
+  bool found = refineAllClustersPoses(clusters, dock_template_, params, detected_dock_);
+  if (!found && tracking_active_) {
+    // The track is lost, so search again from the initial estimate with all the iterations
+    RCLCPP_DEBUG(logger_, "Dock lost while tracking, searching from the initial estimate");
+    tracking_active_ = false;
+    tracking_iterations_ = -1.0;
+    matching_pose_ = initial_estimate_pose_;
+    clusters = std::move(untracked_clusters);
+    found = refineAllClustersPoses(clusters, dock_template_, params, detected_dock_);
+  }
+
+  if (found) {
+    dock_found_ = true;
+    // The detection is as old as the scan, not as its processing
+    detected_dock_.pose.header.stamp = scan.header.stamp;
+    detection_stamp_ = scan.header.stamp;
+    roi_misses_ = 0;
+    // Exponential moving average of the iterations needed to match the dock
+    const double iterations = detected_dock_.iterations;
+    tracking_iterations_ = tracking_iterations_ < 0.0 ?
+      iterations : 0.7 * tracking_iterations_ + 0.3 * iterations;
   } else {
-    if (refineAllClustersPoses(clusters, dock_template_, detected_dock_)) {
-      dock_found_ = true;
-    }
+    roi_misses_++;
   }
 
   return detected_dock_.pose;
 }
 
+geometry_msgs::msg::PoseStamped Perception::propagateDetection(const Parameters & params)
+{
+  // A detection in the fixed frame does not move with the robot, and an old detection keeps its
+  // stamp, so the caller still notices that the dock is not seen anymore
+  const auto age = clock_->now() - rclcpp::Time(detection_stamp_, clock_->get_clock_type());
+  if (detected_dock_.pose.header.frame_id == fixed_frame_ ||
+    age.seconds() > params.propagation_max_age)
+  {
+    return detected_dock_.pose;
+  }
+
+  geometry_msgs::msg::PoseStamped dock_pose;
+  if (!predictDetection(tf2::TimePointZero, dock_pose)) {
+    return detected_dock_.pose;
+  }
+  dock_pose.header.stamp = clock_->now();
+  return dock_pose;
+}
+
+bool Perception::predictDetection(
+  const tf2::TimePoint & time, geometry_msgs::msg::PoseStamped & dock_pose)
+{
+  dock_pose = detected_dock_.pose;
+  const auto & frame = detected_dock_.pose.header.frame_id;
+  try {
+    // Motion of the frame of the detection from the scan to the given time
+    auto tf_stamped = tf_buffer_->lookupTransform(
+      frame, time, frame, tf2_ros::fromMsg(detection_stamp_), fixed_frame_,
+      tf2::Duration::zero());
+    tf2::doTransform(dock_pose, dock_pose, tf_stamped);
+  } catch (const tf2::TransformException & ex) {
+    RCLCPP_DEBUG(logger_, "Could not propagate the detection: %s", ex.what());
+    dock_pose = detected_dock_.pose;
+    return false;
+  }
+  dock_pose.header.frame_id = frame;
+  return true;
+}
+
+int Perception::getIterationCap(const Parameters & params) const
+{
+  if (!tracking_active_ || tracking_iterations_ < 0.0) {
+    return params.icp_max_iter;
+  }
+  // Twice the recent iterations leaves room for faster motions of the dock
+  const int cap = static_cast<int>(std::ceil(2.0 * tracking_iterations_));
+  return std::clamp(
+    cap, std::min(params.tracking_min_iter, params.icp_max_iter), params.icp_max_iter);
+}
+
+Perception::Parameters Perception::getParameters()
+{
+  std::lock_guard<std::mutex> lock(dynamic_params_lock_);
+  return params_;
+}
+
+sensor_msgs::msg::LaserScan::ConstSharedPtr Perception::selectScan(
+  const std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> & scans)
+{
+  if (scans.empty()) {
+    return nullptr;
+  }
+  const auto & target_frame = initial_estimate_pose_.header.frame_id;
+  if (!tf_buffer_ || target_frame.empty()) {
+    return scans.back();
+  }
+  for (auto scan = scans.rbegin(); scan != scans.rend(); ++scan) {
+    if ((*scan)->header.frame_id == target_frame ||
+      tf_buffer_->canTransform(
+        target_frame, (*scan)->header.frame_id, tf2_ros::fromMsg((*scan)->header.stamp)))
+    {
+      return *scan;
+    }
+  }
+  return scans.back();
+}
+
 void Perception::setInitialEstimate(
   const geometry_msgs::msg::Pose & pose, const std::string & frame)
 {
@@ -122,6 +372,12 @@ void Perception::setInitialEstimate(
   initial_estimate_pose_.header.frame_id = frame;
   initial_estimate_pose_.header.stamp = clock_->now();
   dock_found_ = false;
+  // The result of the last scan depends on the initial estimate
+  scan_processed_ = false;
+  roi_misses_ = 0;
+  matching_pose_ = initial_estimate_pose_;
+  tracking_active_ = false;
+  tracking_iterations_ = -1.0;
 }
 
 bool Perception::loadDockPointcloud(std::string filepath, Pcloud & dock)
@@ -140,6 +396,34 @@ bool Perception::loadDockPointcloud(std::string filepath, Pcloud & dock)
   return success;
 }
 
+bool Perception::loadDockTemplate(std::string filepath)
+{
+  // Use the precompiled template unless the PCD file was saved after it
+  if (!filepath.empty()) {
+    const std::string precompiled = DockTemplateFile::path(filepath);
+    std::error_code error;
+    const auto precompiled_time = std::filesystem::last_write_time(precompiled, error);
+    const bool up_to_date = !error &&
+      precompiled_time >= std::filesystem::last_write_time(filepath, error) && !error;
+    if (up_to_date &&
+      DockTemplateFile::read(
+        precompiled, params_.icp_max_corr_dis, template_levels_, dock_template_))
+    {
+      RCLCPP_INFO(
+        logger_, "Dock loaded from precompiled template with %lu points",
+        dock_template_.cloud->size());
+      return true;
+    }
+  }
+
+  Pcloud dock_cloud;
+  if (!loadDockPointcloud(filepath, dock_cloud)) {
+    return false;
+  }
+  dock_template_ = DockTemplate(dock_cloud, params_.icp_max_corr_dis, template_levels_);
+  return true;
+}
+
 bool Perception::storeDockPointcloud(std::string filepath, const Pcloud & dock)
 {
   bool success = false;
@@ -148,59 +432,241 @@ bool Perception::storeDockPointcloud(std::string filepath, const Pcloud & dock)
   } else {
     RCLCPP_INFO(logger_, "Dock saved to PCD file");
     success = true;
+
+    // Precompile the template after the PCD file, so it is not older than it
+    const std::string precompiled = DockTemplateFile::path(filepath);
+    const double max_corr_dis = getParameters().icp_max_corr_dis;
+    if (DockTemplateFile::write(
+        precompiled, DockTemplate(dock, max_corr_dis, template_levels_)))
+    {
+      RCLCPP_INFO(logger_, "Dock template precompiled to %s", precompiled.c_str());
+    } else {
+      RCLCPP_WARN(logger_, "Failed to precompile the dock template");
+    }
   }
   return success;
 }
 
+size_t Perception::fuseDockPointclouds(
+  const std::vector<Pcloud> & clouds, double resolution, Pcloud & dock,
+  double & mean_residual, double & max_residual)
+{
+  dock.clear();
+  mean_residual = 0.0;
+  max_residual = 0.0;
+
+  // The densest pointcloud is the reference of the registration
+  auto reference = std::max_element(
+    clouds.begin(), clouds.end(),
+    [](const Pcloud & a, const Pcloud & b) {return a.size() < b.size();});
+  if (reference == clouds.end() || reference->size() < 2) {
+    return 0;
+  }
+  const Parameters params = getParameters();
+  const DockTemplate reference_template(*reference, params.icp_max_corr_dis);
+  Eigen::Vector4f reference_centroid;
+  pcl::compute3DCentroid(*reference, reference_centroid);
+
+  Pcloud merged;
+  size_t fused = 0;
+  for (auto cloud = clouds.begin(); cloud != clouds.end(); ++cloud) {
+    if (cloud == reference) {
+      merged += *cloud;
+      fused++;
+      continue;
+    }
+    if (cloud->size() < 2) {
+      continue;
+    }
+
+    // Start from the centroid of the reference, the robot may have moved between the scans
+    Eigen::Vector4f centroid;
+    pcl::compute3DCentroid(*cloud, centroid);
+    Eigen::Matrix4f seed = Eigen::Matrix4f::Identity();
+    seed.block<2, 1>(0, 3) = (reference_centroid - centroid).head<2>();
+    Pcloud source;
+    pcl::transformPointCloud(*cloud, source, seed);
+
+    Eigen::Matrix4f transformation;
+    double score = 0.0;
+    int iterations = 0;
+    if (!alignToTemplate(
+        source, reference_template.levels.front(), params, params.icp_max_iter,
+        std::chrono::steady_clock::time_point::max(), transformation, score, iterations) ||
+      score > params.icp_min_score)
+    {
+      RCLCPP_WARN(logger_, "Discarding a scan of the dock that does not match the reference");
+      continue;
+    }
+    pcl::transformPointCloud(source, source, transformation);
+    merged += source;
+    fused++;
+  }
+
+  // The bearing relative to the direction of the dock orders the points along the profile,
+  // without wrapping around when the dock is behind the sensor
+  const float cx = reference_centroid.x(), cy = reference_centroid.y();
+  const auto bearing = [cx, cy](const pcl::PointXYZ & p) {
+      return std::atan2(cx * p.y - cy * p.x, cx * p.x + cy * p.y);
+    };
+  std::sort(
+    merged.begin(), merged.end(),
+    [&bearing](const pcl::PointXYZ & a, const pcl::PointXYZ & b) {
+      return bearing(a) < bearing(b);
+    });
+
+  // Each scan contributes about one point to every neighbourhood of that size
+  const int half_window = static_cast<int>(fused / 2);
+  const int size = static_cast<int>(merged.size());
+  Pcloud smoothed;
+  smoothed.header = reference->header;
+  for (int i = 0; i < size; i++) {
+    const int begin = std::max(i - half_window, 0);
+    const int end = std::min(i + half_window, size - 1);
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    for (int j = begin; j <= end; j++) {
+      sum += merged[j].getVector3fMap();
+    }
+    sum /= static_cast<float>(end - begin + 1);
+    smoothed.push_back(pcl::PointXYZ(sum.x(), sum.y(), sum.z()));
+  }
+
+  if (resolution <= 0.0) {
+    resolution = DockTemplate::spacing(*reference);
+  }
+  dock = DockTemplate::resample(smoothed, resolution);
+
+  // Distance of the registered points to the segments of the fused profile
+  const NearestGrid2D grid(dock, static_cast<float>(params.icp_max_corr_dis));
+  for (const auto & point : merged) {
+    float distance_sq;
+    grid.closest(NearestGrid2D::Point(point.x, point.y), distance_sq);
+    const double residual = std::sqrt(static_cast<double>(distance_sq));
+    mean_residual += residual;
+    max_residual = std::max(max_residual, residual);
+  }
+  mean_residual /= static_cast<double>(merged.size());
+
+  RCLCPP_INFO(
+    logger_, "Fused %lu of %lu scans of the dock into %lu points, mean residual %f m",
+    fused, clouds.size(), dock.size(), mean_residual);
+  return fused;
+}
+
 Clusters Perception::extractClustersFromScan(const sensor_msgs::msg::LaserScan & scan)
 {
+  return extractClustersFromScan(scan, getParameters());
+}
+
+Clusters Perception::extractClustersFromScan(
+  const sensor_msgs::msg::LaserScan & scan, const Parameters & params)
+{
+  // Correct the motion of the sensor between the beams with the odometry
+  double vx = 0.0, vy = 0.0, wz = 0.0;
+  if (params.motion_compensation) {
+    estimateSensorVelocity(scan, vx, vy, wz);
+  }
+  segmentation_->setSensorVelocity(vx, vy, wz);
+
+  // Only segment the part of the scan where the dock is expected
+  updateRegionOfInterest(scan, params);
+
   // Perform segmentation on the scan and filter the clusters
   Clusters clusters;
   if (segmentation_->performSegmentation(scan, clusters)) {
-    clusters = segmentation_->filterClusters(clusters);
+    clusters = segmentation_->filterClusters(std::move(clusters));
   }
   return clusters;
 }
 
 
-bool Perception::refineClusterPose(Cluster & cluster, const Pcloud & cloud_template)
+bool Perception::refineClusterPose(
+  Cluster & cluster, const DockTemplate & dock_template, const Parameters & params,
+  std::chrono::steady_clock::time_point deadline)
 {
   bool success = false;
+  bool converged = false;
+  double score = 0.0;
+  int iterations = 0;
+  const int max_iterations = getIterationCap(params);
 
-  // Prepare the ICP object
-  pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ> icp;
-  icp.setMaximumIterations(icp_max_iter_);
-  icp.setMaxCorrespondenceDistance(icp_max_corr_dis_);
-  icp.setTransformationEpsilon(icp_max_trans_eps_);
-  icp.setEuclideanFitnessEpsilon(icp_max_eucl_fit_eps_);
+  if (dock_template.empty()) {
+    return false;
+  }
 
-  // Align the cluster to the template
-  Pcloud::Ptr cloud_template_ptr(new Pcloud(cloud_template));
-  Pcloud::Ptr cluster_cloud_ptr(new Pcloud(cluster.cloud));
-  Pcloud matched_cloud;
+  // Seed the matching with the best transform of a coarse search around the estimate, so it
+  // converges even if the estimate is beyond the correspondence distance
+  Eigen::Matrix4f estimate = Eigen::Matrix4f::Identity();
+  if (params.correlative_search && !tracking_active_ && dock_template.likelihood) {
+    CorrelativeMatcher2D correlative;
+    correlative.setLinearWindow(params.correlative_linear_window);
+    correlative.setAngularWindow(params.correlative_angular_window);
+    correlative.setMinScore(params.correlative_min_score);
+    correlative.setSearchGridTarget(dock_template.likelihood);
+    if (correlative.match(cluster.cloud)) {
+      estimate = correlative.getFinalTransformation();
+      RCLCPP_DEBUG(
+        logger_, "Correlative search seeded cluster %i with score %f", cluster.id,
+        correlative.getScore());
+    }
+  }
 
-  icp.setInputSource(cloud_template_ptr);
-  icp.setInputTarget(cluster_cloud_ptr);
-  icp.align(matched_cloud);
+  // Coarse to fine over the pyramid of the template, down to the level that matches the density
+  // of the cluster. The coarser levels match a decimated cluster and each level starts from the
+  // result of the previous one
+  const double cluster_spacing = DockTemplate::spacing(cluster.cloud);
+  const size_t finest = dock_template.selectLevel(cluster_spacing);
+  for (size_t level = dock_template.levels.size(); level-- > finest; ) {
+    const auto & template_level = dock_template.levels[level];
+    size_t step = 1;
+    if (level > finest && cluster_spacing > 0.0) {
+      step = std::max<size_t>(1, static_cast<size_t>(template_level.spacing / cluster_spacing));
+    }
+    Pcloud source;
+    source.header = cluster.cloud.header;
+    for (size_t i = 0; i < cluster.cloud.size(); i += step) {
+      source.push_back(cluster.cloud[i]);
+    }
+    pcl::transformPointCloud(source, source, estimate);
+
+    // The coarser levels only bring the cluster close to the template, so they have their own
+    // cap and leave the time budget to the finest level
+    const int level_max_iterations =
+      level > finest ? std::min(params.coarse_max_iter, max_iterations) : max_iterations;
+
+    Eigen::Matrix4f transformation;
+    double level_score = 0.0;
+    int level_iterations = 0;
+    converged = alignToTemplate(
+      source, template_level, params, level_max_iterations, deadline, transformation,
+      level_score, level_iterations);
+    iterations += level_iterations;
+    if (converged) {
+      estimate = transformation * estimate;
+      score = level_score;
+    }
+  }
 
   // If the ICP converged, store the results on the cluster
-  if (icp.hasConverged()) {
-    // Get the final transformation
-    auto icp_refinement = eigenToTransform(icp.getFinalTransformation());
+  if (converged) {
+    // The matcher moves the cluster onto the template, so the dock is at the inverse
+    auto icp_refinement = eigenToTransform(estimate).inverse();
     // Transform the pose to the matching frame
     tf2::Transform tf_stage;
-    tf2::fromMsg(initial_estimate_pose_.pose, tf_stage);
-    tf2::Transform tf_correct = icp_refinement * tf_stage;
+    tf2::fromMsg(matching_pose_.pose, tf_stage);
+    tf2::Transform tf_correct = tf_stage * icp_refinement;
     // Convert to ROS msg
     geometry_msgs::msg::Pose pose_correct;
     tf2::toMsg(tf_correct, pose_correct);
 
-    // Update the cluster
-    cluster.score = icp.getFitnessScore();
-    cluster.pose.header.frame_id = initial_estimate_pose_.header.frame_id;
+    // Update the cluster with the template aligned in the matching frame
+    cluster.score = score;
+    cluster.iterations = iterations;
+    cluster.pose.header.frame_id = matching_pose_.header.frame_id;
     cluster.pose.header.stamp = clock_->now();
     cluster.pose.pose = pose_correct;
-    cluster.cloud = matched_cloud;
+    pcl_ros::transformPointCloud(*dock_template.cloud, cluster.cloud, tf_correct);
+    cluster.cloud.header.frame_id = matching_pose_.header.frame_id;
 
     success = true;
 
@@ -216,11 +682,96 @@ bool Perception::refineClusterPose(Cluster & cluster, const Pcloud & cloud_templ
   return success;
 }
 
+bool Perception::alignToTemplate(
+  const Pcloud & source, const DockTemplateLevel & template_level, const Parameters & params,
+  int max_iterations, std::chrono::steady_clock::time_point deadline,
+  Eigen::Matrix4f & transformation, double & score, int & iterations)
+{
+  bool converged = false;
+  Pcloud matched_cloud;
+  transformation = Eigen::Matrix4f::Identity();
+  score = 0.0;
+  iterations = 0;
+
+  if (params.matcher == "se2") {
+    // Planar matcher, only estimates x, y and yaw
+    ScanMatcher2D matcher;
+    matcher.setMaximumIterations(max_iterations);
+    matcher.setMaxCorrespondenceDistance(params.icp_max_corr_dis);
+    matcher.setTransformationEpsilon(params.icp_max_trans_eps);
+    matcher.setEuclideanFitnessEpsilon(params.icp_max_eucl_fit_eps);
+    matcher.setDeadline(deadline);
+
+    // Align the cluster to the template
+    matcher.setInputSource(source);
+    matcher.setSearchGridTarget(template_level.grid);
+    matcher.align(matched_cloud);
+
+    converged = matcher.hasConverged();
+    score = matcher.getFitnessScore();
+    iterations = matcher.getIterations();
+    transformation = matcher.getFinalTransformation();
+  } else {
+    // Prepare the ICP object
+    CountedIterativeClosestPoint icp;
+    icp.setMaximumIterations(max_iterations);
+    icp.setMaxCorrespondenceDistance(params.icp_max_corr_dis);
+    icp.setTransformationEpsilon(params.icp_max_trans_eps);
+    icp.setEuclideanFitnessEpsilon(params.icp_max_eucl_fit_eps);
+
+    // Align the cluster to the template, reusing the KD-tree of the template
+    icp.setInputSource(std::make_shared<Pcloud>(source));
+    icp.setInputTarget(template_level.cloud);
+    icp.setSearchMethodTarget(template_level.tree, true);
+    icp.align(matched_cloud);
+
+    converged = icp.hasConverged();
+    if (converged) {
+      score = icp.getFitnessScore();
+      iterations = icp.getIterations();
+      transformation = icp.getFinalTransformation();
+    }
+  }
+  return converged;
+}
+
 bool Perception::refineAllClustersPoses(
-  Clusters & clusters, const Cluster & dock_template, Cluster & dock)
+  Clusters & clusters, const DockTemplate & dock_template, const Parameters & params,
+  Cluster & dock)
 {
   bool success = false;
-  Clusters potential_docks;
+  std::vector<Cluster *> potential_docks;
+  std::vector<Cluster *> candidates;
+  size_t shape_checked = 0, shape_rejected = 0;
+
+  // The clusters are matched in the frame of the template, so they are moved by the inverse of
+  // the matching pose. Usually in global coordinates (map frame)
+  tf2::Transform tf_stage;
+  tf2::fromMsg(matching_pose_.pose, tf_stage);
+  const tf2::Transform tf_stage_inverse = tf_stage.inverse();
+
+  // Publish the dock template only when it changes
+  if (params.debug && dock_template_pub_ && !dock_template.empty() &&
+    dock_template.cloud != published_template_)
+  {
+    dock_template_pub_->publish(createPointCloud2Msg(*dock_template.cloud));
+    published_template_ = dock_template.cloud;
+  }
+
+  // The clusters that reach the matching are visualized in a single cloud, coloured by cluster
+  const bool publish_targets = hasSubscribers(target_cloud_pub_, params);
+  pcl::PointCloud<pcl::PointXYZRGB> target_cloud;
+  Eigen::Affine3f template_to_stage = Eigen::Affine3f::Identity();
+  if (publish_targets) {
+    pcl_ros::transformAsMatrix(tf_stage, template_to_stage.matrix());
+    target_cloud.header.frame_id = matching_pose_.header.frame_id;
+  }
+
+  bool scan_resolved = false, scan_transformed = false;
+  std::string scan_frame;
+  uint64_t scan_stamp = 0;
+  tf2::Transform tf_scan;
+  Eigen::Affine3f scan_to_template = Eigen::Affine3f::Identity();
 
   for (auto & cluster : clusters) {
     // Discard clusters not valid (i.e. clusters not similar to dock by size, ...)
@@ -228,77 +779,231 @@ bool Perception::refineAllClustersPoses(
       continue;
     }
 
-    // Prepares the template pointcloud for matching by transforming to the initial estimate pose.
-    // Usually in global coordinates (map frame)
-    Pcloud cloud_template_initial;
-    tf2::Transform tf_stage;
-    tf2::fromMsg(initial_estimate_pose_.pose, tf_stage);
-    pcl_ros::transformPointCloud(dock_template.cloud, cloud_template_initial, tf_stage);
-    cloud_template_initial.header.frame_id = initial_estimate_pose_.header.frame_id;
-
-    // Transforms the target point cloud from the scan frame to the global frame (map frame)
-    if (cluster.cloud.header.frame_id != initial_estimate_pose_.header.frame_id) {
-      try {
-        if (!tf_buffer_->canTransform(
-            initial_estimate_pose_.header.frame_id, cluster.cloud.header.frame_id,
-            rclcpp::Time(cluster.cloud.header.stamp * 1000), rclcpp::Duration::from_seconds(0.2)))
-        {
-          RCLCPP_WARN(
-            logger_, "Could not transform %s to %s",
-            cluster.cloud.header.frame_id.c_str(), initial_estimate_pose_.header.frame_id.c_str());
-          return false;
-        }
-        auto tf_stamped = tf_buffer_->lookupTransform(
-          initial_estimate_pose_.header.frame_id, cluster.cloud.header.frame_id,
-          tf2::TimePointZero);
-        pcl_ros::transformPointCloud(cluster.cloud, cluster.cloud, tf_stamped);
-        cluster.cloud.header.frame_id = initial_estimate_pose_.header.frame_id;
-      } catch (const tf2::TransformException & ex) {
-        RCLCPP_WARN(
-          logger_, "Could not transform %s to %s: %s",
-          cluster.cloud.header.frame_id.c_str(),
-          initial_estimate_pose_.header.frame_id.c_str(), ex.what());
-        return false;
+    // Discard clusters whose shape cannot match the template before running any matching
+    if (params.shape_filter) {
+      shape_checked++;
+      if (!dock_template.descriptor.matches(
+          ShapeDescriptor(cluster.data(), cluster.size()), params.shape_extent_tolerance,
+          params.shape_max_distance))
+      {
+        shape_rejected++;
+        continue;
       }
     }
 
-    // Visualizes the target point cloud and estimated dock template pose
-    if (debug_) {
-      // Publish dock template and target cloud
-      dock_template_pub_->publish(createPointCloud2Msg(dock_template.cloud));
-      target_cloud_pub_->publish(createPointCloud2Msg(cluster.cloud));
+    // The transform from the scan to the global frame (map frame) is resolved once per scan.
+    // All the clusters of a scan share its frame and stamp
+    const auto & header = cluster.header();
+    if (!scan_resolved || header.frame_id != scan_frame || header.stamp != scan_stamp) {
+      scan_resolved = true;
+      scan_frame = header.frame_id;
+      scan_stamp = header.stamp;
+      scan_transformed = lookupScanTransform(header, tf_scan);
+      pcl_ros::transformAsMatrix(tf_stage_inverse * tf_scan, scan_to_template.matrix());
+    }
+    if (!scan_transformed) {
+      continue;
+    }
+
+    // Only the clusters that reach the matching get their own pointcloud, moved to the frame of
+    // the template in the same pass
+    cluster.materialize(scan_to_template);
+
+    // Each candidate gets its own colour in the debug cloud
+    if (publish_targets) {
+      const auto & color = CLUSTER_COLORS[candidates.size() % CLUSTER_COLORS.size()];
+      for (const auto & point : cluster.cloud) {
+        pcl::PointXYZRGB target_point;
+        target_point.getVector3fMap() = template_to_stage * point.getVector3fMap();
+        target_point.r = color[0];
+        target_point.g = color[1];
+        target_point.b = color[2];
+        target_cloud.push_back(target_point);
+      }
     }
 
-    // Refine the cluster to get the dock pose
-    if (refineClusterPose(cluster, cloud_template_initial)) {
-      // Check if potential dock is found
-      if (cluster.score < icp_min_score_) {
-        RCLCPP_DEBUG(
-          logger_, "Dock potentially identified at cluster %i with score %f",
-          cluster.id, cluster.score);
-        potential_docks.push_back(cluster);
+    candidates.push_back(&cluster);
+  }
+  if (publish_targets) {
+    target_cloud_pub_->publish(createPointCloud2Msg(target_cloud));
+  }
+
+  // Report the matching avoided by the shape filter
+  if (params.shape_filter) {
+    shape_checked_ += shape_checked;
+    shape_rejected_ += shape_rejected;
+    RCLCPP_DEBUG(
+      logger_, "Shape filter rejected %lu of %lu clusters (%lu of %lu since start)",
+      shape_rejected, shape_checked, shape_rejected_, shape_checked_);
+  }
+
+  // Refine the clusters concurrently to get the dock pose. The hypotheses still running when
+  // the time budget runs out are cancelled
+  auto deadline = std::chrono::steady_clock::time_point::max();
+  if (params.time_budget > 0.0) {
+    deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(params.time_budget));
+  }
+  std::vector<char> refined(candidates.size(), false);
+  std::atomic<size_t> cancelled{0};
+  worker_pool_->parallelFor(
+    candidates.size(), [&](size_t i) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        cancelled++;
+        return;
       }
+      refined[i] = refineClusterPose(*candidates[i], dock_template, params, deadline);
+    });
+  if (cancelled > 0) {
+    RCLCPP_DEBUG(
+      logger_, "%lu of %lu clusters skipped by the time budget", cancelled.load(),
+      candidates.size());
+  }
+
+  for (size_t i = 0; i < candidates.size(); i++) {
+    // Check if potential dock is found
+    if (refined[i] && candidates[i]->score < params.icp_min_score) {
+      RCLCPP_DEBUG(
+        logger_, "Dock potentially identified at cluster %i with score %f",
+        candidates[i]->id, candidates[i]->score);
+      potential_docks.push_back(candidates[i]);
     }
   }
 
   // Check if dock is found
   if (!potential_docks.empty()) {
-    // Sort the clusters by ICP score and select the best one
-    std::sort(potential_docks.begin(), potential_docks.end());
-    dock = potential_docks.front();
+    // Sort the clusters by ICP score and select the best one. The potential docks are in the
+    // order of the clusters, which breaks the ties so the selection does not depend on the
+    // order in which the clusters were refined
+    std::stable_sort(
+      potential_docks.begin(), potential_docks.end(),
+      [](const Cluster * a, const Cluster * b) {return a->score < b->score;});
+    dock = *potential_docks.front();
     // Publish the dock cloud
-    if (debug_) {
+    if (hasSubscribers(dock_cloud_pub_, params)) {
       dock_cloud_pub_->publish(createPointCloud2Msg(dock.cloud));
     }
     success = true;
     RCLCPP_DEBUG(logger_, "Dock successfully identified at cluster %i", dock.id);
   } else {
     RCLCPP_WARN(logger_, "Unable to identify the dock");
+    // Partial or oblique views of the dock may be rejected before the matching
+    if (shape_rejected > 0) {
+      RCLCPP_INFO(
+        logger_, "The shape filter rejected %lu of %lu clusters", shape_rejected, shape_checked);
+    }
   }
 
   return success;
 }
 
+bool Perception::lookupScanTransform(const pcl::PCLHeader & header, tf2::Transform & tf_scan)
+{
+  tf_scan.setIdentity();
+  const auto & target_frame = matching_pose_.header.frame_id;
+  if (header.frame_id == target_frame) {
+    return true;
+  }
+
+  // PCL stamps are in microseconds
+  const rclcpp::Time stamp(static_cast<int64_t>(header.stamp * 1000));
+  try {
+    if (!tf_buffer_->canTransform(
+        target_frame, header.frame_id, stamp, rclcpp::Duration::from_seconds(0.2)))
+    {
+      RCLCPP_WARN(
+        logger_, "Could not transform %s to %s", header.frame_id.c_str(), target_frame.c_str());
+      return false;
+    }
+    auto tf_stamped = tf_buffer_->lookupTransform(target_frame, header.frame_id, stamp);
+    tf2::fromMsg(tf_stamped.transform, tf_scan);
+  } catch (const tf2::TransformException & ex) {
+    RCLCPP_WARN(
+      logger_, "Could not transform %s to %s: %s", header.frame_id.c_str(),
+      target_frame.c_str(), ex.what());
+    return false;
+  }
+  return true;
+}
+
+bool Perception::estimateSensorVelocity(
+  const sensor_msgs::msg::LaserScan & scan, double & vx, double & vy, double & wz)
+{
+  vx = vy = wz = 0.0;
+  const double duration = scan.time_increment * (static_cast<double>(scan.ranges.size()) - 1.0);
+  if (duration <= 0.0) {
+    return false;
+  }
+
+  // Motion of the sensor during the time of a scan before it, as the pose of the sensor at the
+  // stamp of the scan in the frame of the sensor at the start of that interval
+  const auto stamp = tf2_ros::fromMsg(scan.header.stamp);
+  const auto start = stamp - tf2::durationFromSec(duration);
+  tf2::Transform motion;
+  try {
+    auto tf_stamped = tf_buffer_->lookupTransform(
+      scan.header.frame_id, start, scan.header.frame_id, stamp, fixed_frame_,
+      tf2::Duration::zero());
+    tf2::fromMsg(tf_stamped.transform, motion);
+  } catch (const tf2::TransformException & ex) {
+    RCLCPP_DEBUG(logger_, "Could not estimate the motion of the sensor: %s", ex.what());
+    return false;
+  }
+  vx = motion.getOrigin().x() / duration;
+  vy = motion.getOrigin().y() / duration;
+  wz = tf2::getYaw(motion.getRotation()) / duration;
+  return true;
+}
+
+void Perception::updateRegionOfInterest(
+  const sensor_msgs::msg::LaserScan & scan, const Parameters & params)
+{
+  if (!params.region_of_interest || dock_template_.empty()) {
+    segmentation_->clearRegionOfInterest();
+    return;
+  }
+
+  // Expected pose of the dock in the frame of the scan. The window has margins, so the latest
+  // transform is good enough
+  const auto & expected = dock_found_ ? detected_dock_.pose : initial_estimate_pose_;
+  tf2::Transform tf_expected;
+  tf2::fromMsg(expected.pose, tf_expected);
+  if (expected.header.frame_id != scan.header.frame_id) {
+    try {
+      auto tf_stamped = tf_buffer_->lookupTransform(
+        scan.header.frame_id, expected.header.frame_id, tf2::TimePointZero);
+      tf2::Transform tf_frame;
+      tf2::fromMsg(tf_stamped.transform, tf_frame);
+      tf_expected = tf_frame * tf_expected;
+    } catch (const tf2::TransformException & ex) {
+      RCLCPP_DEBUG(logger_, "Could not locate the region of interest: %s", ex.what());
+      segmentation_->clearRegionOfInterest();
+      return;
+    }
+  }
+  const auto & template_center = dock_template_.center;
+  const tf2::Vector3 center =
+    tf_expected * tf2::Vector3(template_center.x, template_center.y, 0.0);
+  const double range = std::hypot(center.x(), center.y());
+  const double bearing = std::atan2(center.y(), center.x());
+
+  // The margins double after each scan without the dock
+  const double growth = std::ldexp(1.0, std::min(roi_misses_, 8));
+  const double half_width = dock_template_.radius + params.roi_range_margin * growth;
+  if (range <= half_width) {
+    segmentation_->clearRegionOfInterest();
+    return;
+  }
+  const double half_angle = std::asin(half_width / range) + params.roi_angle_margin * growth;
+  if (half_angle >= M_PI) {
+    segmentation_->clearRegionOfInterest();
+    return;
+  }
+  segmentation_->setRegionOfInterest(
+    bearing - half_angle, bearing + half_angle, range - half_width, range + half_width);
+}
+
 sensor_msgs::msg::PointCloud2 Perception::createPointCloud2Msg(const Pcloud & cloud)
 {
   sensor_msgs::msg::PointCloud2 msg;
@@ -307,6 +1012,22 @@ sensor_msgs::msg::PointCloud2 Perception::createPointCloud2Msg(const Pcloud & cl
   return msg;
 }
 
+sensor_msgs::msg::PointCloud2 Perception::createPointCloud2Msg(
+  const pcl::PointCloud<pcl::PointXYZRGB> & cloud)
+{
+  sensor_msgs::msg::PointCloud2 msg;
+  pcl::toROSMsg(cloud, msg);
+  msg.header.stamp = clock_->now();
+  return msg;
+}
+
+bool Perception::hasSubscribers(
+  const rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr & publisher,
+  const Parameters & params) const
+{
+  return params.debug && publisher && publisher->get_subscription_count() > 0;
+}
+
 tf2::Transform Perception::eigenToTransform(const Eigen::Matrix4f & T)
 {
   return tf2::Transform(
@@ -329,23 +1050,67 @@ rcl_interfaces::msg::SetParametersResult Perception::dynamicParametersCallback(
 
     if (type == rclcpp::ParameterType::PARAMETER_INTEGER) {
       if (name == name_ + ".perception.icp_max_iter") {
-        icp_max_iter_ = parameter.as_int();
+        params_.icp_max_iter = parameter.as_int();
+      } else if (name == name_ + ".perception.coarse_max_iter") {
+        params_.coarse_max_iter = parameter.as_int();
+      } else if (name == name_ + ".perception.tracking_min_iter") {
+        params_.tracking_min_iter = parameter.as_int();
       }
     } else if (type == rclcpp::ParameterType::PARAMETER_DOUBLE) {
       if (name == name_ + ".perception.icp_min_score") {
-        icp_min_score_ = parameter.as_double();
+        params_.icp_min_score = parameter.as_double();
+      } else if (name == name_ + ".perception.time_budget") {
+        params_.time_budget = parameter.as_double();
+      } else if (name == name_ + ".perception.shape_extent_tolerance") {
+        params_.shape_extent_tolerance = parameter.as_double();
+      } else if (name == name_ + ".perception.roi_angle_margin") {
+        params_.roi_angle_margin = parameter.as_double();
+      } else if (name == name_ + ".perception.correlative_linear_window") {
+        params_.correlative_linear_window = parameter.as_double();
+      } else if (name == name_ + ".perception.correlative_angular_window") {
+        params_.correlative_angular_window = parameter.as_double();
+      } else if (name == name_ + ".perception.correlative_min_score") {
+        params_.correlative_min_score = parameter.as_double();
+      } else if (name == name_ + ".perception.roi_range_margin") {
+        params_.roi_range_margin = parameter.as_double();
+      } else if (name == name_ + ".perception.shape_max_distance") {
+        params_.shape_max_distance = parameter.as_double();
+      } else if (name == name_ + ".perception.propagation_max_age") {
+        params_.propagation_max_age = parameter.as_double();
       } else if (name == name_ + ".perception.icp_max_corr_dis") {
-        icp_max_corr_dis_ = parameter.as_double();
+        params_.icp_max_corr_dis = parameter.as_double();
       } else if (name == name_ + ".perception.icp_max_trans_eps") {
-        icp_max_trans_eps_ = parameter.as_double();
+        params_.icp_max_trans_eps = parameter.as_double();
       } else if (name == name_ + ".perception.icp_max_eucl_fit_eps") {
-        icp_max_eucl_fit_eps_ = parameter.as_double();
+        params_.icp_max_eucl_fit_eps = parameter.as_double();
+      }
+    } else if (type == rclcpp::ParameterType::PARAMETER_STRING) {
+      if (name == name_ + ".perception.matcher") {
+        const auto & matcher = parameter.as_string();
+        if (matcher != "pcl" && matcher != "se2") {
+          result.successful = false;
+          result.reason = "Unknown matcher " + matcher + ", must be 'pcl' or 'se2'";
+          return result;
+        }
+        params_.matcher = matcher;
       }
     } else if (type == rclcpp::ParameterType::PARAMETER_BOOL) {
       if (name == name_ + ".perception.enable_debug") {
-        debug_ = parameter.as_bool();
+        params_.debug = parameter.as_bool();
       } else if (name == name_ + ".perception.use_first_detection") {
-        use_first_detection_ = parameter.as_bool();
+        params_.use_first_detection = parameter.as_bool();
+      } else if (name == name_ + ".perception.shape_filter") {
+        params_.shape_filter = parameter.as_bool();
+      } else if (name == name_ + ".perception.propagate_detection") {
+        params_.propagate_detection = parameter.as_bool();
+      } else if (name == name_ + ".perception.motion_compensation") {
+        params_.motion_compensation = parameter.as_bool();
+      } else if (name == name_ + ".perception.region_of_interest") {
+        params_.region_of_interest = parameter.as_bool();
+      } else if (name == name_ + ".perception.tracking") {
+        params_.tracking = parameter.as_bool();
+      } else if (name == name_ + ".perception.correlative_search") {
+        params_.correlative_search = parameter.as_bool();
       }
     }
   }
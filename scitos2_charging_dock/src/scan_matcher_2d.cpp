@@ -0,0 +1,263 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+#include "scitos2_charging_dock/scan_matcher_2d.hpp"
+
+namespace scitos2_charging_dock
+{
+
+NearestGrid2D::NearestGrid2D(const Pcloud & cloud, float margin, float resolution)
+: resolution_(resolution)
+{
+  points_.reserve(cloud.size());
+  for (const auto & point : cloud) {
+    points_.emplace_back(point.x, point.y);
+  }
+  if (points_.empty()) {
+    return;
+  }
+
+  // Bounding box of the cloud with the margin
+  Point min_point = points_.front(), max_point = points_.front();
+  for (const auto & point : points_) {
+    min_point = min_point.cwiseMin(point);
+    max_point = max_point.cwiseMax(point);
+  }
+  origin_ = min_point - Point(margin, margin);
+  const Point size = max_point - min_point + Point(2.0f * margin, 2.0f * margin);
+
+  // Coarsen the grid if it would be too large
+  constexpr int max_cells = 1 << 20;
+  do {
+    width_ = static_cast<int>(std::ceil(size.x() / resolution_)) + 1;
+    height_ = static_cast<int>(std::ceil(size.y() / resolution_)) + 1;
+    if (width_ * height_ > max_cells) {
+      resolution_ *= 2.0f;
+    }
+  } while (width_ * height_ > max_cells);
+
+  // Store the nearest point to the center of each cell
+  cells_.resize(width_ * height_);
+  for (int iy = 0; iy < height_; iy++) {
+    for (int ix = 0; ix < width_; ix++) {
+      const Point center = origin_ + resolution_ * Point(ix + 0.5f, iy + 0.5f);
+      uint32_t best = 0;
+      float best_distance_sq = std::numeric_limits<float>::max();
+      for (size_t i = 0; i < points_.size(); i++) {
+        const float d = (points_[i] - center).squaredNorm();
+        if (d < best_distance_sq) {
+          best_distance_sq = d;
+          best = static_cast<uint32_t>(i);
+        }
+      }
+      cells_[iy * width_ + ix] = best;
+    }
+  }
+}
+
+size_t NearestGrid2D::nearest(const Point & point, float & distance_sq) const
+{
+  const int ix = static_cast<int>(std::floor((point.x() - origin_.x()) / resolution_));
+  const int iy = static_cast<int>(std::floor((point.y() - origin_.y()) / resolution_));
+
+  // Linear search outside the grid
+  if (ix < 0 || iy < 0 || ix >= width_ || iy >= height_) {
+    size_t best = 0;
+    distance_sq = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < points_.size(); i++) {
+      const float d = (points_[i] - point).squaredNorm();
+      if (d < distance_sq) {
+        distance_sq = d;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  // Start from the nearest point to the center of the cell and walk along the cloud
+  size_t best = cells_[iy * width_ + ix];
+  distance_sq = (points_[best] - point).squaredNorm();
+  bool improved = true;
+  while (improved) {
+    improved = false;
+    for (size_t j : {best - 1, best + 1}) {
+      if (j < points_.size()) {
+        const float d = (points_[j] - point).squaredNorm();
+        if (d < distance_sq) {
+          distance_sq = d;
+          best = j;
+          improved = true;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+NearestGrid2D::Point NearestGrid2D::closest(const Point & point, float & distance_sq) const
+{
+  const size_t i = nearest(point, distance_sq);
+  Point best = points_[i];
+
+  // The cloud is ordered as the beams of the scan, so the surface around the nearest point
+  // is approximated by the segments to its neighbours
+  auto project = [&](size_t j) {
+      const Point segment = points_[j] - points_[i];
+      const float length_sq = segment.squaredNorm();
+      if (length_sq <= 0.0f) {
+        return;
+      }
+      const float t = std::clamp((point - points_[i]).dot(segment) / length_sq, 0.0f, 1.0f);
+      const Point candidate = points_[i] + t * segment;
+      const float d = (candidate - point).squaredNorm();
+      if (d < distance_sq) {
+        distance_sq = d;
+        best = candidate;
+      }
+    };
+  if (i > 0) {
+    project(i - 1);
+  }
+  if (i + 1 < points_.size()) {
+    project(i + 1);
+  }
+  return best;
+}
+
+void ScanMatcher2D::setInputSource(const Pcloud & cloud)
+{
+  source_header_ = cloud.header;
+  source_.clear();
+  source_.reserve(cloud.size());
+  for (const auto & point : cloud) {
+    source_.emplace_back(point.x, point.y);
+  }
+}
+
+void ScanMatcher2D::setInputTarget(const Pcloud & cloud)
+{
+  target_ = std::make_shared<NearestGrid2D>(
+    cloud, static_cast<float>(max_correspondence_distance_));
+}
+
+void ScanMatcher2D::align(Pcloud & output)
+{
+  rotation_.setIdentity();
+  translation_.setZero();
+  fitness_score_ = std::numeric_limits<double>::max();
+  iterations_ = 0;
+  converged_ = false;
+
+  output.clear();
+  output.header = source_header_;
+  if (source_.empty() || !target_ || target_->empty()) {
+    return;
+  }
+
+  const float max_distance_sq =
+    static_cast<float>(max_correspondence_distance_ * max_correspondence_distance_);
+  double previous_mse = std::numeric_limits<double>::max();
+
+  while (iterations_ < max_iterations_) {
+    // Cancel the alignment when it runs out of time
+    if (std::chrono::steady_clock::now() > deadline_) {
+      return;
+    }
+
+    // Accumulate the sums of the correspondences in a single pass
+    size_t n = 0;
+    double error = 0.0;
+    double spx = 0.0, spy = 0.0, sqx = 0.0, sqy = 0.0;
+    double sxx = 0.0, sxy = 0.0, syx = 0.0, syy = 0.0;
+    for (const auto & source_point : source_) {
+      const Point p = rotation_ * source_point + translation_;
+      float distance_sq;
+      const Point q = target_->closest(p, distance_sq);
+      if (distance_sq > max_distance_sq) {
+        continue;
+      }
+      n++;
+      error += distance_sq;
+      spx += p.x();
+      spy += p.y();
+      sqx += q.x();
+      sqy += q.y();
+      sxx += p.x() * q.x();
+      sxy += p.x() * q.y();
+      syx += p.y() * q.x();
+      syy += p.y() * q.y();
+    }
+
+    // Same minimum number of correspondences as PCL
+    if (n < 3) {
+      return;
+    }
+
+    // Closed-form SE(2) solution from the centered cross-covariance
+    const double inv_n = 1.0 / static_cast<double>(n);
+    const double mpx = spx * inv_n, mpy = spy * inv_n, mqx = sqx * inv_n, mqy = sqy * inv_n;
+    const double dot = (sxx - n * mpx * mqx) + (syy - n * mpy * mqy);
+    const double cross = (sxy - n * mpx * mqy) - (syx - n * mpy * mqx);
+    const double dyaw = std::atan2(cross, dot);
+    const float c = static_cast<float>(std::cos(dyaw));
+    const float s = static_cast<float>(std::sin(dyaw));
+    Eigen::Matrix2f delta_rotation;
+    delta_rotation << c, -s, s, c;
+    const Point delta_translation = Eigen::Vector2d(mqx, mqy).cast<float>() -
+      delta_rotation * Eigen::Vector2d(mpx, mpy).cast<float>();
+
+    // Compose the increment with the current estimate
+    rotation_ = delta_rotation * rotation_;
+    translation_ = delta_rotation * translation_ + delta_translation;
+    iterations_++;
+
+    // Early termination
+    const double mse = error * inv_n;
+    const double increment = delta_translation.squaredNorm() + dyaw * dyaw;
+    if (increment <= transformation_epsilon_ ||
+      std::abs(mse - previous_mse) <= euclidean_fitness_epsilon_)
+    {
+      break;
+    }
+    previous_mse = mse;
+  }
+  converged_ = true;
+
+  // Transform the source and compute the fitness score over all the points
+  double error = 0.0;
+  output.reserve(source_.size());
+  for (const auto & source_point : source_) {
+    const Point p = rotation_ * source_point + translation_;
+    float distance_sq;
+    target_->nearest(p, distance_sq);
+    error += distance_sq;
+    output.push_back(pcl::PointXYZ(p.x(), p.y(), 0.0f));
+  }
+  fitness_score_ = error / static_cast<double>(source_.size());
+}
+
+Eigen::Matrix4f ScanMatcher2D::getFinalTransformation() const
+{
+  Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+  transformation.block<2, 2>(0, 0) = rotation_;
+  transformation.block<2, 1>(0, 3) = translation_;
+  return transformation;
+}
+
+}  // namespace scitos2_charging_dock
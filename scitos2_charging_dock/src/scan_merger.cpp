@@ -0,0 +1,146 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// TF
+#include "tf2_geometry_msgs/tf2_geometry_msgs.hpp"
+
+#include "scitos2_charging_dock/scan_merger.hpp"
+
+namespace scitos2_charging_dock
+{
+
+ScanMerger::ScanMerger(
+  std::shared_ptr<tf2_ros::Buffer> tf, const std::string & frame, size_t sources,
+  double sync_tolerance)
+: tf_buffer_(tf), frame_(frame), sync_tolerance_(sync_tolerance), latest_scans_(sources)
+{
+}
+
+sensor_msgs::msg::LaserScan::ConstSharedPtr ScanMerger::addScan(
+  size_t source, sensor_msgs::msg::LaserScan::ConstSharedPtr scan)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!scan || source >= latest_scans_.size()) {
+    return nullptr;
+  }
+  const rclcpp::Time stamp(scan->header.stamp, RCL_ROS_TIME);
+  latest_scans_[source] = std::move(scan);
+
+  // The merged scan is stamped with the newest scan, so it is only merged when the newest scan
+  // arrives. A scan arriving late is kept for the next merge, a merged scan with the same stamp
+  // as the last one would be taken as already processed
+  rclcpp::Time newest(0, 0, RCL_ROS_TIME);
+  for (const auto & latest : latest_scans_) {
+    if (latest && rclcpp::Time(latest->header.stamp, RCL_ROS_TIME) > newest) {
+      newest = rclcpp::Time(latest->header.stamp, RCL_ROS_TIME);
+    }
+  }
+  if (stamp < newest || stamp <= last_stamp_) {
+    return nullptr;
+  }
+
+  // Scans close in time to the newest one with their extrinsic transforms
+  std::vector<std::pair<const sensor_msgs::msg::LaserScan *, tf2::Transform>> scans;
+  float angle_increment = std::numeric_limits<float>::max();
+  float scan_time = 0.0f;
+  for (const auto & latest : latest_scans_) {
+    tf2::Transform extrinsic;
+    if (!latest || latest->angle_increment <= 0.0f ||
+      (newest - rclcpp::Time(latest->header.stamp, RCL_ROS_TIME)).seconds() > sync_tolerance_ ||
+      !lookupExtrinsic(latest->header.frame_id, extrinsic))
+    {
+      continue;
+    }
+    scans.emplace_back(latest.get(), extrinsic);
+    angle_increment = std::min(angle_increment, latest->angle_increment);
+    scan_time = std::max(scan_time, latest->scan_time);
+  }
+  if (scans.empty()) {
+    return nullptr;
+  }
+  last_stamp_ = newest;
+
+  // A whole turn with the finest resolution of the lasers. The beams are not taken at the same
+  // time, so the merged scan has no time between them. The beams of the older scans are not
+  // moved to the newest stamp, so they lag up to the sync tolerance behind the robot motion
+  auto merged = std::make_shared<sensor_msgs::msg::LaserScan>();
+  merged->header.frame_id = frame_;
+  merged->header.stamp = newest;
+  const size_t bins = static_cast<size_t>(std::ceil(2.0 * M_PI / angle_increment));
+  merged->angle_min = static_cast<float>(-M_PI);
+  merged->angle_increment = angle_increment;
+  merged->angle_max = merged->angle_min + static_cast<float>(bins - 1) * angle_increment;
+  merged->time_increment = 0.0f;
+  merged->scan_time = scan_time;
+  merged->ranges.assign(bins, std::numeric_limits<float>::infinity());
+
+  // Move the valid beams to the common frame and keep the nearest return of each bin
+  float range_min = std::numeric_limits<float>::max();
+  float range_max = 0.0f;
+  for (const auto & [latest, extrinsic] : scans) {
+    for (size_t i = 0; i < latest->ranges.size(); i++) {
+      const float range = latest->ranges[i];
+      if (!(range >= latest->range_min && range <= latest->range_max)) {
+        continue;
+      }
+      const double angle = latest->angle_min + static_cast<double>(i) * latest->angle_increment;
+      const tf2::Vector3 point =
+        extrinsic * tf2::Vector3(range * std::cos(angle), range * std::sin(angle), 0.0);
+      const float merged_range = static_cast<float>(std::hypot(point.x(), point.y()));
+      const double merged_angle = std::atan2(point.y(), point.x());
+      const size_t bin =
+        static_cast<size_t>(std::lround((merged_angle + M_PI) / angle_increment)) % bins;
+      merged->ranges[bin] = std::min(merged->ranges[bin], merged_range);
+      range_min = std::min(range_min, merged_range);
+      range_max = std::max(range_max, merged_range);
+    }
+  }
+  merged->range_min = std::min(range_min, range_max);
+  merged->range_max = range_max;
+  return merged;
+}
+
+bool ScanMerger::lookupExtrinsic(const std::string & sensor_frame, tf2::Transform & extrinsic)
+{
+  auto cached = extrinsics_.find(sensor_frame);
+  if (cached != extrinsics_.end()) {
+    extrinsic = cached->second;
+    return true;
+  }
+
+  if (sensor_frame == frame_) {
+    extrinsic.setIdentity();
+  } else {
+    try {
+      auto tf_stamped = tf_buffer_->lookupTransform(frame_, sensor_frame, tf2::TimePointZero);
+      tf2::fromMsg(tf_stamped.transform, extrinsic);
+    } catch (const tf2::TransformException & ex) {
+      RCLCPP_DEBUG(
+        logger_, "Could not get the extrinsic of %s: %s", sensor_frame.c_str(), ex.what());
+      return false;
+    }
+  }
+  extrinsics_.emplace(sensor_frame, extrinsic);
+  return true;
+}
+
+}  // namespace scitos2_charging_dock
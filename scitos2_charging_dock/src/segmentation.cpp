@@ -12,6 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// C++
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <utility>
+
 #include "rclcpp/rclcpp.hpp"
 #include "nav2_util/node_utils.hpp"
 #include "scitos2_charging_dock/segmentation.hpp"
@@ -58,62 +66,85 @@ Segmentation::Segmentation(
 bool Segmentation::performSegmentation(
   const sensor_msgs::msg::LaserScan & scan, Clusters & clusters)
 {
-  // Convert the scan to points
-  auto points = scanToPoints(scan);
+  // The parameters cannot change while the scan is segmented
+  std::lock_guard<std::mutex> lock(dynamic_params_lock_);
+
+  // Convert the scan to points, shared by all the clusters
+  auto scan_points = std::make_shared<Pcloud>(scanToPoints(scan));
+  scan_points->header.frame_id = scan.header.frame_id;
+  // PCL stamps are in microseconds
+  scan_points->header.stamp = rclcpp::Time(scan.header.stamp).nanoseconds() / 1000;
+
+  // A full turn has no ends, so the points start at a jump and a segment over the first and
+  // last beams, e.g. a dock behind a merged scan, is not split
+  auto & turn_points = scan_points->points;
+  if (closed_scan_ && turn_points.size() > 1 &&
+    !isJumpBetweenPoints(turn_points.back(), turn_points.front(), distance_threshold_))
+  {
+    for (size_t p = 1; p < turn_points.size(); p++) {
+      if (isJumpBetweenPoints(turn_points[p - 1], turn_points[p], distance_threshold_)) {
+        std::rotate(turn_points.begin(), turn_points.begin() + p, turn_points.end());
+        break;
+      }
+    }
+  }
+  const Pcloud & points = *scan_points;
 
   if (points.empty()) {
     return false;
   }
 
-  // Create the first cluster
-  Cluster current_cluster;
-  current_cluster.cloud.header.frame_id = scan.header.frame_id;
-  current_cluster.push_back(points.front());
-
-  // Create the segments
-  for (uint64_t p = 1; p < points.size(); p++) {
+  // Create the segments as ranges of the points, accumulating their statistics in the same pass.
+  // Each cluster is identified by its position in the segmentation
+  size_t begin = 0;
+  ClusterStatistics statistics;
+  statistics.add(points.front());
+  for (size_t p = 1; p < points.size(); p++) {
     if (isJumpBetweenPoints(points[p - 1], points[p], distance_threshold_)) {
-      clusters.push_back(current_cluster);
-      current_cluster.clear();
+      clusters.emplace_back();
+      clusters.back().id = static_cast<int>(clusters.size() - 1);
+      clusters.back().assign(scan_points, begin, p, statistics);
+      begin = p;
+      statistics = ClusterStatistics();
     }
-    current_cluster.push_back(points[p]);
+    statistics.add(points[p]);
   }
-  clusters.push_back(current_cluster);
+  clusters.emplace_back();
+  clusters.back().id = static_cast<int>(clusters.size() - 1);
+  clusters.back().assign(scan_points, begin, points.size(), statistics);
 
   return clusters.size() > 0;
 }
 
-Clusters Segmentation::filterClusters(const Clusters & clusters)
+Clusters Segmentation::filterClusters(Clusters clusters)
 {
-  Clusters filtered_clusters;
-  filtered_clusters.reserve(clusters.size());
+  std::lock_guard<std::mutex> lock(dynamic_params_lock_);
 
   const double squared_min_cluster_width = min_cluster_width_ * min_cluster_width_;
   const double squared_max_cluster_width = max_cluster_width_ * max_cluster_width_;
 
-  for (const auto & cluster : clusters) {
-    // By number of points
-    if (cluster.size() < min_points_cluster_ || cluster.size() > max_points_cluster_) {
-      continue;
-    }
-
-    // By distance to sensor
-    if (cluster.centroid_length() < min_avg_distance_from_sensor_ ||
-      cluster.centroid_length() > max_avg_distance_from_sensor_)
-    {
-      continue;
-    }
+  // Remove the clusters in place so the survivors are not copied
+  auto rejected = [&](const Cluster & cluster) {
+      // By number of points
+      if (cluster.size() < min_points_cluster_ || cluster.size() > max_points_cluster_) {
+        return true;
+      }
 
-    // By width
-    if (cluster.width_squared() < squared_min_cluster_width ||
-      cluster.width_squared() > squared_max_cluster_width)
-    {
-      continue;
-    }
+      // By distance to sensor
+      const double centroid_length = cluster.centroid_length();
+      if (centroid_length < min_avg_distance_from_sensor_ ||
+        centroid_length > max_avg_distance_from_sensor_)
+      {
+        return true;
+      }
 
-    filtered_clusters.push_back(cluster);
-  }
-  return filtered_clusters;
+      // By width
+      const double width_squared = cluster.width_squared();
+      return width_squared < squared_min_cluster_width ||
+             width_squared > squared_max_cluster_width;
+    };
+  clusters.erase(std::remove_if(clusters.begin(), clusters.end(), rejected), clusters.end());
+  return clusters;
 }
 
 geometry_msgs::msg::Point Segmentation::fromPolarToCartesian(double range, double angle)
@@ -124,31 +155,150 @@ geometry_msgs::msg::Point Segmentation::fromPolarToCartesian(double range, doubl
   return point;
 }
 
-std::vector<geometry_msgs::msg::Point> Segmentation::scanToPoints(
-  const sensor_msgs::msg::LaserScan & scan)
+void Segmentation::updateTrigonometricTables(const sensor_msgs::msg::LaserScan & scan)
+{
+  if (cos_table_.size() == scan.ranges.size() && table_angle_min_ == scan.angle_min &&
+    table_angle_increment_ == scan.angle_increment)
+  {
+    return;
+  }
+
+  // The angle of each beam is computed from its index so it does not drift
+  const size_t size = scan.ranges.size();
+  cos_table_.resize(size);
+  sin_table_.resize(size);
+  for (size_t i = 0; i < size; i++) {
+    const double angle = static_cast<double>(scan.angle_min) +
+      static_cast<double>(i) * static_cast<double>(scan.angle_increment);
+    cos_table_[i] = static_cast<float>(std::cos(angle));
+    sin_table_[i] = static_cast<float>(std::sin(angle));
+  }
+  table_angle_min_ = scan.angle_min;
+  table_angle_increment_ = scan.angle_increment;
+  beam_x_.resize(size);
+  beam_y_.resize(size);
+}
+
+Pcloud Segmentation::scanToPoints(const sensor_msgs::msg::LaserScan & scan)
 {
-  std::vector<geometry_msgs::msg::Point> points;
-  double phi = scan.angle_min;
-  double angle_resolution = scan.angle_increment;
-  for (const auto r : scan.ranges) {
-    if (r >= scan.range_min && r <= scan.range_max) {
-      points.push_back(fromPolarToCartesian(r, phi));
+  updateTrigonometricTables(scan);
+
+  // Spans of the beams and ranges inside the region of interest, the whole scan without it
+  const size_t size = scan.ranges.size();
+  const double turn = 2.0 * M_PI;
+  const double increment = scan.angle_increment;
+  const bool full_turn = increment > 0.0 &&
+    std::abs(static_cast<double>(size) * increment - turn) < increment;
+  std::array<std::pair<size_t, size_t>, 2> spans{{{0, size}, {0, 0}}};
+  float range_min = scan.range_min, range_max = scan.range_max;
+  closed_scan_ = full_turn;
+  if (roi_enabled_ && increment > 0.0) {
+    // Move the window to the turn that starts at the first beam. A window over the seam of a
+    // full turn continues at the first beams, over the seam of a partial scan it is not
+    // contiguous, so the whole scan is used instead
+    const double offset = roi_angle_min_ - scan.angle_min;
+    const double start = offset - turn * std::floor(offset / turn);
+    const double stop = start + (roi_angle_max_ - roi_angle_min_);
+    if (stop < turn || full_turn) {
+      const double begin = std::ceil(start / increment);
+      const double end = std::floor(std::min(stop, turn) / increment) + 1.0;
+      auto & [first, last] = spans[0];
+      first = static_cast<size_t>(std::clamp(begin, 0.0, static_cast<double>(size)));
+      last = static_cast<size_t>(
+        std::clamp(end, static_cast<double>(first), static_cast<double>(size)));
+      if (stop >= turn) {
+        const double wrapped = std::floor((stop - turn) / increment) + 1.0;
+        spans[1].second = static_cast<size_t>(
+          std::clamp(wrapped, 0.0, static_cast<double>(first)));
+      }
+      range_min = std::max(range_min, roi_range_min_);
+      range_max = std::min(range_max, roi_range_max_);
+      closed_scan_ = false;
+    }
+  }
+
+  // Convert the beams in a branchless loop that the compiler can vectorize
+  const float * ranges = scan.ranges.data();
+  const float * cos_table = cos_table_.data();
+  const float * sin_table = sin_table_.data();
+  float * beam_x = beam_x_.data();
+  float * beam_y = beam_y_.data();
+  for (const auto & [first, last] : spans) {
+    for (size_t i = first; i < last; i++) {
+      beam_x[i] = ranges[i] * cos_table[i];
+      beam_y[i] = ranges[i] * sin_table[i];
+    }
+  }
+
+  // Move each beam to the pose of the sensor at the stamp of the scan, i.e. the first beam,
+  // assuming a constant velocity. The rotation during a scan is small, so its cosine and sine
+  // are replaced by their Taylor series
+  const float time_increment = scan.time_increment;
+  if (time_increment > 0.0f &&
+    (velocity_x_ != 0.0f || velocity_y_ != 0.0f || velocity_yaw_ != 0.0f))
+  {
+    for (const auto & [first, last] : spans) {
+      for (size_t i = first; i < last; i++) {
+        const float t = static_cast<float>(i) * time_increment;
+        const float yaw = velocity_yaw_ * t;
+        const float yaw_sq = yaw * yaw;
+        const float c = 1.0f - 0.5f * yaw_sq * (1.0f - yaw_sq / 12.0f);
+        const float s = yaw * (1.0f - yaw_sq / 6.0f);
+        const float x = beam_x[i];
+        const float y = beam_y[i];
+        beam_x[i] = c * x - s * y + velocity_x_ * t;
+        beam_y[i] = s * x + c * y + velocity_y_ * t;
+      }
+    }
+  }
+
+  // Keep the beams within the range limits, in the order of the window
+  Pcloud points;
+  points.reserve(spans[0].second - spans[0].first + spans[1].second);
+  for (const auto & [first, last] : spans) {
+    for (size_t i = first; i < last; i++) {
+      if (ranges[i] >= range_min && ranges[i] <= range_max) {
+        points.push_back(pcl::PointXYZ(beam_x[i], beam_y[i], 0.0f));
+      }
     }
-    phi += angle_resolution;
   }
   return points;
 }
 
+void Segmentation::setSensorVelocity(double vx, double vy, double wz)
+{
+  velocity_x_ = static_cast<float>(vx);
+  velocity_y_ = static_cast<float>(vy);
+  velocity_yaw_ = static_cast<float>(wz);
+}
+
+void Segmentation::setRegionOfInterest(
+  double angle_min, double angle_max, double range_min, double range_max)
+{
+  roi_enabled_ = true;
+  roi_angle_min_ = angle_min;
+  roi_angle_max_ = angle_max;
+  roi_range_min_ = static_cast<float>(range_min);
+  roi_range_max_ = static_cast<float>(range_max);
+}
+
+void Segmentation::clearRegionOfInterest()
+{
+  roi_enabled_ = false;
+}
+
 double Segmentation::euclideanDistance(
   const geometry_msgs::msg::Point & p1, const geometry_msgs::msg::Point & p2)
 {
-  return sqrt(pow(p1.x - p2.x, 2) + pow(p1.y - p2.y, 2));
+  return std::hypot(p1.x - p2.x, p1.y - p2.y);
 }
 
 bool Segmentation::isJumpBetweenPoints(
-  const geometry_msgs::msg::Point & p1, const geometry_msgs::msg::Point & p2, double threshold)
+  const pcl::PointXYZ & p1, const pcl::PointXYZ & p2, double threshold)
 {
-  return euclideanDistance(p1, p2) > threshold;
+  const float dx = p1.x - p2.x;
+  const float dy = p1.y - p2.y;
+  return dx * dx + dy * dy > static_cast<float>(threshold * threshold);
 }
 
 rcl_interfaces::msg::SetParametersResult
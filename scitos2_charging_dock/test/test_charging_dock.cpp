@@ -14,6 +14,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>
+#include <thread>
+
 #include "gtest/gtest.h"
 #include "nav2_util/node_utils.hpp"
 #include "rclcpp/rclcpp.hpp"
@@ -198,6 +201,95 @@ TEST(ScitosChargingDock, refinedPoseTest)
   dock.reset();
 }
 
+TEST(ScitosChargingDock, refinedPoseBackgroundTest)
+{
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("test");
+  auto pub = node->create_publisher<sensor_msgs::msg::LaserScan>("scan", 1);
+  pub->on_activate();
+  auto dock = std::make_unique<scitos2_charging_dock::ChargingDock>();
+
+  // Create the TF
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+
+  // Update parameters to read the test dock template and process the scans in the background
+  std::string pkg = ament_index_cpp::get_package_share_directory("scitos2_charging_dock");
+  std::string path = pkg + "/test/dock_test.pcd";
+  nav2_util::declare_parameter_if_not_declared(
+    node, "my_dock.background_perception", rclcpp::ParameterValue(true));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "my_dock.external_detection_timeout", rclcpp::ParameterValue(0.5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "my_dock.perception.dock_template", rclcpp::ParameterValue(path));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "my_dock.segmentation.distance_threshold", rclcpp::ParameterValue(0.5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "my_dock.segmentation.min_points", rclcpp::ParameterValue(0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "my_dock.segmentation.min_width", rclcpp::ParameterValue(0.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "my_dock.segmentation.min_distance", rclcpp::ParameterValue(0.0));
+
+  dock->configure(node, "my_dock", tf_buffer);
+  dock->activate();
+
+  // There is no detection yet
+  geometry_msgs::msg::PoseStamped pose;
+  pose.header.frame_id = "my_frame";
+  EXPECT_FALSE(dock->getRefinedPose(pose, ""));
+
+  // Set the staging pose in the perception module
+  geometry_msgs::msg::Pose pose_stmp;
+  dock->getStagingPose(pose_stmp, "my_frame");
+
+  // Publish a scan that matches the test dock template
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.stamp = node->now();
+  scan.header.frame_id = "my_frame";
+  scan.angle_min = -std::atan2(0.1, 0.9);
+  scan.angle_max = std::atan2(0.1, 0.9);
+  scan.angle_increment = std::atan2(0.1, 0.9);
+  scan.ranges = {0.9055, 1.0, 0.9055};
+  scan.range_min = 0.9055;
+  scan.range_max = 1.0;
+  pub->publish(scan);
+  rclcpp::spin_some(node->get_node_base_interface());
+
+  // The pose is refined as soon as the perception thread has processed the scan
+  bool refined = false;
+  for (int i = 0; i < 100 && !refined; i++) {
+    refined = dock->getRefinedPose(pose, "");
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(refined);
+
+  // A new staging pose discards the previous detection
+  dock->getStagingPose(pose_stmp, "my_frame");
+  EXPECT_FALSE(dock->getRefinedPose(pose, ""));
+
+  // The scans are not processed once the docking stops asking for the dock pose
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+  scan.header.stamp = node->now();
+  pub->publish(scan);
+  rclcpp::spin_some(node->get_node_base_interface());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_FALSE(dock->getRefinedPose(pose, ""));
+
+  // Asking again resumes the processing with the next scan
+  scan.header.stamp = node->now();
+  pub->publish(scan);
+  rclcpp::spin_some(node->get_node_base_interface());
+  refined = false;
+  for (int i = 0; i < 100 && !refined; i++) {
+    refined = dock->getRefinedPose(pose, "");
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(refined);
+
+  dock->deactivate();
+  dock->cleanup();
+  dock.reset();
+}
+
 int main(int argc, char ** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -105,6 +105,120 @@ TEST(ScitosDockingCluster, valid) {
   EXPECT_FALSE(cluster.valid(10.0));
 }
 
+TEST(ScitosDockingCluster, scanRange) {
+  auto scan_points = std::make_shared<scitos2_charging_dock::Pcloud>();
+  scan_points->header.frame_id = "laser";
+  for (int i = 0; i < 6; i++) {
+    scan_points->push_back(pcl::PointXYZ(i, 2.0 * i, 0.0));
+  }
+
+  // The cluster is a range of the points of the scan
+  scitos2_charging_dock::Cluster cluster;
+  cluster.assign(scan_points, 2, 5);
+  EXPECT_EQ(cluster.size(), 3);
+  EXPECT_TRUE(cluster.cloud.empty());
+  EXPECT_EQ(cluster.header().frame_id, "laser");
+  EXPECT_EQ(cluster.data()[0].x, 2.0);
+  EXPECT_DOUBLE_EQ(cluster.centroid().x, 3.0);
+  EXPECT_DOUBLE_EQ(cluster.centroid().y, 6.0);
+  EXPECT_DOUBLE_EQ(cluster.width(), std::hypot(2.0, 4.0));
+
+  // Copies of the cluster share the points
+  auto copy = cluster;
+  EXPECT_EQ(copy.data(), cluster.data());
+
+  // Materializing copies the range into its own pointcloud
+  cluster.materialize();
+  EXPECT_EQ(cluster.scan_points, nullptr);
+  EXPECT_EQ(cluster.size(), 3);
+  EXPECT_EQ(cluster.cloud.size(), 3u);
+  EXPECT_EQ(cluster.cloud.header.frame_id, "laser");
+  EXPECT_EQ(cluster.cloud.points[2].x, 4.0);
+  EXPECT_DOUBLE_EQ(cluster.centroid().x, 3.0);
+
+  // Pushing a point into a range materializes it first
+  geometry_msgs::msg::Point point;
+  point.x = 10.0;
+  copy.push_back(point);
+  EXPECT_EQ(copy.size(), 4);
+  EXPECT_EQ(copy.cloud.points[0].x, 2.0);
+  EXPECT_EQ(copy.cloud.points[3].x, 10.0);
+  EXPECT_EQ(scan_points->size(), 6u);
+
+  copy.clear();
+  EXPECT_EQ(copy.size(), 0);
+
+  // The range can be moved while it is copied
+  copy.assign(scan_points, 1, 3);
+  Eigen::Affine3f transform(Eigen::Translation3f(1.0, 0.0, 0.0));
+  copy.materialize(transform);
+  EXPECT_EQ(copy.scan_points, nullptr);
+  EXPECT_EQ(copy.size(), 2);
+  EXPECT_EQ(copy.cloud.header.frame_id, "laser");
+  EXPECT_FLOAT_EQ(copy.cloud.points[0].x, 2.0);
+  EXPECT_FLOAT_EQ(copy.cloud.points[1].y, 4.0);
+  EXPECT_DOUBLE_EQ(copy.centroid().x, 2.5);
+
+  // And the points it owns are moved in place
+  copy.materialize(transform);
+  EXPECT_FLOAT_EQ(copy.cloud.points[0].x, 3.0);
+  EXPECT_DOUBLE_EQ(copy.centroid().x, 3.5);
+}
+
+TEST(ScitosDockingCluster, statistics) {
+  scitos2_charging_dock::Cluster cluster;
+  EXPECT_EQ(cluster.statistics().count, 0u);
+
+  // The statistics are accumulated as the points are pushed
+  geometry_msgs::msg::Point point;
+  point.x = 1.0;
+  point.y = -2.0;
+  cluster.push_back(point);
+  point.x = 3.0;
+  point.y = 4.0;
+  cluster.push_back(point);
+  auto stats = cluster.statistics();
+  EXPECT_EQ(stats.count, 2u);
+  EXPECT_DOUBLE_EQ(stats.sum_x, 4.0);
+  EXPECT_DOUBLE_EQ(stats.sum_y, 2.0);
+  EXPECT_FLOAT_EQ(stats.min_x, 1.0);
+  EXPECT_FLOAT_EQ(stats.max_x, 3.0);
+  EXPECT_FLOAT_EQ(stats.min_y, -2.0);
+  EXPECT_FLOAT_EQ(stats.max_y, 4.0);
+  EXPECT_FLOAT_EQ(stats.first.x, 1.0);
+  EXPECT_FLOAT_EQ(stats.last.y, 4.0);
+  EXPECT_DOUBLE_EQ(cluster.width_squared(), 40.0);
+
+  // Points pushed to the pointcloud directly are taken into account
+  cluster.cloud.push_back(pcl::PointXYZ(5.0, 7.0, 0.0));
+  EXPECT_EQ(cluster.statistics().count, 3u);
+  EXPECT_DOUBLE_EQ(cluster.centroid().x, 3.0);
+  EXPECT_DOUBLE_EQ(cluster.centroid().y, 3.0);
+
+  // And so are the points moved in place, keeping their number
+  for (auto & p : cluster.cloud.points) {
+    p.x += 1.0;
+  }
+  EXPECT_DOUBLE_EQ(cluster.centroid().x, 4.0);
+  EXPECT_DOUBLE_EQ(cluster.width(), std::hypot(4.0, 9.0));
+
+  // The statistics accumulated by the segmentation are used as they are
+  auto scan_points = std::make_shared<scitos2_charging_dock::Pcloud>();
+  scitos2_charging_dock::ClusterStatistics accumulated;
+  for (int i = 0; i < 4; i++) {
+    scan_points->push_back(pcl::PointXYZ(i, 0.0, 0.0));
+    accumulated.add(scan_points->back());
+  }
+  cluster.assign(scan_points, 0, 4, accumulated);
+  EXPECT_EQ(cluster.statistics().count, 4u);
+  EXPECT_DOUBLE_EQ(cluster.centroid().x, 1.5);
+  EXPECT_DOUBLE_EQ(cluster.width(), 3.0);
+
+  cluster.clear();
+  EXPECT_EQ(cluster.statistics().count, 0u);
+  EXPECT_DOUBLE_EQ(cluster.width(), 0.0);
+}
+
 TEST(ScitosDockingCluster, operators) {
   scitos2_charging_dock::Cluster cluster1;
   cluster1.score = 1.0;
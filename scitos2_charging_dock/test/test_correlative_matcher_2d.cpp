@@ -0,0 +1,157 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "scitos2_charging_dock/correlative_matcher_2d.hpp"
+
+using scitos2_charging_dock::CorrelativeGrid2D;
+using scitos2_charging_dock::CorrelativeMatcher2D;
+using scitos2_charging_dock::Pcloud;
+
+class CorrelativeMatcher2DFixture : public CorrelativeMatcher2D
+{
+public:
+  // Best score of all the transforms of the window at the finest level
+  float bruteForceScore()
+  {
+    float best = 0.0f;
+    for (size_t r = 0; r < rotated_cells_.size(); r++) {
+      for (int x = -linear_steps_; x <= linear_steps_; x++) {
+        for (int y = -linear_steps_; y <= linear_steps_; y++) {
+          Candidate candidate{static_cast<int>(r), x, y, 0, 0.0f};
+          scoreCandidate(candidate);
+          best = std::max(best, candidate.score);
+        }
+      }
+    }
+    return best;
+  }
+};
+
+// A V-shaped profile similar to the docking station, 1 meter in front of the sensor
+Pcloud createTemplate()
+{
+  Pcloud cloud;
+  cloud.header.frame_id = "test_link";
+  for (int i = -20; i <= 20; i++) {
+    float y = 0.01f * i;
+    cloud.push_back(pcl::PointXYZ(1.0f + 0.5f * std::abs(y), y, 0.0f));
+  }
+  return cloud;
+}
+
+Pcloud transformCloud(const Pcloud & cloud, float x, float y, float yaw)
+{
+  Pcloud transformed;
+  for (const auto & point : cloud) {
+    transformed.push_back(
+      pcl::PointXYZ(
+        std::cos(yaw) * point.x - std::sin(yaw) * point.y + x,
+        std::sin(yaw) * point.x + std::cos(yaw) * point.y + y, 0.0f));
+  }
+  return transformed;
+}
+
+TEST(ScitosDockingCorrelativeMatcher2D, grid) {
+  auto cloud = createTemplate();
+  CorrelativeGrid2D grid(cloud, 0.02f, 4);
+  EXPECT_FALSE(grid.empty());
+  EXPECT_EQ(grid.levels(), 4);
+  EXPECT_FLOAT_EQ(grid.resolution(), 0.02f);
+
+  // The points of the cloud are likely and the space far from them is not
+  auto cell = grid.cell(Eigen::Vector2f(cloud[20].x, cloud[20].y));
+  EXPECT_GT(grid.value(0, cell.x(), cell.y()), 0.5f);
+  EXPECT_FLOAT_EQ(grid.value(0, cell.x() + 100, cell.y()), 0.0f);
+
+  // Each level bounds the finest cells of its blocks
+  for (int level = 1; level < grid.levels(); level++) {
+    const int block = 1 << level;
+    for (int ix = -block; ix < 30; ix++) {
+      for (int iy = -block; iy < 30; iy++) {
+        float maximum = 0.0f;
+        for (int dx = 0; dx < block; dx++) {
+          for (int dy = 0; dy < block; dy++) {
+            maximum = std::max(maximum, grid.value(0, ix + dx, iy + dy));
+          }
+        }
+        EXPECT_FLOAT_EQ(grid.value(level, ix, iy), maximum);
+      }
+    }
+  }
+
+  // Empty cloud
+  CorrelativeGrid2D empty_grid(Pcloud(), 0.02f);
+  EXPECT_TRUE(empty_grid.empty());
+}
+
+TEST(ScitosDockingCorrelativeMatcher2D, recoverTransformation) {
+  auto target = createTemplate();
+  auto grid = std::make_shared<const CorrelativeGrid2D>(target, 0.02f);
+
+  // The source is far beyond the reach of the iterative matchers
+  auto source = transformCloud(target, -0.3f, 0.2f, 0.15f);
+
+  CorrelativeMatcher2DFixture matcher;
+  matcher.setLinearWindow(0.5);
+  matcher.setAngularWindow(0.35);
+  matcher.setMinScore(0.3);
+  matcher.setSearchGridTarget(grid);
+  ASSERT_TRUE(matcher.match(source));
+
+  // The transform moves the source close to the target
+  auto transformation = matcher.getFinalTransformation();
+  double error = 0.0;
+  for (size_t i = 0; i < source.size(); i++) {
+    Eigen::Vector4f point(source[i].x, source[i].y, 0.0f, 1.0f);
+    Eigen::Vector4f moved = transformation * point;
+    error += std::hypot(moved.x() - target[i].x, moved.y() - target[i].y);
+  }
+  EXPECT_LT(error / source.size(), 0.03);
+  EXPECT_GT(matcher.getScore(), 0.5);
+
+  // And it is the optimum of the brute force search
+  EXPECT_NEAR(matcher.getScore(), matcher.bruteForceScore(), 1e-5);
+}
+
+TEST(ScitosDockingCorrelativeMatcher2D, outsideWindow) {
+  auto target = createTemplate();
+  auto grid = std::make_shared<const CorrelativeGrid2D>(target, 0.02f);
+
+  // The source is outside the translation window
+  CorrelativeMatcher2D matcher;
+  matcher.setLinearWindow(0.2);
+  matcher.setMinScore(0.5);
+  matcher.setSearchGridTarget(grid);
+  EXPECT_FALSE(matcher.match(transformCloud(target, 1.0f, 1.0f, 0.0f)));
+  EXPECT_DOUBLE_EQ(matcher.getScore(), 0.0);
+  EXPECT_TRUE(matcher.getFinalTransformation().isApprox(Eigen::Matrix4f::Identity()));
+
+  // Empty source or target
+  EXPECT_FALSE(matcher.match(Pcloud()));
+  matcher.setSearchGridTarget(nullptr);
+  EXPECT_FALSE(matcher.match(target));
+}
+
+int main(int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  bool success = RUN_ALL_TESTS();
+  return success;
+}
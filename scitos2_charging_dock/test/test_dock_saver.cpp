@@ -13,6 +13,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include <random>
+
 #include "gtest/gtest.h"
 #include "nav2_util/node_utils.hpp"
 #include "rclcpp/rclcpp.hpp"
@@ -47,6 +52,43 @@ protected:
   rclcpp::TimerBase::SharedPtr timer_;
 };
 
+// Publishes the scan of a V-shaped dock 1 meter in front of the sensor, with noise
+class DockPublisher : public rclcpp::Node
+{
+public:
+  DockPublisher()
+  : Node("dock_publisher")
+  {
+    scan_pub_ = create_publisher<sensor_msgs::msg::LaserScan>("scan", rclcpp::SensorDataQoS());
+    timer_ = this->create_wall_timer(
+      std::chrono::milliseconds(10), [this]() {
+        sensor_msgs::msg::LaserScan msg;
+        msg.header.stamp = now();
+        msg.header.frame_id = "my_frame";
+        msg.angle_min = -0.3;
+        msg.angle_increment = 0.005;
+        msg.range_min = 0.1;
+        msg.range_max = 10.0;
+        for (double angle = msg.angle_min; angle <= 0.3; angle += msg.angle_increment) {
+          const double range = 1.0 / (std::cos(angle) - 0.5 * std::abs(std::sin(angle)));
+          if (std::abs(range * std::sin(angle)) <= 0.2) {
+            msg.ranges.push_back(static_cast<float>(range + noise_(generator_)));
+          } else {
+            msg.ranges.push_back(std::numeric_limits<float>::infinity());
+          }
+        }
+        msg.angle_max = msg.angle_min + (msg.ranges.size() - 1) * msg.angle_increment;
+        scan_pub_->publish(msg);
+      });
+  }
+
+protected:
+  rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr scan_pub_;
+  rclcpp::TimerBase::SharedPtr timer_;
+  std::mt19937 generator_{42};
+  std::normal_distribution<double> noise_{0.0, 0.003};
+};
+
 TEST(ScitosDockingSaver, saveDockEmpty) {
   rclcpp::init(0, nullptr);
   // Create the node
@@ -141,7 +183,76 @@ TEST(ScitosDockingSaver, saveDock) {
   // Check the response
   EXPECT_TRUE(resp->result);
 
+  // A second request reuses the subscription and the scans buffered by the first one
+  result = client->async_send_request(req);
+  ASSERT_EQ(
+    rclcpp::spin_until_future_complete(node, result, std::chrono::milliseconds(500)),
+    rclcpp::FutureReturnCode::SUCCESS);
+  EXPECT_TRUE(result.get()->result);
+
+  // Cleaning up
+  node->deactivate();
+  node->cleanup();
+  node->shutdown();
+  rclcpp::shutdown();
+  pub_thread.join();
+}
+
+TEST(ScitosDockingSaver, saveDockMultipleScans) {
+  rclcpp::init(0, nullptr);
+  // Create the node
+  auto node = std::make_shared<scitos2_charging_dock::DockSaver>();
+  node->set_parameter(rclcpp::Parameter("capture_scans", 5));
+  node->set_parameter(rclcpp::Parameter("capture_resolution", 0.005));
+
+  // Declare parameters for segmentation
+  nav2_util::declare_parameter_if_not_declared(
+    node, "dock_saver.segmentation.min_points", rclcpp::ParameterValue(10));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "dock_saver.segmentation.distance_threshold", rclcpp::ParameterValue(0.04));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "dock_saver.segmentation.min_width", rclcpp::ParameterValue(0.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "dock_saver.segmentation.min_distance", rclcpp::ParameterValue(0.0));
+
+  node->configure();
+  node->activate();
+
+  // Create the scan publisher node
+  auto pub_node = std::make_shared<DockPublisher>();
+  auto pub_thread = std::thread([&]() {rclcpp::spin(pub_node);});
+
+  // Create the client service
+  auto req = std::make_shared<scitos2_msgs::srv::SaveDock::Request>();
+  auto path = std::filesystem::temp_directory_path() / "saved_dock_test.pcd";
+  req->dock_url = path.string();
+  auto client = node->create_client<scitos2_msgs::srv::SaveDock>("/dock_saver/save_dock");
+
+  // Wait for the service to be available
+  ASSERT_TRUE(client->wait_for_service());
+
+  // Call the service
+  auto result = client->async_send_request(req);
+  // Wait for the result
+  auto resp = std::make_shared<scitos2_msgs::srv::SaveDock::Response>();
+  if (rclcpp::spin_until_future_complete(node, result) == rclcpp::FutureReturnCode::SUCCESS) {
+    RCLCPP_INFO(node->get_logger(), "Service call successful");
+    resp = result.get();
+  } else {
+    RCLCPP_ERROR(node->get_logger(), "Service call failed");
+  }
+
+  // The scans are fused into a dense template close to all of them
+  EXPECT_TRUE(resp->result);
+  EXPECT_GT(resp->point_count, 80u);
+  EXPECT_GT(resp->mean_residual, 0.0);
+  EXPECT_LT(resp->mean_residual, 0.005);
+  EXPECT_LT(resp->max_residual, 0.02);
+  EXPECT_TRUE(std::filesystem::exists(path));
+
   // Cleaning up
+  std::filesystem::remove(path);
+  std::filesystem::remove(scitos2_charging_dock::DockTemplateFile::path(path.string()));
   node->deactivate();
   node->cleanup();
   node->shutdown();
@@ -0,0 +1,145 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "scitos2_charging_dock/dock_template_file.hpp"
+
+using scitos2_charging_dock::DockTemplate;
+using scitos2_charging_dock::DockTemplateFile;
+using scitos2_charging_dock::Pcloud;
+
+// A V-shaped profile similar to the docking station
+Pcloud createTemplate()
+{
+  Pcloud cloud;
+  for (int i = -20; i <= 20; i++) {
+    float y = 0.01f * i;
+    cloud.push_back(pcl::PointXYZ(0.5f * std::abs(y), y, 0.0f));
+  }
+  return cloud;
+}
+
+std::string temporaryPath(const std::string & name)
+{
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+TEST(ScitosDockTemplateFile, path) {
+  EXPECT_EQ(DockTemplateFile::path("/tmp/dock.pcd"), "/tmp/dock.sdt");
+  EXPECT_EQ(DockTemplateFile::path("/tmp/dock"), "/tmp/dock.sdt");
+}
+
+TEST(ScitosDockTemplateFile, writeAndRead) {
+  const std::string path = temporaryPath("test_dock_template.sdt");
+  DockTemplate dock_template(createTemplate(), 0.25, 3);
+  ASSERT_TRUE(DockTemplateFile::write(path, dock_template));
+
+  DockTemplate loaded;
+  ASSERT_TRUE(DockTemplateFile::read(path, 0.25, 3, loaded));
+
+  // Shape and extent of the dock
+  EXPECT_EQ(loaded.correspondence_distance, dock_template.correspondence_distance);
+  EXPECT_EQ(loaded.requested_levels, dock_template.requested_levels);
+  EXPECT_EQ(loaded.descriptor.major_extent, dock_template.descriptor.major_extent);
+  EXPECT_EQ(loaded.descriptor.minor_extent, dock_template.descriptor.minor_extent);
+  EXPECT_EQ(loaded.descriptor.turning_function, dock_template.descriptor.turning_function);
+  EXPECT_EQ(loaded.center.x, dock_template.center.x);
+  EXPECT_EQ(loaded.center.y, dock_template.center.y);
+  EXPECT_EQ(loaded.radius, dock_template.radius);
+  EXPECT_DOUBLE_EQ(loaded.width(), dock_template.width());
+
+  // Levels of the pyramid with their search structures
+  ASSERT_EQ(loaded.levels.size(), dock_template.levels.size());
+  EXPECT_EQ(loaded.cloud, loaded.levels.front().cloud);
+  for (size_t l = 0; l < loaded.levels.size(); l++) {
+    const auto & expected = dock_template.levels[l];
+    const auto & level = loaded.levels[l];
+    EXPECT_EQ(level.spacing, expected.spacing);
+    ASSERT_EQ(level.cloud->size(), expected.cloud->size());
+    for (size_t i = 0; i < level.cloud->size(); i++) {
+      EXPECT_EQ((*level.cloud)[i].x, (*expected.cloud)[i].x);
+      EXPECT_EQ((*level.cloud)[i].y, (*expected.cloud)[i].y);
+    }
+    EXPECT_EQ(level.grid->origin(), expected.grid->origin());
+    EXPECT_EQ(level.grid->resolution(), expected.grid->resolution());
+    EXPECT_EQ(level.grid->width(), expected.grid->width());
+    EXPECT_EQ(level.grid->height(), expected.grid->height());
+    EXPECT_EQ(level.grid->cells(), expected.grid->cells());
+    EXPECT_NE(level.tree, nullptr);
+  }
+
+  // Likelihood field of the correlative search
+  ASSERT_NE(loaded.likelihood, nullptr);
+  EXPECT_EQ(loaded.likelihood->origin(), dock_template.likelihood->origin());
+  ASSERT_EQ(loaded.likelihood->levels(), dock_template.likelihood->levels());
+  for (int l = 0; l < loaded.likelihood->levels(); l++) {
+    EXPECT_EQ(loaded.likelihood->levelValues(l), dock_template.likelihood->levelValues(l));
+  }
+
+  // The restored grids answer the same queries
+  float expected_distance, distance;
+  const Eigen::Vector2f query(0.05f, 0.03f);
+  const auto expected_nearest = dock_template.grid->nearest(query, expected_distance);
+  EXPECT_EQ(loaded.grid->nearest(query, distance), expected_nearest);
+  EXPECT_EQ(distance, expected_distance);
+
+  std::remove(path.c_str());
+}
+
+TEST(ScitosDockTemplateFile, rejectInvalidFiles) {
+  const std::string path = temporaryPath("test_dock_template_invalid.sdt");
+  DockTemplate loaded;
+
+  // A file that does not exist
+  EXPECT_FALSE(DockTemplateFile::read(path, 0.25, 3, loaded));
+
+  // An empty template is not written
+  EXPECT_FALSE(DockTemplateFile::write(path, DockTemplate()));
+
+  // A file built with other parameters
+  DockTemplate dock_template(createTemplate(), 0.25, 3);
+  ASSERT_TRUE(DockTemplateFile::write(path, dock_template));
+  EXPECT_FALSE(DockTemplateFile::read(path, 0.3, 3, loaded));
+  EXPECT_FALSE(DockTemplateFile::read(path, 0.25, 1, loaded));
+  EXPECT_TRUE(loaded.empty());
+
+  // A truncated file
+  const auto size = std::filesystem::file_size(path);
+  std::filesystem::resize_file(path, size / 2);
+  EXPECT_FALSE(DockTemplateFile::read(path, 0.25, 3, loaded));
+  EXPECT_TRUE(loaded.empty());
+
+  // A file of another format
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "# .PCD v0.7 - Point Cloud Data file format";
+  }
+  EXPECT_FALSE(DockTemplateFile::read(path, 0.25, 3, loaded));
+  EXPECT_TRUE(loaded.empty());
+
+  std::remove(path.c_str());
+}
+
+int main(int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -13,9 +13,23 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "ament_index_cpp/get_package_share_directory.hpp"
 #include "nav2_util/node_utils.hpp"
+#include "pcl_conversions/pcl_conversions.h"
 #include "rclcpp/rclcpp.hpp"
 #include "tf2/LinearMath/Transform.h"
 #include "scitos2_charging_dock/perception.hpp"
@@ -35,6 +49,16 @@ public:
     return scitos2_charging_dock::Perception::loadDockPointcloud(filepath, dock);
   }
 
+  bool loadDockTemplate(std::string filepath)
+  {
+    return scitos2_charging_dock::Perception::loadDockTemplate(filepath);
+  }
+
+  const scitos2_charging_dock::DockTemplate & getDockTemplate()
+  {
+    return dock_template_;
+  }
+
   sensor_msgs::msg::PointCloud2 createPointCloud2Msg(const scitos2_charging_dock::Pcloud & cloud)
   {
     return scitos2_charging_dock::Perception::createPointCloud2Msg(cloud);
@@ -48,22 +72,56 @@ public:
   bool refineClusterPose(
     scitos2_charging_dock::Cluster & cluster, const scitos2_charging_dock::Pcloud & cloud_template)
   {
-    return scitos2_charging_dock::Perception::refineClusterPose(cluster, cloud_template);
+    const auto params = getParameters();
+    const scitos2_charging_dock::DockTemplate dock_template(
+      cloud_template, params.icp_max_corr_dis, template_levels_);
+    return scitos2_charging_dock::Perception::refineClusterPose(cluster, dock_template, params);
   }
 
   bool refineAllClustersPoses(
     scitos2_charging_dock::Clusters & clusters,
-    const scitos2_charging_dock::Cluster dock_template,
+    const scitos2_charging_dock::DockTemplate & dock_template,
     scitos2_charging_dock::Cluster & dock)
   {
-    return scitos2_charging_dock::Perception::refineAllClustersPoses(clusters, dock_template, dock);
+    return scitos2_charging_dock::Perception::refineAllClustersPoses(
+      clusters, dock_template, getParameters(), dock);
+  }
+
+  size_t segmentedPoints(const sensor_msgs::msg::LaserScan & scan)
+  {
+    updateRegionOfInterest(scan, getParameters());
+    scitos2_charging_dock::Clusters clusters;
+    segmentation_->performSegmentation(scan, clusters);
+    size_t points = 0;
+    for (const auto & cluster : clusters) {
+      points += cluster.size();
+    }
+    return points;
   }
 
+  void setRoiMisses(int misses) {roi_misses_ = misses;}
+
+  int getIterationCap()
+  {
+    return scitos2_charging_dock::Perception::getIterationCap(getParameters());
+  }
+
+  std::string getMatcher() {return getParameters().matcher;}
+
+  const scitos2_charging_dock::DockTemplate & getDockTemplate() {return dock_template_;}
+
+  bool getTrackingActive() {return tracking_active_;}
+
   bool getDockFound() {return dock_found_;}
 
+  size_t getShapeChecked() {return shape_checked_;}
+
+  size_t getShapeRejected() {return shape_rejected_;}
+
   void setUseFirstDetection(bool use_first_detection)
   {
-    use_first_detection_ = use_first_detection;
+    std::lock_guard<std::mutex> lock(dynamic_params_lock_);
+    params_.use_first_detection = use_first_detection;
   }
 };
 
@@ -75,6 +133,50 @@ geometry_msgs::msg::Point create_point(double x, double y)
   return point;
 }
 
+// A V-shaped dock template
+scitos2_charging_dock::Pcloud create_dock_template()
+{
+  scitos2_charging_dock::Pcloud cloud;
+  cloud.header.frame_id = "test_link";
+  for (int i = -20; i <= 20; i++) {
+    float y = 0.01f * i;
+    cloud.push_back(pcl::PointXYZ(0.5f * std::abs(y), y, 0.0f));
+  }
+  return cloud;
+}
+
+// A scan of a cluttered room: the dock and walls, boxes and furniture of similar width
+// around the expected pose of the dock
+scitos2_charging_dock::Clusters create_cluttered_clusters(
+  const scitos2_charging_dock::Pcloud & dock, int num_clutter)
+{
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<float> offset(-0.15f, 0.15f);
+  std::uniform_real_distribution<float> angle(-0.6f, 0.6f);
+  std::normal_distribution<float> noise(0.0f, 0.003f);
+
+  scitos2_charging_dock::Clusters clusters;
+  for (int c = 0; c <= num_clutter; c++) {
+    scitos2_charging_dock::Cluster cluster;
+    cluster.id = c;
+    cluster.cloud.header.frame_id = "test_link";
+    float x = c == 0 ? 0.02f : offset(generator);
+    float y = c == 0 ? -0.01f : offset(generator);
+    float yaw = c == 0 ? 0.05f : angle(generator);
+    for (int i = -20; i <= 20; i++) {
+      // The first cluster is the dock, the rest are flat or curved segments
+      float py = 0.01f * i;
+      float px = c == 0 ? dock[i + 20].x : (c % 2) * 0.0005f * i * i;
+      cluster.cloud.push_back(
+        pcl::PointXYZ(
+          std::cos(yaw) * px - std::sin(yaw) * py + x + noise(generator),
+          std::sin(yaw) * px + std::cos(yaw) * py + y + noise(generator), 0.0f));
+    }
+    clusters.push_back(cluster);
+  }
+  return clusters;
+}
+
 TEST(ScitosDockingPerception, configure) {
   // Create a node
   auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
@@ -103,24 +205,74 @@ TEST(ScitosDockingPerception, dynamicParameters) {
   // Set the parameters
   auto results = params->set_parameters_atomically(
     {rclcpp::Parameter("test.perception.icp_max_iter", 5),
+      rclcpp::Parameter("test.perception.coarse_max_iter", 2),
+      rclcpp::Parameter("test.perception.tracking_min_iter", 3),
       rclcpp::Parameter("test.perception.icp_min_score", 0.5),
       rclcpp::Parameter("test.perception.icp_max_corr_dis", 0.5),
       rclcpp::Parameter("test.perception.icp_max_trans_eps", 0.5),
       rclcpp::Parameter("test.perception.icp_max_eucl_fit_eps", 0.5),
       rclcpp::Parameter("test.perception.enable_debug", false),
-      rclcpp::Parameter("test.perception.use_first_detection", true)});
+      rclcpp::Parameter("test.perception.use_first_detection", true),
+      rclcpp::Parameter("test.perception.matcher", "se2"),
+      rclcpp::Parameter("test.perception.time_budget", 0.05),
+      rclcpp::Parameter("test.perception.shape_filter", true),
+      rclcpp::Parameter("test.perception.shape_extent_tolerance", 0.1),
+      rclcpp::Parameter("test.perception.shape_max_distance", 0.5),
+      rclcpp::Parameter("test.perception.propagate_detection", true),
+      rclcpp::Parameter("test.perception.propagation_max_age", 1.0),
+      rclcpp::Parameter("test.perception.motion_compensation", true),
+      rclcpp::Parameter("test.perception.region_of_interest", true),
+      rclcpp::Parameter("test.perception.roi_angle_margin", 0.2),
+      rclcpp::Parameter("test.perception.roi_range_margin", 0.5),
+      rclcpp::Parameter("test.perception.tracking", true),
+      rclcpp::Parameter("test.perception.correlative_search", true),
+      rclcpp::Parameter("test.perception.correlative_linear_window", 0.8),
+      rclcpp::Parameter("test.perception.correlative_angular_window", 0.5),
+      rclcpp::Parameter("test.perception.correlative_min_score", 0.4)});
 
   // Spin
   rclcpp::spin_until_future_complete(node->get_node_base_interface(), results);
 
   // Check parameters
   EXPECT_EQ(node->get_parameter("test.perception.icp_max_iter").as_int(), 5);
+  EXPECT_EQ(node->get_parameter("test.perception.coarse_max_iter").as_int(), 2);
+  EXPECT_EQ(node->get_parameter("test.perception.tracking_min_iter").as_int(), 3);
   EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.icp_min_score").as_double(), 0.5);
   EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.icp_max_corr_dis").as_double(), 0.5);
   EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.icp_max_trans_eps").as_double(), 0.5);
   EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.icp_max_eucl_fit_eps").as_double(), 0.5);
   EXPECT_EQ(node->get_parameter("test.perception.enable_debug").as_bool(), false);
   EXPECT_EQ(node->get_parameter("test.perception.use_first_detection").as_bool(), true);
+  EXPECT_EQ(node->get_parameter("test.perception.matcher").as_string(), "se2");
+  EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.time_budget").as_double(), 0.05);
+  EXPECT_EQ(node->get_parameter("test.perception.shape_filter").as_bool(), true);
+  EXPECT_DOUBLE_EQ(
+    node->get_parameter("test.perception.shape_extent_tolerance").as_double(), 0.1);
+  EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.shape_max_distance").as_double(), 0.5);
+  EXPECT_EQ(node->get_parameter("test.perception.propagate_detection").as_bool(), true);
+  EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.propagation_max_age").as_double(), 1.0);
+  EXPECT_EQ(node->get_parameter("test.perception.motion_compensation").as_bool(), true);
+  EXPECT_EQ(node->get_parameter("test.perception.region_of_interest").as_bool(), true);
+  EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.roi_angle_margin").as_double(), 0.2);
+  EXPECT_DOUBLE_EQ(node->get_parameter("test.perception.roi_range_margin").as_double(), 0.5);
+  EXPECT_EQ(node->get_parameter("test.perception.tracking").as_bool(), true);
+  EXPECT_EQ(node->get_parameter("test.perception.correlative_search").as_bool(), true);
+  EXPECT_DOUBLE_EQ(
+    node->get_parameter("test.perception.correlative_linear_window").as_double(), 0.8);
+  EXPECT_DOUBLE_EQ(
+    node->get_parameter("test.perception.correlative_angular_window").as_double(), 0.5);
+  EXPECT_DOUBLE_EQ(
+    node->get_parameter("test.perception.correlative_min_score").as_double(), 0.4);
+  // The matching gets a copy of the new parameters
+  EXPECT_EQ(perception->getMatcher(), "se2");
+  EXPECT_EQ(perception->getIterationCap(), 5);
+
+  // An unknown matcher is rejected
+  results = params->set_parameters_atomically(
+    {rclcpp::Parameter("test.perception.matcher", "unknown")});
+  rclcpp::spin_until_future_complete(node->get_node_base_interface(), results);
+  EXPECT_EQ(node->get_parameter("test.perception.matcher").as_string(), "se2");
+  EXPECT_EQ(perception->getMatcher(), "se2");
 
   // Cleaning up
   node->deactivate();
@@ -173,6 +325,62 @@ TEST(ScitosDockingPerception, storeDockPointcloud) {
   EXPECT_TRUE(success);
 }
 
+TEST(ScitosDockingPerception, precompiledDockTemplate) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+
+  // Storing the dock also precompiles its template
+  auto directory = std::filesystem::temp_directory_path();
+  std::string path = (directory / "precompiled_dock_test.pcd").string();
+  std::string precompiled = (directory / "precompiled_dock_test.sdt").string();
+  auto dock = create_dock_template();
+  ASSERT_TRUE(perception->storeDockPointcloud(path, dock));
+  EXPECT_TRUE(std::filesystem::exists(precompiled));
+
+  // The precompiled template is loaded with its search structures
+  EXPECT_TRUE(perception->loadDockTemplate(path));
+  const auto & dock_template = perception->getDockTemplate();
+  EXPECT_EQ(dock_template.cloud->size(), dock.size());
+  EXPECT_NE(dock_template.grid, nullptr);
+  EXPECT_NE(dock_template.likelihood, nullptr);
+
+  // A PCD file saved after the precompiled template replaces it
+  scitos2_charging_dock::Pcloud other_dock;
+  for (size_t i = 0; i < dock.size(); i += 2) {
+    other_dock.push_back(dock[i]);
+  }
+  std::string other_path = (directory / "precompiled_dock_test_other.pcd").string();
+  ASSERT_TRUE(perception->storeDockPointcloud(other_path, other_dock));
+  std::filesystem::copy_file(
+    other_path, path, std::filesystem::copy_options::overwrite_existing);
+  std::filesystem::last_write_time(
+    precompiled, std::filesystem::last_write_time(path) - std::chrono::seconds(10));
+  EXPECT_TRUE(perception->loadDockTemplate(path));
+  EXPECT_EQ(perception->getDockTemplate().cloud->size(), other_dock.size());
+
+  // But an older PCD file does not
+  std::filesystem::last_write_time(
+    precompiled, std::filesystem::last_write_time(path) + std::chrono::seconds(10));
+  EXPECT_TRUE(perception->loadDockTemplate(path));
+  EXPECT_EQ(perception->getDockTemplate().cloud->size(), dock.size());
+
+  // A corrupt precompiled template falls back to the PCD file
+  {
+    std::ofstream file(precompiled, std::ios::binary | std::ios::trunc);
+    file << "corrupt";
+  }
+  std::filesystem::last_write_time(
+    precompiled, std::filesystem::last_write_time(path) + std::chrono::seconds(10));
+  EXPECT_TRUE(perception->loadDockTemplate(path));
+  EXPECT_EQ(perception->getDockTemplate().cloud->size(), other_dock.size());
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(precompiled);
+  std::filesystem::remove(other_path);
+  std::filesystem::remove(scitos2_charging_dock::DockTemplateFile::path(other_path));
+}
+
 TEST(ScitosDockingPerception, createPointcloudMsg) {
   // Create a node
   auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
@@ -295,6 +503,173 @@ TEST(ScitosDockingPerception, refineClusterToPose) {
   EXPECT_FALSE(success);
 }
 
+TEST(ScitosDockingPerception, refineClusterToPoseSE2) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.matcher", rclcpp::ParameterValue("se2"));
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+
+  // Create a cluster
+  scitos2_charging_dock::Cluster cluster;
+  cluster.cloud.push_back(pcl::PointXYZ(0, 0, 0));
+  cluster.cloud.push_back(pcl::PointXYZ(1, 0, 0));
+  cluster.cloud.push_back(pcl::PointXYZ(1, 1.5, 0));
+  cluster.cloud.push_back(pcl::PointXYZ(1, 2, 0));
+
+  // Create a template
+  scitos2_charging_dock::Pcloud cloud_template;
+  cloud_template.push_back(pcl::PointXYZ(0, 0, 0));
+  cloud_template.push_back(pcl::PointXYZ(1, 0, 0));
+  cloud_template.push_back(pcl::PointXYZ(1, 1.5, 0));
+  cloud_template.push_back(pcl::PointXYZ(1, 2, 0));
+
+  // Set the initial pose
+  geometry_msgs::msg::Pose initial_pose;
+  initial_pose.position.x = 1;
+  initial_pose.position.y = 1;
+
+  // Refine the cluster pose
+  perception->setInitialEstimate(initial_pose, "test_link");
+  bool success = perception->refineClusterPose(cluster, cloud_template);
+
+  // Check if the pose was refined with the same score semantics as the PCL matcher
+  EXPECT_TRUE(success);
+  EXPECT_EQ(cluster.pose.header.frame_id, "test_link");
+  EXPECT_NEAR(cluster.pose.pose.position.x, 1.0, 0.01);
+  EXPECT_NEAR(cluster.pose.pose.position.y, 1.0, 0.01);
+  EXPECT_NEAR(cluster.score, 0.0, 0.01);
+
+  // Now set another cluster different from the template
+  cluster.clear();
+  cluster.cloud.push_back(pcl::PointXYZ(40, 50, 7));
+  cluster.cloud.push_back(pcl::PointXYZ(10, 30, 0));
+  cluster.cloud.push_back(pcl::PointXYZ(10, 1.5, 0));
+  cluster.cloud.push_back(pcl::PointXYZ(10, 90, 0));
+
+  // Refine the cluster pose
+  perception->setInitialEstimate(initial_pose, "test_link");
+  success = perception->refineClusterPose(cluster, cloud_template);
+
+  // Check if the pose was refined
+  EXPECT_FALSE(success);
+}
+
+TEST(ScitosDockingPerception, correlativeSearch) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.matcher", rclcpp::ParameterValue("se2"));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.correlative_search", rclcpp::ParameterValue(true));
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+
+  // The dock is further from the initial estimate than the correspondence distance
+  auto cloud_template = create_dock_template();
+  const float x = 0.35f, y = -0.3f, yaw = 0.2f;
+  scitos2_charging_dock::Cluster cluster;
+  for (const auto & point : cloud_template) {
+    cluster.cloud.push_back(
+      pcl::PointXYZ(
+        std::cos(yaw) * point.x - std::sin(yaw) * point.y + x,
+        std::sin(yaw) * point.x + std::cos(yaw) * point.y + y, 0.0f));
+  }
+
+  // Refine the cluster pose
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+  bool success = perception->refineClusterPose(cluster, cloud_template);
+
+  // The correlative search brings the cluster within reach of the matcher
+  EXPECT_TRUE(success);
+  EXPECT_NEAR(cluster.pose.pose.position.x, x, 0.01);
+  EXPECT_NEAR(cluster.pose.pose.position.y, y, 0.01);
+  EXPECT_NEAR(cluster.score, 0.0, 1e-4);
+}
+
+TEST(ScitosDockingPerception, templatePyramid) {
+  // Each level of the pyramid doubles the spacing of the previous one
+  auto cloud_template = create_dock_template();
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25, 3);
+  ASSERT_EQ(dock_template.levels.size(), 3u);
+  EXPECT_EQ(dock_template.levels[0].cloud, dock_template.cloud);
+  EXPECT_EQ(dock_template.levels[1].cloud->size(), 21u);
+  EXPECT_EQ(dock_template.levels[2].cloud->size(), 11u);
+  for (size_t level = 1; level < dock_template.levels.size(); level++) {
+    const auto & points = *dock_template.levels[level].cloud;
+    EXPECT_NEAR(
+      dock_template.levels[level].spacing, 2.0 * dock_template.levels[level - 1].spacing, 1e-9);
+    EXPECT_NEAR(
+      scitos2_charging_dock::DockTemplate::spacing(points),
+      dock_template.levels[level].spacing, 1e-3);
+    // The ends of the dock are kept
+    EXPECT_FLOAT_EQ(points.front().y, cloud_template.front().y);
+    EXPECT_FLOAT_EQ(points.back().y, cloud_template.back().y);
+    EXPECT_NE(dock_template.levels[level].grid, nullptr);
+  }
+
+  // Dense clusters use the finest level and sparse clusters the coarser ones
+  EXPECT_EQ(dock_template.selectLevel(0.005), 0u);
+  EXPECT_EQ(dock_template.selectLevel(0.03), 1u);
+  EXPECT_EQ(dock_template.selectLevel(1.0), 2u);
+
+  // A template of a single level
+  scitos2_charging_dock::DockTemplate single_level(cloud_template, 0.25);
+  EXPECT_EQ(single_level.levels.size(), 1u);
+  EXPECT_EQ(single_level.selectLevel(1.0), 0u);
+}
+
+TEST(ScitosDockingPerception, refineClusterPosePyramid) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.template_levels", rclcpp::ParameterValue(3));
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+
+  // A sparse scan of the dock, as seen from far away
+  auto cloud_template = create_dock_template();
+  const float x = 0.05f, y = -0.03f, yaw = 0.1f;
+  scitos2_charging_dock::Cluster cluster;
+  for (size_t i = 0; i < cloud_template.size(); i += 3) {
+    const auto & point = cloud_template[i];
+    cluster.cloud.push_back(
+      pcl::PointXYZ(
+        std::cos(yaw) * point.x - std::sin(yaw) * point.y + x,
+        std::sin(yaw) * point.x + std::cos(yaw) * point.y + y, 0.0f));
+  }
+
+  // Refine the cluster pose
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+  bool success = perception->refineClusterPose(cluster, cloud_template);
+
+  // The pose is refined coarse to fine
+  EXPECT_TRUE(success);
+  EXPECT_NEAR(cluster.pose.pose.position.x, x, 0.01);
+  EXPECT_NEAR(cluster.pose.pose.position.y, y, 0.01);
+  EXPECT_LT(cluster.score, 1e-3);
+
+  // Without early termination every level runs to its cap: the coarser level of the sparse
+  // cluster gets its own cap and the finest level the full one
+  node->set_parameter(rclcpp::Parameter("test.perception.matcher", "se2"));
+  node->set_parameter(rclcpp::Parameter("test.perception.icp_max_iter", 40));
+  node->set_parameter(rclcpp::Parameter("test.perception.coarse_max_iter", 5));
+  node->set_parameter(rclcpp::Parameter("test.perception.icp_max_trans_eps", -1.0));
+  node->set_parameter(rclcpp::Parameter("test.perception.icp_max_eucl_fit_eps", -1.0));
+  scitos2_charging_dock::Cluster capped;
+  for (size_t i = 0; i < cloud_template.size(); i += 3) {
+    const auto & point = cloud_template[i];
+    capped.cloud.push_back(
+      pcl::PointXYZ(
+        std::cos(yaw) * point.x - std::sin(yaw) * point.y + x,
+        std::sin(yaw) * point.x + std::cos(yaw) * point.y + y, 0.0f));
+  }
+  EXPECT_TRUE(perception->refineClusterPose(capped, cloud_template));
+  EXPECT_EQ(capped.iterations, 5 + 40);
+  EXPECT_NEAR(capped.pose.pose.position.x, x, 0.01);
+  EXPECT_NEAR(capped.pose.pose.position.y, y, 0.01);
+}
+
 TEST(ScitosDockingPerception, refineAllClustersPoses) {
   // Create a node
   auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
@@ -329,12 +704,16 @@ TEST(ScitosDockingPerception, refineAllClustersPoses) {
   cluster.clear();
 
   // Create a template
-  scitos2_charging_dock::Cluster dock_template;
-  dock_template.cloud.header.frame_id = "test_link";
-  dock_template.cloud.push_back(pcl::PointXYZ(0, 0, 0));
-  dock_template.cloud.push_back(pcl::PointXYZ(1, 0, 0));
-  dock_template.cloud.push_back(pcl::PointXYZ(1, 1.5, 0));
-  dock_template.cloud.push_back(pcl::PointXYZ(1, 2, 0));
+  scitos2_charging_dock::Pcloud cloud_template;
+  cloud_template.header.frame_id = "test_link";
+  cloud_template.push_back(pcl::PointXYZ(0, 0, 0));
+  cloud_template.push_back(pcl::PointXYZ(1, 0, 0));
+  cloud_template.push_back(pcl::PointXYZ(1, 1.5, 0));
+  cloud_template.push_back(pcl::PointXYZ(1, 2, 0));
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25);
+  EXPECT_DOUBLE_EQ(dock_template.width(), std::hypot(1.0, 2.0));
+  EXPECT_TRUE(dock_template.tree != nullptr);
+  EXPECT_TRUE(dock_template.grid != nullptr);
 
   // Set the initial pose
   geometry_msgs::msg::Pose initial_pose;
@@ -350,6 +729,284 @@ TEST(ScitosDockingPerception, refineAllClustersPoses) {
   EXPECT_TRUE(success);
   EXPECT_EQ(dock.pose.header.frame_id, "test_link");
   EXPECT_NEAR(dock.pose.pose.position.x, 0.0, 0.01);
+
+  // Now the dock is shifted and the initial estimate is close to it
+  clusters.clear();
+  cluster.cloud.header.frame_id = "test_link";
+  for (const auto & point : *dock_template.cloud) {
+    cluster.cloud.push_back(pcl::PointXYZ(point.x + 2.05, point.y + 1.0, 0));
+  }
+  clusters.push_back(cluster);
+  initial_pose.position.x = 2.0;
+  initial_pose.position.y = 1.0;
+  perception->setInitialEstimate(initial_pose, "test_link");
+  success = perception->refineAllClustersPoses(clusters, dock_template, dock);
+
+  // The dock is found at the shifted pose and its cloud is the aligned template
+  EXPECT_TRUE(success);
+  EXPECT_NEAR(dock.pose.pose.position.x, 2.05, 0.01);
+  EXPECT_NEAR(dock.pose.pose.position.y, 1.0, 0.01);
+  EXPECT_EQ(dock.cloud.size(), dock_template.cloud->size());
+  EXPECT_NEAR(dock.cloud.front().x, 2.05, 0.01);
+
+  // The clusters are in the frame of the sensor, transformed once for all of them
+  geometry_msgs::msg::TransformStamped sensor_tf;
+  sensor_tf.header.frame_id = "test_link";
+  sensor_tf.child_frame_id = "scan_link";
+  sensor_tf.transform.translation.x = 1.0;
+  sensor_tf.transform.translation.y = 0.5;
+  tf_buffer->setTransform(sensor_tf, "test", true);
+  clusters.clear();
+  for (int c = 0; c < 3; c++) {
+    cluster.clear();
+    cluster.id = c;
+    cluster.cloud.header.frame_id = "scan_link";
+    for (const auto & point : *dock_template.cloud) {
+      cluster.cloud.push_back(pcl::PointXYZ(point.x + 1.05 + c, point.y + 0.5, 0));
+    }
+    clusters.push_back(cluster);
+  }
+  perception->setInitialEstimate(initial_pose, "test_link");
+  success = perception->refineAllClustersPoses(clusters, dock_template, dock);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(dock.id, 0);
+  EXPECT_NEAR(dock.pose.pose.position.x, 2.05, 0.01);
+  EXPECT_NEAR(dock.pose.pose.position.y, 1.0, 0.01);
+
+  // The clusters in a frame without transform are skipped
+  for (auto & c : clusters) {
+    c.cloud.header.frame_id = "unknown_link";
+  }
+  EXPECT_FALSE(perception->refineAllClustersPoses(clusters, dock_template, dock));
+}
+
+TEST(ScitosDockingPerception, debugVisualization) {
+  // Create a node with debug mode
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.enable_debug", rclcpp::ParameterValue(true));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.max_distance", rclcpp::ParameterValue(5.0));
+  node->configure();
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", tf_buffer);
+  node->activate();
+
+  // A flat template and a scan with two walls like it, in front and to the left of the sensor
+  scitos2_charging_dock::Pcloud cloud_template;
+  cloud_template.header.frame_id = "test_link";
+  for (int i = -8; i <= 8; i++) {
+    cloud_template.push_back(pcl::PointXYZ(0.0f, 0.05f * i, 0.0f));
+  }
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25);
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.stamp = node->now();
+  scan.header.frame_id = "test_link";
+  scan.angle_min = -M_PI;
+  scan.angle_increment = 0.01;
+  scan.range_min = 0.1;
+  scan.range_max = 10.0;
+  for (double angle = scan.angle_min; angle < M_PI; angle += scan.angle_increment) {
+    if (std::abs(2.0 * std::tan(angle)) <= 0.4 && std::cos(angle) > 0.0) {
+      scan.ranges.push_back(2.0 / std::cos(angle));
+    } else if (std::abs(2.0 / std::tan(angle)) <= 0.4 && std::sin(angle) > 0.0) {
+      scan.ranges.push_back(2.0 / std::sin(angle));
+    } else {
+      scan.ranges.push_back(std::numeric_limits<float>::infinity());
+    }
+  }
+  scan.angle_max = scan.angle_min + (scan.ranges.size() - 1) * scan.angle_increment;
+
+  // The segmentation identifies each cluster
+  auto clusters = perception->extractClustersFromScan(scan);
+  ASSERT_EQ(clusters.size(), 2u);
+  EXPECT_NE(clusters[0].id, clusters[1].id);
+  const size_t cluster_points = clusters[0].size() + clusters[1].size();
+  perception->setInitialEstimate(geometry_msgs::msg::Pose(), "test_link");
+
+  // Without subscribers, only the template is published
+  scitos2_charging_dock::Cluster dock;
+  perception->refineAllClustersPoses(clusters, dock_template, dock);
+
+  // Subscribe to the debug topics
+  auto listener = rclcpp::Node::make_shared("debug_listener");
+  size_t template_msgs = 0;
+  sensor_msgs::msg::PointCloud2::SharedPtr target_msg;
+  auto template_sub = listener->create_subscription<sensor_msgs::msg::PointCloud2>(
+    "dock/template", rclcpp::QoS(1).transient_local(),
+    [&](sensor_msgs::msg::PointCloud2::SharedPtr) {template_msgs++;});
+  auto target_sub = listener->create_subscription<sensor_msgs::msg::PointCloud2>(
+    "dock/target", 1, [&](sensor_msgs::msg::PointCloud2::SharedPtr msg) {target_msg = msg;});
+  auto start = std::chrono::steady_clock::now();
+  while (node->count_subscribers("dock/target") == 0 &&
+    std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // The clusters of a scan are published in a single coloured cloud
+  clusters = perception->extractClustersFromScan(scan);
+  perception->refineAllClustersPoses(clusters, dock_template, dock);
+  start = std::chrono::steady_clock::now();
+  while ((!target_msg || template_msgs == 0) &&
+    std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+  {
+    rclcpp::spin_some(listener);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_NE(target_msg, nullptr);
+  EXPECT_EQ(target_msg->header.frame_id, "test_link");
+  EXPECT_EQ(target_msg->width * target_msg->height, cluster_points);
+  ASSERT_TRUE(
+    std::any_of(
+      target_msg->fields.begin(), target_msg->fields.end(),
+      [](const auto & field) {return field.name == "rgb";}));
+
+  // Each cluster has its own colour
+  pcl::PointCloud<pcl::PointXYZRGB> target_cloud;
+  pcl::fromROSMsg(*target_msg, target_cloud);
+  std::set<uint32_t> colors;
+  for (const auto & point : target_cloud) {
+    colors.insert(point.rgba & 0xFFFFFF);
+  }
+  EXPECT_EQ(colors.size(), 2u);
+
+  // The template was received once by the late subscriber, it is not published again
+  EXPECT_EQ(template_msgs, 1u);
+
+  node->deactivate();
+  node->cleanup();
+  node->shutdown();
+}
+
+TEST(ScitosDockingPerception, deterministicSelection) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.max_threads", rclcpp::ParameterValue(4));
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+
+  // Create several identical clusters, the identifiers do not follow their order
+  auto cloud_template = create_dock_template();
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25);
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+
+  for (int trial = 0; trial < 10; trial++) {
+    scitos2_charging_dock::Clusters clusters;
+    for (int id = 7; id >= 0; id--) {
+      scitos2_charging_dock::Cluster cluster;
+      cluster.id = id;
+      cluster.cloud = cloud_template;
+      clusters.push_back(cluster);
+    }
+
+    // The dock is always the first of the tied clusters
+    scitos2_charging_dock::Cluster dock;
+    EXPECT_TRUE(perception->refineAllClustersPoses(clusters, dock_template, dock));
+    EXPECT_EQ(dock.id, 7);
+  }
+}
+
+TEST(ScitosDockingPerception, timeBudget) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.time_budget", rclcpp::ParameterValue(1e-9));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.matcher", rclcpp::ParameterValue("se2"));
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+
+  auto cloud_template = create_dock_template();
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25);
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+
+  // All the hypotheses are cancelled
+  auto clusters = create_cluttered_clusters(cloud_template, 5);
+  scitos2_charging_dock::Cluster dock;
+  EXPECT_FALSE(perception->refineAllClustersPoses(clusters, dock_template, dock));
+}
+
+TEST(ScitosDockingPerception, shapeFilter) {
+  auto cloud_template = create_dock_template();
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25);
+  geometry_msgs::msg::Pose initial_pose;
+
+  // Create a node with the shape filter enabled
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.shape_filter", rclcpp::ParameterValue(true));
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+  perception->setInitialEstimate(initial_pose, "test_link");
+
+  // Only the dock passes the filter and it is still found
+  auto clusters = create_cluttered_clusters(cloud_template, 15);
+  scitos2_charging_dock::Cluster dock;
+  EXPECT_TRUE(perception->refineAllClustersPoses(clusters, dock_template, dock));
+  EXPECT_EQ(dock.id, 0);
+  EXPECT_EQ(perception->getShapeChecked(), 16u);
+  EXPECT_EQ(perception->getShapeRejected(), 15u);
+
+  // The counts accumulate over the scans
+  clusters = create_cluttered_clusters(cloud_template, 15);
+  clusters.erase(clusters.begin());
+  EXPECT_FALSE(perception->refineAllClustersPoses(clusters, dock_template, dock));
+  EXPECT_EQ(perception->getShapeChecked(), 31u);
+  EXPECT_EQ(perception->getShapeRejected(), 30u);
+}
+
+TEST(ScitosDockingPerception, threadCountIndependence) {
+  auto cloud_template = create_dock_template();
+  scitos2_charging_dock::DockTemplate dock_template(cloud_template, 0.25);
+  geometry_msgs::msg::Pose initial_pose;
+
+  for (const std::string matcher : {"pcl", "se2"}) {
+    for (int threads : {1, 2, 4}) {
+      // Create a perception with the number of threads
+      auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+      nav2_util::declare_parameter_if_not_declared(
+        node, "test.perception.max_threads", rclcpp::ParameterValue(threads));
+      nav2_util::declare_parameter_if_not_declared(
+        node, "test.perception.matcher", rclcpp::ParameterValue(matcher));
+      auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+      perception->setInitialEstimate(initial_pose, "test_link");
+
+      // The dock is found regardless of the number of threads
+      auto clusters = create_cluttered_clusters(cloud_template, 15);
+      scitos2_charging_dock::Cluster dock;
+      ASSERT_TRUE(perception->refineAllClustersPoses(clusters, dock_template, dock));
+      EXPECT_EQ(dock.id, 0);
+      EXPECT_NEAR(dock.pose.pose.position.x, 0.02, 0.01);
+      EXPECT_NEAR(dock.pose.pose.position.y, -0.01, 0.01);
+    }
+  }
+}
+
+TEST(ScitosDockingPerception, fuseDockBehindSensor) {
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", nullptr);
+
+  // Scans of a V-shaped dock 1 meter behind the sensor, where the bearing wraps around
+  std::mt19937 generator(42);
+  std::normal_distribution<float> noise(0.0f, 0.002f);
+  std::vector<scitos2_charging_dock::Pcloud> clouds(3);
+  for (auto & cloud : clouds) {
+    for (int i = -40; i <= 40; i++) {
+      float y = 0.005f * i;
+      cloud.push_back(pcl::PointXYZ(-1.0f + 0.5f * std::abs(y) + noise(generator), y, 0.0f));
+    }
+  }
+
+  // The fused profile follows the dock without joining its ends
+  scitos2_charging_dock::Pcloud dock;
+  double mean_residual = 0.0, max_residual = 0.0;
+  EXPECT_EQ(perception->fuseDockPointclouds(clouds, 0.01, dock, mean_residual, max_residual), 3u);
+  ASSERT_FALSE(dock.empty());
+  for (const auto & point : dock) {
+    EXPECT_NEAR(point.x, -1.0f + 0.5f * std::abs(point.y), 0.01f);
+  }
+  EXPECT_LT(max_residual, 0.015);
 }
 
 TEST(ScitosDockingPerception, getDockPose) {
@@ -395,6 +1052,8 @@ TEST(ScitosDockingPerception, getDockPose) {
 
   sensor_msgs::msg::LaserScan scan_random;
   scan_random = scan_template;
+  scan_random.header.stamp = rclcpp::Time(scan_template.header.stamp) -
+    rclcpp::Duration::from_seconds(0.1);
   scan_random.ranges = {5.2, 2.0, 2.25, 4.5, 8.2};
 
   // The dock is not found yet
@@ -426,6 +1085,372 @@ TEST(ScitosDockingPerception, getDockPose) {
   EXPECT_TRUE(perception->getDockFound());
 }
 
+TEST(ScitosDockingPerception, selectScan) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+  node->configure();
+
+  // Create the perception module
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", tf_buffer);
+
+  // No scans to select
+  EXPECT_EQ(perception->selectScan({}), nullptr);
+
+  // Create two scans in the laser frame, the oldest one first
+  auto old_scan = std::make_shared<sensor_msgs::msg::LaserScan>();
+  old_scan->header.stamp = rclcpp::Time(10, 0);
+  old_scan->header.frame_id = "laser_link";
+  auto new_scan = std::make_shared<sensor_msgs::msg::LaserScan>(*old_scan);
+  new_scan->header.stamp = rclcpp::Time(11, 0);
+  std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> scans = {old_scan, new_scan};
+
+  // Without initial estimate the newest scan is selected
+  EXPECT_EQ(perception->selectScan(scans), new_scan);
+
+  // The transform is only available at the time of the oldest scan
+  perception->setInitialEstimate(geometry_msgs::msg::Pose(), "odom");
+  geometry_msgs::msg::TransformStamped transform;
+  transform.header.stamp = old_scan->header.stamp;
+  transform.header.frame_id = "odom";
+  transform.child_frame_id = "laser_link";
+  transform.transform.rotation.w = 1.0;
+  tf_buffer->setTransform(transform, "test", false);
+  EXPECT_EQ(perception->selectScan(scans), old_scan);
+
+  // Once the transform of the newest scan arrives, it is selected
+  transform.header.stamp = rclcpp::Time(12, 0);
+  tf_buffer->setTransform(transform, "test", false);
+  EXPECT_EQ(perception->selectScan(scans), new_scan);
+
+  // Without any transform the newest scan is selected
+  perception->setInitialEstimate(geometry_msgs::msg::Pose(), "map");
+  EXPECT_EQ(perception->selectScan(scans), new_scan);
+}
+
+TEST(ScitosDockingPerception, getDockPoseMemoised) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+
+  // Set the dock template
+  std::string pkg = ament_index_cpp::get_package_share_directory("scitos2_charging_dock");
+  std::string path = pkg + "/test/dock_test.pcd";
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.dock_template", rclcpp::ParameterValue(path));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.distance_threshold", rclcpp::ParameterValue(0.5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_points", rclcpp::ParameterValue(0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_width", rclcpp::ParameterValue(0.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_distance", rclcpp::ParameterValue(0.0));
+  node->configure();
+
+  // Create the perception module
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", tf_buffer);
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+
+  // A scan taken a moment ago that matches the test dock template
+  rclcpp::Time scan_time = node->now() - rclcpp::Duration::from_seconds(0.2);
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.stamp = scan_time;
+  scan.header.frame_id = "test_link";
+  scan.angle_min = -std::atan2(0.1, 0.9);
+  scan.angle_max = std::atan2(0.1, 0.9);
+  scan.angle_increment = std::atan2(0.1, 0.9);
+  scan.ranges = {0.9055, 1.0, 0.9055};
+  scan.range_min = 0.9055;
+  scan.range_max = 1.0;
+
+  // The first call processes the scan, the detection is stamped with the scan
+  auto dock_pose = perception->getDockPose(scan);
+  EXPECT_TRUE(perception->getDockFound());
+  rclcpp::Time detection_time = dock_pose.header.stamp;
+  EXPECT_EQ(detection_time, scan_time);
+
+  // The same scan is not processed again, so the detection is the same
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  dock_pose = perception->getDockPose(scan);
+  EXPECT_EQ(rclcpp::Time(dock_pose.header.stamp), detection_time);
+
+  // A new scan is processed
+  scan.header.stamp = scan_time + rclcpp::Duration::from_seconds(0.05);
+  dock_pose = perception->getDockPose(scan);
+  EXPECT_GT(rclcpp::Time(dock_pose.header.stamp), detection_time);
+  detection_time = dock_pose.header.stamp;
+
+  // A new initial estimate invalidates the last result, so the same scan is processed again
+  perception->setInitialEstimate(initial_pose, "test_link");
+  EXPECT_FALSE(perception->getDockFound());
+  dock_pose = perception->getDockPose(scan);
+  EXPECT_TRUE(perception->getDockFound());
+  EXPECT_EQ(rclcpp::Time(dock_pose.header.stamp), detection_time);
+
+  // Without odometry the detection cannot be propagated
+  node->set_parameter(rclcpp::Parameter("test.perception.propagate_detection", true));
+  dock_pose = perception->getDockPose(scan);
+  EXPECT_EQ(rclcpp::Time(dock_pose.header.stamp), detection_time);
+
+  // The robot moves 1 meter forward after the scan
+  geometry_msgs::msg::TransformStamped odom;
+  odom.header.frame_id = "odom";
+  odom.child_frame_id = "test_link";
+  odom.header.stamp = scan.header.stamp;
+  tf_buffer->setTransform(odom, "test");
+  odom.header.stamp = scan_time + rclcpp::Duration::from_seconds(0.1);
+  odom.transform.translation.x = 1.0;
+  tf_buffer->setTransform(odom, "test");
+
+  // So the dock is 1 meter closer
+  dock_pose = perception->getDockPose(scan);
+  EXPECT_GT(rclcpp::Time(dock_pose.header.stamp), detection_time);
+  EXPECT_EQ(dock_pose.header.frame_id, "test_link");
+  EXPECT_NEAR(dock_pose.pose.position.x, -1.0, 0.01);
+  EXPECT_NEAR(dock_pose.pose.position.y, 0.0, 0.01);
+
+  // An old detection is not propagated, so it keeps its stamp
+  node->set_parameter(rclcpp::Parameter("test.perception.propagation_max_age", 0.01));
+  dock_pose = perception->getDockPose(scan);
+  EXPECT_EQ(rclcpp::Time(dock_pose.header.stamp), detection_time);
+  EXPECT_NEAR(dock_pose.pose.position.x, 0.0, 0.01);
+}
+
+TEST(ScitosDockingPerception, tracking) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+
+  // Set the dock template
+  std::string pkg = ament_index_cpp::get_package_share_directory("scitos2_charging_dock");
+  std::string path = pkg + "/test/dock_test.pcd";
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.dock_template", rclcpp::ParameterValue(path));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.tracking", rclcpp::ParameterValue(true));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.distance_threshold", rclcpp::ParameterValue(0.5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_points", rclcpp::ParameterValue(0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_width", rclcpp::ParameterValue(0.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_distance", rclcpp::ParameterValue(0.0));
+  node->configure();
+
+  // Create the perception module
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", tf_buffer);
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+
+  // A scan that matches the test dock template
+  rclcpp::Time scan_time = node->now();
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.stamp = scan_time;
+  scan.header.frame_id = "test_link";
+  scan.angle_min = -std::atan2(0.1, 0.9);
+  scan.angle_max = std::atan2(0.1, 0.9);
+  scan.angle_increment = std::atan2(0.1, 0.9);
+  scan.ranges = {0.9055, 1.0, 0.9055};
+  scan.range_min = 0.9055;
+  scan.range_max = 1.0;
+
+  // The first detection is a full search
+  perception->getDockPose(scan);
+  EXPECT_TRUE(perception->getDockFound());
+  EXPECT_FALSE(perception->getTrackingActive());
+  EXPECT_EQ(perception->getIterationCap(), 300);
+
+  // The next scans start from the last detection with a few iterations
+  scan.header.stamp = scan_time + rclcpp::Duration::from_seconds(0.1);
+  auto dock_pose = perception->getDockPose(scan);
+  EXPECT_TRUE(perception->getDockFound());
+  EXPECT_TRUE(perception->getTrackingActive());
+  EXPECT_NEAR(dock_pose.pose.position.x, 0.0, 0.01);
+  EXPECT_NEAR(dock_pose.pose.position.y, 0.0, 0.01);
+  EXPECT_GE(perception->getIterationCap(), 5);
+  EXPECT_LT(perception->getIterationCap(), 300);
+
+  // When the dock is lost, the search falls back to the initial estimate
+  scan.header.stamp = scan_time + rclcpp::Duration::from_seconds(0.2);
+  scan.ranges = {5.2, 2.0, 8.2};
+  perception->getDockPose(scan);
+  EXPECT_FALSE(perception->getTrackingActive());
+  EXPECT_EQ(perception->getIterationCap(), 300);
+}
+
+TEST(ScitosDockingPerception, correspondenceDistanceRebuild) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+
+  // Set the dock template
+  std::string pkg = ament_index_cpp::get_package_share_directory("scitos2_charging_dock");
+  std::string path = pkg + "/test/dock_test.pcd";
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.dock_template", rclcpp::ParameterValue(path));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.template_levels", rclcpp::ParameterValue(2));
+  node->configure();
+
+  // Create the perception module
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", tf_buffer);
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+  ASSERT_FALSE(perception->getDockTemplate().empty());
+  const auto cloud = perception->getDockTemplate().cloud;
+  EXPECT_DOUBLE_EQ(perception->getDockTemplate().correspondence_distance, 0.25);
+
+  // The template is only rebuilt by the next scan, between the matchings
+  node->set_parameter(rclcpp::Parameter("test.perception.icp_max_corr_dis", 0.4));
+  EXPECT_DOUBLE_EQ(perception->getDockTemplate().correspondence_distance, 0.25);
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.stamp = node->now();
+  scan.header.frame_id = "test_link";
+  scan.angle_min = -std::atan2(0.1, 0.9);
+  scan.angle_max = std::atan2(0.1, 0.9);
+  scan.angle_increment = std::atan2(0.1, 0.9);
+  scan.ranges = {0.9055, 1.0, 0.9055};
+  scan.range_min = 0.9055;
+  scan.range_max = 1.0;
+  perception->getDockPose(scan);
+
+  // The grids of every level cover the new distance around the same points
+  const auto & dock_template = perception->getDockTemplate();
+  EXPECT_DOUBLE_EQ(dock_template.correspondence_distance, 0.4);
+  EXPECT_EQ(dock_template.cloud->size(), cloud->size());
+  ASSERT_FALSE(dock_template.levels.empty());
+  for (const auto & level : dock_template.levels) {
+    float min_x = std::numeric_limits<float>::max(), min_y = min_x;
+    for (const auto & point : *level.cloud) {
+      min_x = std::min(min_x, point.x);
+      min_y = std::min(min_y, point.y);
+    }
+    EXPECT_FLOAT_EQ(level.grid->origin().x(), min_x - 0.4f);
+    EXPECT_FLOAT_EQ(level.grid->origin().y(), min_y - 0.4f);
+  }
+  EXPECT_NE(dock_template.likelihood, nullptr);
+}
+
+TEST(ScitosDockingPerception, parametersWhileDetecting) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+
+  // Set the dock template
+  std::string pkg = ament_index_cpp::get_package_share_directory("scitos2_charging_dock");
+  std::string path = pkg + "/test/dock_test.pcd";
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.dock_template", rclcpp::ParameterValue(path));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.max_threads", rclcpp::ParameterValue(2));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.distance_threshold", rclcpp::ParameterValue(0.5));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_points", rclcpp::ParameterValue(0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_width", rclcpp::ParameterValue(0.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.segmentation.min_distance", rclcpp::ParameterValue(0.0));
+  node->configure();
+
+  // Create the perception module
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", tf_buffer);
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+
+  // A scan that matches the test dock template
+  rclcpp::Time scan_time = node->now();
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.frame_id = "test_link";
+  scan.angle_min = -std::atan2(0.1, 0.9);
+  scan.angle_max = std::atan2(0.1, 0.9);
+  scan.angle_increment = std::atan2(0.1, 0.9);
+  scan.ranges = {0.9055, 1.0, 0.9055};
+  scan.range_min = 0.9055;
+  scan.range_max = 1.0;
+
+  // The docking thread processes new scans while the parameters are tuned, so every scan is
+  // matched with a consistent set of parameters
+  std::atomic<bool> tuning{true};
+  int scans = 0, found = 0;
+  std::thread detection([&]() {
+      while (tuning || scans < 10) {
+        scan.header.stamp = scan_time + rclcpp::Duration::from_seconds(0.01 * ++scans);
+        const auto dock_pose = perception->getDockPose(scan);
+        if (std::hypot(dock_pose.pose.position.x, dock_pose.pose.position.y) < 0.01) {
+          found++;
+        }
+      }
+    });
+  for (int i = 0; i < 200; i++) {
+    node->set_parameter(rclcpp::Parameter("test.perception.matcher", i % 2 ? "pcl" : "se2"));
+    node->set_parameter(rclcpp::Parameter("test.perception.tracking", i % 3 == 0));
+    node->set_parameter(rclcpp::Parameter("test.perception.icp_max_iter", 100 + i));
+    node->set_parameter(
+      rclcpp::Parameter("test.segmentation.distance_threshold", i % 2 ? 0.5 : 0.6));
+  }
+  tuning = false;
+  detection.join();
+  EXPECT_EQ(found, scans);
+}
+
+TEST(ScitosDockingPerception, regionOfInterest) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("perception_test");
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(node->get_clock());
+
+  // Set the dock template, 1 meter in front of the initial estimate
+  std::string pkg = ament_index_cpp::get_package_share_directory("scitos2_charging_dock");
+  std::string path = pkg + "/test/dock_test.pcd";
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.dock_template", rclcpp::ParameterValue(path));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "test.perception.region_of_interest", rclcpp::ParameterValue(true));
+  node->configure();
+
+  // Create the perception module
+  auto perception = std::make_shared<PerceptionFixture>(node, "test", tf_buffer);
+  geometry_msgs::msg::Pose initial_pose;
+  perception->setInitialEstimate(initial_pose, "test_link");
+
+  // A wall at 1 meter all around the sensor
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.stamp = node->now();
+  scan.header.frame_id = "test_link";
+  scan.angle_min = -1.5;
+  scan.angle_max = 1.5;
+  scan.angle_increment = 0.1;
+  scan.range_min = 0.1;
+  scan.range_max = 10.0;
+  scan.ranges.assign(31, 1.0);
+
+  // Only the beams around the dock are segmented
+  size_t points = perception->segmentedPoints(scan);
+  EXPECT_EQ(points, 11u);
+
+  // The window widens after each scan without the dock
+  perception->setRoiMisses(1);
+  EXPECT_GT(perception->segmentedPoints(scan), points);
+  perception->setRoiMisses(3);
+  EXPECT_EQ(perception->segmentedPoints(scan), 31u);
+
+  // A new initial estimate starts again from the narrow window
+  perception->setInitialEstimate(initial_pose, "test_link");
+  EXPECT_EQ(perception->segmentedPoints(scan), 11u);
+
+  // Without the transform to the frame of the scan the whole scan is used
+  perception->setInitialEstimate(initial_pose, "unknown_link");
+  EXPECT_EQ(perception->segmentedPoints(scan), 31u);
+
+  // And also when the region of interest is disabled
+  perception->setInitialEstimate(initial_pose, "test_link");
+  node->set_parameter(rclcpp::Parameter("test.perception.region_of_interest", false));
+  EXPECT_EQ(perception->segmentedPoints(scan), 31u);
+}
+
 int main(int argc, char ** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,187 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "scitos2_charging_dock/scan_matcher_2d.hpp"
+
+using scitos2_charging_dock::Pcloud;
+using scitos2_charging_dock::ScanMatcher2D;
+
+// A V-shaped profile similar to the docking station
+Pcloud createTemplate()
+{
+  Pcloud cloud;
+  cloud.header.frame_id = "test_link";
+  for (int i = -20; i <= 20; i++) {
+    float y = 0.01f * i;
+    cloud.push_back(pcl::PointXYZ(0.5f * std::abs(y), y, 0.0f));
+  }
+  return cloud;
+}
+
+Pcloud transformCloud(const Pcloud & cloud, float x, float y, float yaw)
+{
+  Pcloud transformed;
+  for (const auto & point : cloud) {
+    transformed.push_back(
+      pcl::PointXYZ(
+        std::cos(yaw) * point.x - std::sin(yaw) * point.y + x,
+        std::sin(yaw) * point.x + std::cos(yaw) * point.y + y, 0.0f));
+  }
+  return transformed;
+}
+
+TEST(ScitosDockingScanMatcher2D, nearestGrid) {
+  auto cloud = createTemplate();
+  scitos2_charging_dock::NearestGrid2D grid(cloud, 0.25f);
+  EXPECT_FALSE(grid.empty());
+  EXPECT_EQ(grid.points().size(), cloud.size());
+
+  // The lookup agrees with a linear search inside and outside the grid
+  for (float x = -0.5f; x <= 0.5f; x += 0.013f) {
+    for (float y = -0.5f; y <= 0.5f; y += 0.017f) {
+      Eigen::Vector2f query(x, y);
+      float expected = std::numeric_limits<float>::max();
+      for (const auto & point : grid.points()) {
+        expected = std::min(expected, (point - query).squaredNorm());
+      }
+      float distance_sq;
+      grid.nearest(query, distance_sq);
+      EXPECT_NEAR(std::sqrt(distance_sq), std::sqrt(expected), 0.005f);
+
+      // The closest point on the segments is never further than the nearest point
+      float closest_sq;
+      grid.closest(query, closest_sq);
+      EXPECT_LE(closest_sq, distance_sq);
+    }
+  }
+
+  // Empty cloud
+  scitos2_charging_dock::NearestGrid2D empty_grid(Pcloud(), 0.25f);
+  EXPECT_TRUE(empty_grid.empty());
+}
+
+TEST(ScitosDockingScanMatcher2D, sharedGrid) {
+  auto target = createTemplate();
+  auto grid = std::make_shared<const scitos2_charging_dock::NearestGrid2D>(target, 0.25f);
+
+  // The same grid is reused for several sources
+  ScanMatcher2D matcher;
+  matcher.setSearchGridTarget(grid);
+  for (float x : {-0.04f, 0.0f, 0.04f}) {
+    matcher.setInputSource(transformCloud(target, x, 0.02f, -0.05f));
+    Pcloud aligned;
+    matcher.align(aligned);
+    auto transformation = matcher.getFinalTransformation();
+    EXPECT_TRUE(matcher.hasConverged());
+    EXPECT_LT(matcher.getFitnessScore(), 1e-5);
+    EXPECT_NEAR(std::atan2(transformation(1, 0), transformation(0, 0)), 0.05, 5e-3);
+  }
+}
+
+TEST(ScitosDockingScanMatcher2D, identity) {
+  auto cloud = createTemplate();
+
+  ScanMatcher2D matcher;
+  matcher.setInputSource(cloud);
+  matcher.setInputTarget(cloud);
+  Pcloud aligned;
+  matcher.align(aligned);
+
+  EXPECT_TRUE(matcher.hasConverged());
+  EXPECT_NEAR(matcher.getFitnessScore(), 0.0, 1e-9);
+  EXPECT_TRUE(matcher.getFinalTransformation().isApprox(Eigen::Matrix4f::Identity(), 1e-5));
+  EXPECT_EQ(aligned.size(), cloud.size());
+  EXPECT_EQ(aligned.header.frame_id, "test_link");
+}
+
+TEST(ScitosDockingScanMatcher2D, recoverTransformation) {
+  auto source = createTemplate();
+  auto target = transformCloud(source, 0.05f, -0.03f, 0.1f);
+
+  ScanMatcher2D matcher;
+  matcher.setMaximumIterations(300);
+  matcher.setMaxCorrespondenceDistance(0.25);
+  matcher.setTransformationEpsilon(1e-9);
+  matcher.setEuclideanFitnessEpsilon(1e-9);
+  matcher.setInputSource(source);
+  matcher.setInputTarget(target);
+  Pcloud aligned;
+  matcher.align(aligned);
+
+  // The transformation is recovered and the matcher stops before the limit
+  auto transformation = matcher.getFinalTransformation();
+  EXPECT_TRUE(matcher.hasConverged());
+  EXPECT_LT(matcher.getIterations(), 300);
+  EXPECT_NEAR(transformation(0, 3), 0.05, 1e-3);
+  EXPECT_NEAR(transformation(1, 3), -0.03, 1e-3);
+  EXPECT_NEAR(std::atan2(transformation(1, 0), transformation(0, 0)), 0.1, 1e-3);
+  EXPECT_NEAR(transformation(2, 2), 1.0, 1e-6);
+  EXPECT_NEAR(transformation(2, 3), 0.0, 1e-6);
+  EXPECT_LT(matcher.getFitnessScore(), 1e-6);
+  EXPECT_NEAR(aligned[0].x, target[0].x, 1e-3);
+  EXPECT_NEAR(aligned[0].y, target[0].y, 1e-3);
+}
+
+TEST(ScitosDockingScanMatcher2D, fitnessScore) {
+  auto source = createTemplate();
+  auto target = transformCloud(source, 0.0f, 0.0f, 0.0f);
+  // Add an outlier far from the template
+  target.push_back(pcl::PointXYZ(2.0f, 2.0f, 0.0f));
+
+  ScanMatcher2D matcher;
+  matcher.setMaximumIterations(1);
+  matcher.setInputSource(source);
+  matcher.setInputTarget(target);
+  Pcloud aligned;
+  matcher.align(aligned);
+
+  // The score is the mean squared distance from the source to the nearest target point,
+  // so the outlier of the target does not change it
+  EXPECT_TRUE(matcher.hasConverged());
+  EXPECT_EQ(matcher.getIterations(), 1);
+  EXPECT_NEAR(matcher.getFitnessScore(), 0.0, 1e-9);
+}
+
+TEST(ScitosDockingScanMatcher2D, noCorrespondences) {
+  auto source = createTemplate();
+  auto target = transformCloud(source, 10.0f, 10.0f, 0.0f);
+
+  ScanMatcher2D matcher;
+  matcher.setMaxCorrespondenceDistance(0.25);
+  matcher.setInputSource(source);
+  matcher.setInputTarget(target);
+  Pcloud aligned;
+  matcher.align(aligned);
+  EXPECT_FALSE(matcher.hasConverged());
+
+  // Empty target
+  matcher.setInputTarget(Pcloud());
+  matcher.align(aligned);
+  EXPECT_FALSE(matcher.hasConverged());
+  EXPECT_TRUE(aligned.empty());
+}
+
+int main(int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  bool success = RUN_ALL_TESTS();
+  return success;
+}
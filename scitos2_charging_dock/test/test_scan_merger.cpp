@@ -0,0 +1,141 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "rclcpp/rclcpp.hpp"
+#include "scitos2_charging_dock/scan_merger.hpp"
+
+using scitos2_charging_dock::ScanMerger;
+
+sensor_msgs::msg::LaserScan::SharedPtr createScan(
+  const std::string & frame, double stamp, float angle_min, float angle_increment,
+  const std::vector<float> & ranges)
+{
+  auto scan = std::make_shared<sensor_msgs::msg::LaserScan>();
+  scan->header.frame_id = frame;
+  scan->header.stamp = rclcpp::Time(static_cast<int64_t>(stamp * 1e9), RCL_ROS_TIME);
+  scan->angle_min = angle_min;
+  scan->angle_increment = angle_increment;
+  scan->angle_max = angle_min + angle_increment * (ranges.size() - 1);
+  scan->range_min = 0.1f;
+  scan->range_max = 10.0f;
+  scan->ranges = ranges;
+  return scan;
+}
+
+size_t countReturns(const sensor_msgs::msg::LaserScan & scan)
+{
+  return std::count_if(
+    scan.ranges.begin(), scan.ranges.end(), [](float range) {return std::isfinite(range);});
+}
+
+std::shared_ptr<tf2_ros::Buffer> createBuffer()
+{
+  auto tf_buffer = std::make_shared<tf2_ros::Buffer>(std::make_shared<rclcpp::Clock>());
+  // The rear laser looks backwards from the back of the robot
+  geometry_msgs::msg::TransformStamped transform;
+  transform.header.frame_id = "base_link";
+  transform.child_frame_id = "rear_laser";
+  transform.transform.translation.x = -0.5;
+  transform.transform.rotation.z = 1.0;
+  transform.transform.rotation.w = 0.0;
+  tf_buffer->setTransform(transform, "test", true);
+  return tf_buffer;
+}
+
+TEST(ScitosScanMerger, mergeScans) {
+  auto tf_buffer = createBuffer();
+  ScanMerger merger(tf_buffer, "base_link", 2, 0.1);
+
+  // A single laser, already in the common frame
+  auto merged = merger.addScan(0, createScan("base_link", 10.0, -0.1f, 0.1f, {1.0, 1.0, 1.0}));
+  ASSERT_NE(merged, nullptr);
+  EXPECT_EQ(merged->header.frame_id, "base_link");
+  EXPECT_EQ(rclcpp::Time(merged->header.stamp).seconds(), 10.0);
+  EXPECT_FLOAT_EQ(merged->angle_increment, 0.1f);
+  EXPECT_EQ(merged->time_increment, 0.0f);
+  EXPECT_EQ(countReturns(*merged), 3u);
+  EXPECT_FLOAT_EQ(merged->range_min, 1.0f);
+  EXPECT_FLOAT_EQ(merged->range_max, 1.0f);
+
+  // The rear laser is merged with the finest resolution, stamped with the newest scan
+  merged = merger.addScan(1, createScan("rear_laser", 10.05, 0.0f, 0.05f, {1.0}));
+  ASSERT_NE(merged, nullptr);
+  EXPECT_NEAR(rclcpp::Time(merged->header.stamp).seconds(), 10.05, 1e-9);
+  EXPECT_FLOAT_EQ(merged->angle_increment, 0.05f);
+  EXPECT_EQ(countReturns(*merged), 4u);
+  // Its beam is behind the robot, at the seam of the merged scan
+  EXPECT_NEAR(merged->ranges.front(), 1.5f, 1e-5);
+  EXPECT_NEAR(merged->range_max, 1.5f, 1e-5);
+
+  // The front scan is too old to be merged with a new rear scan
+  merged = merger.addScan(1, createScan("rear_laser", 10.5, 0.0f, 0.05f, {1.0}));
+  ASSERT_NE(merged, nullptr);
+  EXPECT_EQ(countReturns(*merged), 1u);
+
+  // A front scan arriving late is not merged on its own, nor is a scan with the same stamp
+  EXPECT_EQ(merger.addScan(0, createScan("base_link", 10.45, -0.1f, 0.1f, {1.0})), nullptr);
+  EXPECT_EQ(merger.addScan(0, createScan("base_link", 10.5, -0.1f, 0.1f, {1.0})), nullptr);
+
+  // But it is merged with the next rear scan
+  merged = merger.addScan(1, createScan("rear_laser", 10.55, 0.0f, 0.05f, {1.0}));
+  ASSERT_NE(merged, nullptr);
+  EXPECT_NEAR(rclcpp::Time(merged->header.stamp).seconds(), 10.55, 1e-9);
+  EXPECT_EQ(countReturns(*merged), 2u);
+}
+
+TEST(ScitosScanMerger, nearestReturn) {
+  auto tf_buffer = createBuffer();
+  ScanMerger merger(tf_buffer, "base_link", 2, 0.1);
+
+  // Both lasers see the same direction, the nearest return is kept
+  merger.addScan(0, createScan("base_link", 10.0, -M_PI, 0.1f, {2.0}));
+  auto merged = merger.addScan(1, createScan("rear_laser", 10.01, 0.0f, 0.1f, {1.0}));
+  ASSERT_NE(merged, nullptr);
+  EXPECT_EQ(countReturns(*merged), 1u);
+  EXPECT_NEAR(merged->ranges.front(), 1.5f, 1e-5);
+}
+
+TEST(ScitosScanMerger, cachedExtrinsic) {
+  auto tf_buffer = createBuffer();
+  ScanMerger merger(tf_buffer, "base_link", 2, 0.1);
+
+  // A laser without transform to the common frame is not merged
+  EXPECT_EQ(merger.addScan(0, createScan("unknown_laser", 10.0, 0.0f, 0.1f, {1.0})), nullptr);
+  // Nor a laser that does not exist
+  EXPECT_EQ(merger.addScan(2, createScan("base_link", 10.0, 0.0f, 0.1f, {1.0})), nullptr);
+
+  // The extrinsic is looked up once, so the merging does not depend on the buffer anymore
+  ASSERT_NE(merger.addScan(1, createScan("rear_laser", 10.0, 0.0f, 0.1f, {1.0})), nullptr);
+  tf_buffer->clear();
+  auto merged = merger.addScan(1, createScan("rear_laser", 10.1, 0.0f, 0.1f, {1.0}));
+  ASSERT_NE(merged, nullptr);
+  EXPECT_NEAR(merged->ranges.front(), 1.5f, 1e-5);
+}
+
+int main(int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  rclcpp::init(argc, argv);
+  bool success = RUN_ALL_TESTS();
+  rclcpp::shutdown();
+  return success;
+}
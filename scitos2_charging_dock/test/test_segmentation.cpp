@@ -13,6 +13,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "gtest/gtest.h"
 #include "rclcpp_lifecycle/lifecycle_node.hpp"
 #include "scitos2_charging_dock/segmentation.hpp"
@@ -31,7 +35,7 @@ public:
     return scitos2_charging_dock::Segmentation::fromPolarToCartesian(range, angle);
   }
 
-  std::vector<geometry_msgs::msg::Point> scanToPoints(const sensor_msgs::msg::LaserScan & scan)
+  scitos2_charging_dock::Pcloud scanToPoints(const sensor_msgs::msg::LaserScan & scan)
   {
     return scitos2_charging_dock::Segmentation::scanToPoints(scan);
   }
@@ -42,8 +46,7 @@ public:
     return scitos2_charging_dock::Segmentation::euclideanDistance(p1, p2);
   }
 
-  bool isJumpBetweenPoints(
-    const geometry_msgs::msg::Point & p1, const geometry_msgs::msg::Point & p2, double threshold)
+  bool isJumpBetweenPoints(const pcl::PointXYZ & p1, const pcl::PointXYZ & p2, double threshold)
   {
     return scitos2_charging_dock::Segmentation::isJumpBetweenPoints(p1, p2, threshold);
   }
@@ -111,6 +114,31 @@ sensor_msgs::msg::LaserScan create_scan(int num_points, double distance)
   return scan;
 }
 
+// Create a full turn laser scan of a room with a box in front of the sensor
+sensor_msgs::msg::LaserScan create_room_scan(int num_beams)
+{
+  sensor_msgs::msg::LaserScan scan;
+  scan.header.frame_id = "laser";
+  scan.angle_min = -M_PI;
+  scan.angle_increment = 2 * M_PI / num_beams;
+  scan.angle_max = scan.angle_min + (num_beams - 1) * scan.angle_increment;
+  scan.range_min = 0.05;
+  scan.range_max = 10.0;
+  for (int i = 0; i < num_beams; i++) {
+    double angle = scan.angle_min + i * scan.angle_increment;
+    double range = 3.0 / std::max(std::abs(std::cos(angle)), std::abs(std::sin(angle)));
+    if (std::abs(angle) < 0.2) {
+      range = 1.0;
+    }
+    // Some beams without return
+    if (i % 50 == 0) {
+      range = std::numeric_limits<float>::infinity();
+    }
+    scan.ranges.push_back(range);
+  }
+  return scan;
+}
+
 TEST(SegmentationTest, dynamicParameters) {
   // Create a node
   auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
@@ -220,19 +248,184 @@ TEST(SegmentationTest, isJumpBetweenPoints) {
   auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
   auto segmentation = std::make_shared<SegmentationFixture>(node, "test");
 
-  // Create two points with a distance of 1.0
-  geometry_msgs::msg::Point point1;
-  point1.x = 0.0;
-  point1.y = 0.0;
-  geometry_msgs::msg::Point point2;
-  point2.x = 1.0;
-  point2.y = 1.0;
+  // Create two points with a distance of sqrt(2)
+  pcl::PointXYZ point1(0.0, 0.0, 0.0);
+  pcl::PointXYZ point2(1.0, 1.0, 0.0);
 
   // Check if there is a jump between two points
   EXPECT_TRUE(segmentation->isJumpBetweenPoints(point1, point2, 0.1));
+  EXPECT_TRUE(segmentation->isJumpBetweenPoints(point1, point2, 1.4));
+  EXPECT_FALSE(segmentation->isJumpBetweenPoints(point1, point2, 1.5));
   EXPECT_FALSE(segmentation->isJumpBetweenPoints(point1, point2, 2.0));
 }
 
+TEST(SegmentationTest, scanToPointsNoDrift) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
+  auto segmentation = std::make_shared<SegmentationFixture>(node, "test");
+
+  // The angle of the last beams is computed from its index, not accumulated
+  auto scan = create_room_scan(1440);
+  auto points = segmentation->scanToPoints(scan);
+  size_t p = 0;
+  for (size_t i = 0; i < scan.ranges.size(); i++) {
+    if (!std::isfinite(scan.ranges[i])) {
+      continue;
+    }
+    double angle = scan.angle_min + static_cast<double>(i) * scan.angle_increment;
+    ASSERT_LT(p, points.size());
+    EXPECT_NEAR(points[p].x, scan.ranges[i] * std::cos(angle), 1e-5);
+    EXPECT_NEAR(points[p].y, scan.ranges[i] * std::sin(angle), 1e-5);
+    p++;
+  }
+  EXPECT_EQ(p, points.size());
+
+  // The tables are rebuilt when the geometry of the scan changes. The first beam has no
+  // return, so the first point is the second beam
+  scan = create_room_scan(720);
+  points = segmentation->scanToPoints(scan);
+  EXPECT_NEAR(points[0].x, scan.ranges[1] * std::cos(scan.angle_min + scan.angle_increment), 1e-5);
+  EXPECT_NEAR(points[0].y, scan.ranges[1] * std::sin(scan.angle_min + scan.angle_increment), 1e-5);
+}
+
+TEST(SegmentationTest, motionCompensation) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
+  auto segmentation = std::make_shared<SegmentationFixture>(node, "test");
+
+  // A scan of 5 beams of 1 meter taken in 0.4 seconds
+  sensor_msgs::msg::LaserScan scan;
+  scan.angle_min = 0.0;
+  scan.angle_increment = 0.1;
+  scan.angle_max = 0.4;
+  scan.time_increment = 0.1;
+  scan.range_min = 0.1;
+  scan.range_max = 10.0;
+  scan.ranges = {1.0, 1.0, 1.0, 1.0, 1.0};
+
+  // The sensor moves forward, so the later beams are moved forward
+  segmentation->setSensorVelocity(1.0, 0.0, 0.0);
+  auto points = segmentation->scanToPoints(scan);
+  ASSERT_EQ(points.size(), 5u);
+  for (size_t i = 0; i < points.size(); i++) {
+    EXPECT_NEAR(points[i].x, std::cos(0.1 * i) + 0.1 * i, 1e-5);
+    EXPECT_NEAR(points[i].y, std::sin(0.1 * i), 1e-5);
+  }
+
+  // The sensor rotates, so the later beams are rotated
+  segmentation->setSensorVelocity(0.0, 0.0, 0.5);
+  points = segmentation->scanToPoints(scan);
+  for (size_t i = 0; i < points.size(); i++) {
+    EXPECT_NEAR(points[i].x, std::cos(0.15 * i), 1e-4);
+    EXPECT_NEAR(points[i].y, std::sin(0.15 * i), 1e-4);
+  }
+
+  // Without velocity the beams are not moved
+  segmentation->setSensorVelocity(0.0, 0.0, 0.0);
+  points = segmentation->scanToPoints(scan);
+  EXPECT_NEAR(points[4].x, std::cos(0.4), 1e-6);
+}
+
+TEST(SegmentationTest, regionOfInterest) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
+  auto segmentation = std::make_shared<SegmentationFixture>(node, "test");
+
+  // A scan of 9 beams with increasing ranges
+  sensor_msgs::msg::LaserScan scan;
+  scan.angle_min = -0.4;
+  scan.angle_increment = 0.1;
+  scan.angle_max = 0.4;
+  scan.range_min = 0.1;
+  scan.range_max = 10.0;
+  scan.ranges = {1.0, 1.0, 1.0, 2.0, 2.0, 2.0, 3.0, 3.0, 3.0};
+
+  // Only the beams inside the window are converted
+  segmentation->setRegionOfInterest(-0.05, 0.25, 0.0, 5.0);
+  auto points = segmentation->scanToPoints(scan);
+  ASSERT_EQ(points.size(), 3u);
+  EXPECT_NEAR(points[0].x, 2.0, 1e-5);
+  EXPECT_NEAR(points[2].x, 3.0 * std::cos(0.2), 1e-5);
+
+  // And within its ranges
+  segmentation->setRegionOfInterest(-0.05, 0.25, 1.5, 2.5);
+  points = segmentation->scanToPoints(scan);
+  EXPECT_EQ(points.size(), 2u);
+
+  // The window is found a turn away
+  segmentation->setRegionOfInterest(2.0 * M_PI - 0.22, 2.0 * M_PI + 0.02, 0.0, 5.0);
+  points = segmentation->scanToPoints(scan);
+  ASSERT_EQ(points.size(), 3u);
+  EXPECT_NEAR(points[0].y, -std::sin(0.2), 1e-5);
+
+  // Without the window the whole scan is converted
+  segmentation->clearRegionOfInterest();
+  points = segmentation->scanToPoints(scan);
+  EXPECT_EQ(points.size(), 9u);
+}
+
+TEST(SegmentationTest, segmentRoomScan) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
+  auto segmentation = std::make_shared<SegmentationFixture>(node, "test");
+  segmentation->setDistanceThreshold(0.04);
+
+  for (int num_beams : {720, 1440}) {
+    auto scan = create_room_scan(num_beams);
+    scitos2_charging_dock::Clusters clusters;
+    EXPECT_TRUE(segmentation->performSegmentation(scan, clusters));
+    // The box in front of the sensor is split from the walls
+    EXPECT_GT(clusters.size(), 1u);
+  }
+}
+
+TEST(SegmentationTest, segmentFullTurn) {
+  // Create a node
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
+  auto segmentation = std::make_shared<SegmentationFixture>(node, "test");
+  segmentation->setDistanceThreshold(0.04);
+
+  // A full turn with a dock 1 meter behind the sensor, over the seam of the scan
+  sensor_msgs::msg::LaserScan scan;
+  scan.angle_min = -M_PI;
+  scan.angle_increment = 2 * M_PI / 720;
+  scan.angle_max = scan.angle_min + 719 * scan.angle_increment;
+  scan.range_min = 0.05;
+  scan.range_max = 10.0;
+  size_t dock_beams = 0;
+  for (int i = 0; i < 720; i++) {
+    double angle = scan.angle_min + i * scan.angle_increment;
+    if (std::abs(angle) > M_PI - 0.1) {
+      scan.ranges.push_back(1.0);
+      dock_beams++;
+    } else {
+      scan.ranges.push_back(std::numeric_limits<float>::infinity());
+    }
+  }
+
+  // The dock is a single cluster
+  scitos2_charging_dock::Clusters clusters;
+  EXPECT_TRUE(segmentation->performSegmentation(scan, clusters));
+  ASSERT_EQ(clusters.size(), 1u);
+  EXPECT_EQ(clusters.front().size(), dock_beams);
+
+  // Also inside a window over the seam
+  segmentation->setRegionOfInterest(M_PI - 0.2, M_PI + 0.2, 0.0, 5.0);
+  auto points = segmentation->scanToPoints(scan);
+  ASSERT_EQ(points.size(), dock_beams);
+  // The points follow the window across the seam
+  EXPECT_GT(points.front().y, 0.0f);
+  EXPECT_LT(points.back().y, 0.0f);
+  clusters.clear();
+  EXPECT_TRUE(segmentation->performSegmentation(scan, clusters));
+  ASSERT_EQ(clusters.size(), 1u);
+  EXPECT_EQ(clusters.front().size(), dock_beams);
+
+  // A window away from the seam does not see the dock
+  segmentation->setRegionOfInterest(-0.2, 0.2, 0.0, 5.0);
+  EXPECT_TRUE(segmentation->scanToPoints(scan).empty());
+}
+
 TEST(SegmentationTest, performSegmentation) {
   // Create a node
   auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("segmentation_test");
@@ -259,7 +452,7 @@ TEST(SegmentationTest, performSegmentation) {
   // Check the points in the cluster
   double phi = scan.angle_min;
   for (int i = 0; i < clusters.front().size(); i++) {
-    auto point = clusters.front().cloud.points[i];
+    auto point = clusters.front().data()[i];
     EXPECT_NEAR(point.x, scan.ranges[i] * cos(phi), 1e-6);
     EXPECT_NEAR(point.y, scan.ranges[i] * sin(phi), 1e-6);
     phi += scan.angle_increment;
@@ -275,13 +468,15 @@ TEST(SegmentationTest, performSegmentation) {
   // and the distance between points is 1.0
   EXPECT_EQ(clusters.size(), 3);
   // Check the number of points in the cluster
+  // All the clusters are ranges of the same points
   for (const auto & cluster : clusters) {
     EXPECT_EQ(cluster.size(), 1);
+    EXPECT_EQ(cluster.scan_points, clusters.front().scan_points);
   }
   // Check the points in the cluster
   phi = scan.angle_min;
   for (size_t i = 0; i < clusters.size(); i++) {
-    auto point = clusters[i].cloud.points[0];
+    auto point = clusters[i].data()[0];
     EXPECT_NEAR(point.x, scan.ranges[i] * cos(phi), 1e-6);
     EXPECT_NEAR(point.y, scan.ranges[i] * sin(phi), 1e-6);
     phi += scan.angle_increment;
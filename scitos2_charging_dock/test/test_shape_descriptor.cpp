@@ -0,0 +1,102 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+#include "scitos2_charging_dock/shape_descriptor.hpp"
+
+using scitos2_charging_dock::Pcloud;
+using scitos2_charging_dock::ShapeDescriptor;
+
+// A V-shaped profile similar to the docking station, sampled every step meters
+Pcloud createDock(float step, float x = 0.0f, float y = 0.0f, float yaw = 0.0f)
+{
+  Pcloud cloud;
+  for (float py = -0.2f; py <= 0.2f + 1e-6f; py += step) {
+    float px = 0.5f * std::abs(py);
+    cloud.push_back(
+      pcl::PointXYZ(
+        std::cos(yaw) * px - std::sin(yaw) * py + x,
+        std::sin(yaw) * px + std::cos(yaw) * py + y, 0.0f));
+  }
+  return cloud;
+}
+
+TEST(ScitosDockingShapeDescriptor, empty) {
+  ShapeDescriptor descriptor(Pcloud{});
+  EXPECT_DOUBLE_EQ(descriptor.major_extent, 0.0);
+  EXPECT_DOUBLE_EQ(descriptor.minor_extent, 0.0);
+  for (const auto & angle : descriptor.turning_function) {
+    EXPECT_DOUBLE_EQ(angle, 0.0);
+  }
+}
+
+TEST(ScitosDockingShapeDescriptor, extents) {
+  ShapeDescriptor descriptor(createDock(0.01f));
+  EXPECT_NEAR(descriptor.major_extent, 0.4, 1e-3);
+  EXPECT_NEAR(descriptor.minor_extent, 0.1, 1e-3);
+
+  // The arms of the V turn to opposite sides of the chord
+  const double arm_angle = std::atan2(0.1, 0.2);
+  EXPECT_NEAR(descriptor.turning_function.front(), arm_angle, 1e-3);
+  EXPECT_NEAR(descriptor.turning_function.back(), -arm_angle, 1e-3);
+}
+
+TEST(ScitosDockingShapeDescriptor, invariance) {
+  ShapeDescriptor descriptor(createDock(0.01f));
+
+  // Same shape moved, rotated and with a different density of points
+  ShapeDescriptor moved(createDock(0.025f, 1.5f, -0.7f, 0.8f));
+  EXPECT_NEAR(moved.major_extent, descriptor.major_extent, 0.01);
+  EXPECT_NEAR(moved.minor_extent, descriptor.minor_extent, 0.01);
+  EXPECT_LT(descriptor.turningDistance(moved), 0.05);
+  EXPECT_TRUE(descriptor.matches(moved, 0.05, 0.3));
+}
+
+TEST(ScitosDockingShapeDescriptor, rejectOtherShapes) {
+  ShapeDescriptor descriptor(createDock(0.01f));
+
+  // A flat wall of the same width
+  Pcloud wall;
+  for (int i = -20; i <= 20; i++) {
+    wall.push_back(pcl::PointXYZ(0.0f, 0.01f * i, 0.0f));
+  }
+  ShapeDescriptor wall_descriptor(wall);
+  EXPECT_NEAR(wall_descriptor.minor_extent, 0.0, 1e-6);
+  EXPECT_FALSE(descriptor.matches(wall_descriptor, 0.05, 0.3));
+
+  // The corner of a box, the extents are similar but it bends the other way
+  Pcloud box;
+  for (int i = -20; i <= 20; i++) {
+    box.push_back(pcl::PointXYZ(0.1f - 0.005f * std::abs(i), 0.01f * i, 0.0f));
+  }
+  ShapeDescriptor box_descriptor(box);
+  EXPECT_NEAR(box_descriptor.minor_extent, descriptor.minor_extent, 0.01);
+  EXPECT_GT(descriptor.turningDistance(box_descriptor), 0.3);
+  EXPECT_FALSE(descriptor.matches(box_descriptor, 0.05, 0.3));
+
+  // A wider object
+  ShapeDescriptor wide(createDock(0.01f, 0.0f, 0.0f, 0.0f));
+  wide.major_extent *= 2.0;
+  EXPECT_FALSE(descriptor.matches(wide, 0.05, 0.3));
+}
+
+int main(int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  bool success = RUN_ALL_TESTS();
+  return success;
+}
@@ -21,14 +21,17 @@
 #include <robot/Odometry.h>
 
 // C++
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 // ROS
 #include "rclcpp/rclcpp.hpp"
 #include "rcl_interfaces/msg/set_parameters_result.hpp"
+#include "geometry_msgs/msg/pose.hpp"
 #include "geometry_msgs/msg/twist.hpp"
 #include "nav_msgs/msg/odometry.hpp"
 #include "tf2_ros/transform_broadcaster.h"
@@ -36,16 +39,19 @@
 
 // SCITOS2
 #include "scitos2_core/module.hpp"
+#include "scitos2_modules/rfid_registry.hpp"
 #include "scitos2_msgs/msg/barrier_status.hpp"
 #include "scitos2_msgs/msg/bumper_status.hpp"
 #include "scitos2_msgs/msg/drive_status.hpp"
 #include "scitos2_msgs/msg/emergency_stop_status.hpp"
 #include "scitos2_msgs/msg/mileage.hpp"
+#include "scitos2_msgs/msg/motor_stop_reset.hpp"
 #include "scitos2_msgs/msg/rfid_tag.hpp"
 #include "scitos2_msgs/srv/change_force.hpp"
 #include "scitos2_msgs/srv/emergency_stop.hpp"
 #include "scitos2_msgs/srv/enable_motors.hpp"
 #include "scitos2_msgs/srv/enable_rfid.hpp"
+#include "scitos2_msgs/srv/get_rfid_tag.hpp"
 #include "scitos2_msgs/srv/reset_barrier_stop.hpp"
 #include "scitos2_msgs/srv/reset_motor_stop.hpp"
 #include "scitos2_msgs/srv/reset_odometry.hpp"
@@ -72,7 +78,7 @@ public:
   /**
    * @brief Destructor for scitos2_modules::Drive
    */
-  ~Drive() override = default;
+  ~Drive() override;
 
   /**
    * @brief Configure the module.
@@ -134,6 +140,11 @@ protected:
    */
   void rfidStatusCallback(mira::ChannelRead<uint64> data);
 
+  /**
+   * @brief Callback executed periodically to detect the RFID tags that have left.
+   */
+  void rfidExpiryCallback();
+
   /**
    * @brief Callback executed when velocity command is received.
    *
@@ -185,6 +196,17 @@ protected:
     const std::shared_ptr<scitos2_msgs::srv::EnableRfid::Request> request,
     std::shared_ptr<scitos2_msgs::srv::EnableRfid::Response> response);
 
+  /**
+   * @brief Get RFID tag service callback.
+   *
+   * @param request Get RFID tag request
+   * @param response Get RFID tag response
+   * @return bool If the request was processed
+   */
+  bool getRfidTag(
+    const std::shared_ptr<scitos2_msgs::srv::GetRfidTag::Request> request,
+    std::shared_ptr<scitos2_msgs::srv::GetRfidTag::Response> response);
+
   /**
    * @brief Reset barrier stop service callback.
    *
@@ -246,12 +268,45 @@ protected:
   inline bool isBarrierCode(uint64 code) {return code == MAGNETIC_BARRIER_RFID_CODE;}
 
   /**
-   * @brief Reset tje motor stop if the bumper is activated after a certain time.
+   * @brief Request a motor stop reset if the bumper is activated after a certain time.
+   * The reset itself is performed asynchronously by the recovery worker.
    *
    * @param current_time Current time
    */
   void resetMotorStopAfterTimeout(rclcpp::Time current_time);
 
+  /**
+   * @brief Queue a motor stop reset in the recovery worker. Only one reset can be
+   * pending at a time, so repeated requests are coalesced into the pending one.
+   *
+   * @return bool True if a new reset was queued, false if it was coalesced
+   */
+  bool requestMotorStopReset();
+
+  /**
+   * @brief Start the thread that performs the motor stop resets.
+   */
+  void startMotorStopResetWorker();
+
+  /**
+   * @brief Stop the thread that performs the motor stop resets.
+   */
+  void stopMotorStopResetWorker();
+
+  /**
+   * @brief Loop of the recovery worker. Waits for reset requests, performs one
+   * reset at a time and applies an exponential backoff after failures.
+   */
+  void motorStopResetLoop();
+
+  /**
+   * @brief Compute the backoff to apply after a number of consecutive failures.
+   *
+   * @param failures Number of consecutive failures
+   * @return rclcpp::Duration Time to wait before the next attempt
+   */
+  rclcpp::Duration computeResetBackoff(unsigned int failures) const;
+
   /**
    * @brief Create the bumper markers.
    *
@@ -316,6 +371,19 @@ protected:
   scitos2_msgs::msg::BarrierStatus miraToRosBarrierStatus(
     const uint64 & status, const mira::Time & timestamp);
 
+  /**
+   * @brief Create a ROS RfidTag event.
+   *
+   * @param tag Value of the tag
+   * @param event Event of the tag (ENTER or LEAVE)
+   * @param stamp Timestamp of the event
+   * @param pose Pose of the robot when the tag was last read
+   * @return scitos2_msgs::msg::RfidTag RfidTag for ROS
+   */
+  scitos2_msgs::msg::RfidTag createRfidTagMsg(
+    const uint64 & tag, uint8_t event, const rclcpp::Time & stamp,
+    const geometry_msgs::msg::Pose & pose);
+
   // MIRA Authority
   std::shared_ptr<mira::Authority> authority_;
 
@@ -340,6 +408,8 @@ protected:
   std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<scitos2_msgs::msg::BarrierStatus>>
   magnetic_barrier_pub_;
   std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<scitos2_msgs::msg::Mileage>> mileage_pub_;
+  std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<scitos2_msgs::msg::MotorStopReset>>
+  motor_stop_reset_pub_;
   std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<nav_msgs::msg::Odometry>> odometry_pub_;
   std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<scitos2_msgs::msg::RfidTag>> rfid_pub_;
 
@@ -350,6 +420,7 @@ protected:
   std::shared_ptr<rclcpp::Service<scitos2_msgs::srv::EmergencyStop>> emergency_stop_service_;
   std::shared_ptr<rclcpp::Service<scitos2_msgs::srv::EnableMotors>> enable_motors_service_;
   std::shared_ptr<rclcpp::Service<scitos2_msgs::srv::EnableRfid>> enable_rfid_service_;
+  std::shared_ptr<rclcpp::Service<scitos2_msgs::srv::GetRfidTag>> get_rfid_tag_service_;
   std::shared_ptr<rclcpp::Service<scitos2_msgs::srv::ResetBarrierStop>> reset_barrier_stop_service_;
   std::shared_ptr<rclcpp::Service<scitos2_msgs::srv::ResetMotorStop>> reset_motor_stop_service_;
   std::shared_ptr<rclcpp::Service<scitos2_msgs::srv::ResetOdometry>> reset_odometry_service_;
@@ -357,6 +428,8 @@ protected:
 
   std::string robot_base_frame_, odom_frame_, odom_topic_;
   bool emergency_stop_activated_;
+  // Written by the MIRA callback and the reset service
+  std::mutex barrier_mutex_;
   scitos2_msgs::msg::BarrierStatus barrier_status_;
   bool is_active_;
 
@@ -364,11 +437,28 @@ protected:
   bool bumper_activated_;
   rclcpp::Time last_bumper_reset_;
   rclcpp::Duration reset_bumper_interval_{0, 0};
+  rclcpp::Duration reset_bumper_max_backoff_{10, 0};
   bool use_radius_{false};
   std::string footprint_;
   double robot_radius_;
   std::vector<geometry_msgs::msg::Point> unpadded_footprint_;
 
+  // Motor stop recovery worker
+  std::thread reset_thread_;
+  std::mutex reset_mutex_;
+  std::condition_variable reset_cv_;
+  bool reset_requested_{false};
+  bool reset_in_flight_{false};
+  bool reset_worker_stop_{false};
+  unsigned int reset_coalesced_requests_{0};
+  unsigned int reset_consecutive_failures_{0};
+
+  // RFID
+  std::mutex rfid_mutex_;
+  RfidTagRegistry rfid_registry_;
+  geometry_msgs::msg::Pose last_odom_pose_;
+  rclcpp::TimerBase::SharedPtr rfid_timer_;
+
   // TF
   std::unique_ptr<tf2_ros::TransformBroadcaster> tf_broadcaster_;
   bool publish_tf_;
@@ -21,8 +21,9 @@
 #include <geometry/Point.h>
 
 // C++
+#include <atomic>
+#include <cstdint>
 #include <memory>
-#include <mutex>
 #include <string>
 
 // ROS
@@ -32,6 +33,7 @@
 
 // SCITOS2
 #include "scitos2_core/module.hpp"
+#include "scitos2_msgs/msg/imu_batch.hpp"
 
 namespace scitos2_modules
 {
@@ -78,7 +80,33 @@ public:
    */
   void deactivate() override;
 
+  /**
+   * @brief Number of IMU messages published.
+   */
+  uint64_t getPublishedSamples() const {return published_samples_;}
+
+  /**
+   * @brief Number of samples ignored because their timestamp was not newer than the last one.
+   */
+  uint64_t getDuplicateSamples() const {return duplicate_samples_;}
+
+  /**
+   * @brief Number of samples discarded because no partner arrived within the tolerance.
+   */
+  uint64_t getDroppedSamples() const {return dropped_samples_;}
+
 protected:
+  /**
+   * @struct ImuSample
+   * @brief Accelerometer or gyroscope sample waiting for its partner.
+   */
+  struct ImuSample
+  {
+    rclcpp::Time stamp;
+    geometry_msgs::msg::Vector3 value;
+    bool valid{false};
+  };
+
   /**
    * @brief Callback for Acceleration data. The units and ranges are +- 2g.
    *
@@ -93,6 +121,60 @@ protected:
    */
   void gyroscopeDataCallback(mira::ChannelRead<mira::Point3f> data);
 
+  /**
+   * @brief Add an acceleration sample and publish it if it pairs with the pending gyroscope.
+   *
+   * @param stamp Timestamp of the sample
+   * @param acceleration Acceleration in m/s^2
+   * @return bool If a complete IMU message was published
+   */
+  bool addAcceleration(
+    const rclcpp::Time & stamp, const geometry_msgs::msg::Vector3 & acceleration);
+
+  /**
+   * @brief Add a gyroscope sample and publish it if it pairs with the pending acceleration.
+   *
+   * @param stamp Timestamp of the sample
+   * @param angular_velocity Angular velocity in rad/s
+   * @return bool If a complete IMU message was published
+   */
+  bool addGyroscope(
+    const rclcpp::Time & stamp, const geometry_msgs::msg::Vector3 & angular_velocity);
+
+  /**
+   * @brief Store a sample and check if it pairs with the pending sample of the other sensor.
+   *
+   * @param sample Pending sample of the sensor
+   * @param last_stamp Timestamp of the last sample of the sensor
+   * @param other Pending sample of the other sensor
+   * @param stamp Timestamp of the new sample
+   * @param value Value of the new sample
+   * @return bool If both pending samples are within the synchronization tolerance
+   */
+  bool storeSample(
+    ImuSample & sample, rclcpp::Time & last_stamp, ImuSample & other,
+    const rclcpp::Time & stamp, const geometry_msgs::msg::Vector3 & value);
+
+  /**
+   * @brief Publish the pending pair of samples as a single IMU message.
+   */
+  void publishSample();
+
+  /**
+   * @brief Append a sample to the batch and publish the batch when it is complete.
+   *
+   * @param imu_msg IMU sample
+   * @return bool If the batch was published
+   */
+  bool addToBatch(const sensor_msgs::msg::Imu & imu_msg);
+
+  /**
+   * @brief Check if the batch mode is enabled.
+   *
+   * @return bool If the samples are also published in batches
+   */
+  inline bool isBatchEnabled() const {return batch_size_ > 0 || batch_period_.nanoseconds() > 0;}
+
   /**
    * @brief Convert MIRA Acceleration Point3f to ROS Vector3.
    *
@@ -116,12 +198,28 @@ protected:
   rclcpp::Logger logger_{rclcpp::get_logger("IMU")};
 
   std::string robot_base_frame_;
+  rclcpp::Duration sync_tolerance_{0, 5000000};
   sensor_msgs::msg::Imu imu_msg_;
-  std::mutex mutex_;
+
+  // Pending samples. They are only accessed from the dispatcher thread of the authority,
+  // which runs the callbacks of all its subscriptions one after the other
+  ImuSample acceleration_sample_, gyroscope_sample_;
+  rclcpp::Time last_acceleration_stamp_, last_gyroscope_stamp_;
+
+  // Statistics
+  std::atomic<uint64_t> published_samples_{0};
+  std::atomic<uint64_t> duplicate_samples_{0};
+  std::atomic<uint64_t> dropped_samples_{0};
+
+  // Batch mode
+  int batch_size_{0};
+  rclcpp::Duration batch_period_{0, 0};
+  std::unique_ptr<scitos2_msgs::msg::ImuBatch> batch_msg_;
 
   std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::Imu>>
   imu_pub_;
-  rclcpp::TimerBase::SharedPtr timer_;
+  std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<scitos2_msgs::msg::ImuBatch>>
+  imu_batch_pub_;
 };
 
 }  // namespace scitos2_modules
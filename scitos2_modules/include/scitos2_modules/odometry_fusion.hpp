@@ -0,0 +1,206 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_MODULES__ODOMETRY_FUSION_HPP_
+#define SCITOS2_MODULES__ODOMETRY_FUSION_HPP_
+
+// MIRA
+#include <fw/Framework.h>
+#include <geometry/Point.h>
+#include <robot/Odometry.h>
+
+// C++
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Eigen
+#include <Eigen/Dense>
+
+// ROS
+#include "rclcpp/rclcpp.hpp"
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "tf2_ros/transform_broadcaster.h"
+
+// SCITOS2
+#include "scitos2_core/module.hpp"
+
+namespace scitos2_modules
+{
+
+/**
+ * @class scitos2_modules::OdometryFusion
+ * @brief Module for fusing the wheel odometry and the gyroscope in the MIRA process.
+ * It runs an extended Kalman filter over the unicycle state [x, y, theta, v, omega],
+ * corrected with the wheel velocities and the yaw rate of the gyroscope.
+ *
+ */
+class OdometryFusion : public scitos2_core::Module
+{
+public:
+  /**
+   * @brief Construct for scitos2_modules::OdometryFusion
+   */
+  OdometryFusion() = default;
+
+  /**
+   * @brief Destructor for scitos2_modules::OdometryFusion
+   */
+  ~OdometryFusion() override = default;
+
+  /**
+   * @brief Configure the module.
+   *
+   * @param parent WeakPtr to node
+   * @param name Name of plugin
+   */
+  void configure(
+    const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, std::string name) override;
+
+  /**
+   * @brief Cleanup the module state machine.
+   */
+  void cleanup() override;
+
+  /**
+   * @brief Activate the module state machine.
+   */
+  void activate() override;
+
+  /**
+   * @brief Deactivate the module state machine.
+   */
+  void deactivate() override;
+
+protected:
+  // Size and indices of the state
+  static constexpr int STATE_SIZE = 5;
+  static constexpr int X = 0;
+  static constexpr int Y = 1;
+  static constexpr int THETA = 2;
+  static constexpr int V = 3;
+  static constexpr int OMEGA = 4;
+
+  using StateVector = Eigen::Matrix<double, STATE_SIZE, 1>;
+  using StateMatrix = Eigen::Matrix<double, STATE_SIZE, STATE_SIZE>;
+
+  /**
+   * @brief Callback executed when the odometry data is received.
+   *
+   * @param data Odometry data
+   */
+  void odometryDataCallback(mira::ChannelRead<mira::robot::Odometry2> data);
+
+  /**
+   * @brief Callback for Gyroscope data. The units and ranges are +- 250 degree/sec.
+   *
+   * @param data Gyroscope data
+   */
+  void gyroscopeDataCallback(mira::ChannelRead<mira::Point3f> data);
+
+  /**
+   * @brief Reset the filter to the origin with unknown velocities.
+   */
+  void resetFilter();
+
+  /**
+   * @brief Propagate the state with the unicycle model up to the given time.
+   * Measurements older than the state are applied without prediction.
+   *
+   * @param stamp Time of the next measurement
+   */
+  void predict(const rclcpp::Time & stamp);
+
+  /**
+   * @brief Correct the state with the velocities of the wheel odometry.
+   *
+   * @param v Linear velocity in m/s
+   * @param omega Angular velocity in rad/s
+   */
+  void updateOdometry(double v, double omega);
+
+  /**
+   * @brief Correct the state with the yaw rate of the gyroscope.
+   *
+   * @param omega Angular velocity in rad/s
+   */
+  void updateGyroscope(double omega);
+
+  /**
+   * @brief Kalman correction for a linear measurement of the state.
+   *
+   * @param z Measurement
+   * @param h Measurement matrix
+   * @param r Measurement covariance
+   */
+  template<int N>
+  void update(
+    const Eigen::Matrix<double, N, 1> & z,
+    const Eigen::Matrix<double, N, STATE_SIZE> & h,
+    const Eigen::Matrix<double, N, N> & r)
+  {
+    const Eigen::Matrix<double, N, 1> y = z - h * state_;
+    const Eigen::Matrix<double, N, N> s = h * covariance_ * h.transpose() + r;
+    const Eigen::Matrix<double, STATE_SIZE, N> k =
+      covariance_ * h.transpose() * s.inverse();
+    state_ += k * y;
+    // Joseph form keeps the covariance symmetric and positive definite
+    const StateMatrix i_kh = StateMatrix::Identity() - k * h;
+    covariance_ = i_kh * covariance_ * i_kh.transpose() + k * r * k.transpose();
+  }
+
+  /**
+   * @brief Convert the state of the filter to ROS Odometry.
+   *
+   * @param stamp Timestamp of the state
+   * @return nav_msgs::msg::Odometry Odometry for ROS
+   */
+  nav_msgs::msg::Odometry stateToRosOdometry(const rclcpp::Time & stamp);
+
+  /**
+   * @brief Convert the state of the filter to ROS TF.
+   *
+   * @param stamp Timestamp of the state
+   * @return geometry_msgs::msg::TransformStamped Transform for ROS
+   */
+  geometry_msgs::msg::TransformStamped stateToRosTf(const rclcpp::Time & stamp);
+
+  // MIRA Authority
+  std::shared_ptr<mira::Authority> authority_;
+
+  std::string plugin_name_;
+  rclcpp::Logger logger_{rclcpp::get_logger("OdometryFusion")};
+
+  std::string robot_base_frame_, odom_frame_, odom_topic_;
+  bool publish_tf_;
+
+  // Filter
+  std::mutex mutex_;
+  StateVector state_;
+  StateMatrix covariance_;
+  StateMatrix process_noise_;
+  Eigen::Matrix2d odometry_noise_;
+  Eigen::Matrix<double, 1, 1> gyroscope_noise_;
+  rclcpp::Time last_stamp_;
+  bool initialized_{false};
+
+  std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<nav_msgs::msg::Odometry>> odometry_pub_;
+  std::unique_ptr<tf2_ros::TransformBroadcaster> tf_broadcaster_;
+};
+
+}  // namespace scitos2_modules
+
+#endif  // SCITOS2_MODULES__ODOMETRY_FUSION_HPP_
@@ -0,0 +1,134 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCITOS2_MODULES__RFID_REGISTRY_HPP_
+#define SCITOS2_MODULES__RFID_REGISTRY_HPP_
+
+// C++
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ROS
+#include "rclcpp/rclcpp.hpp"
+#include "geometry_msgs/msg/pose.hpp"
+
+namespace scitos2_modules
+{
+
+/**
+ * @struct scitos2_modules::RfidTagRecord
+ * @brief Last known state of a RFID tag.
+ */
+struct RfidTagRecord
+{
+  rclcpp::Time first_seen;
+  rclcpp::Time last_seen;
+  geometry_msgs::msg::Pose pose;
+  bool present{false};
+};
+
+/**
+ * @class scitos2_modules::RfidTagRegistry
+ * @brief Index from tag value to the last time and pose it was read. Repeated reads
+ * of a tag are debounced: a tag enters when it is first read and leaves when it has
+ * not been read for the debounce interval.
+ */
+class RfidTagRegistry
+{
+public:
+  /**
+   * @brief Construct for scitos2_modules::RfidTagRegistry
+   *
+   * @param debounce_interval Time without reads after which a tag leaves
+   */
+  explicit RfidTagRegistry(const rclcpp::Duration & debounce_interval = rclcpp::Duration(1, 0))
+  : debounce_interval_(debounce_interval) {}
+
+  /**
+   * @brief Set the debounce interval.
+   *
+   * @param debounce_interval Time without reads after which a tag leaves
+   */
+  void setDebounceInterval(const rclcpp::Duration & debounce_interval)
+  {
+    debounce_interval_ = debounce_interval;
+  }
+
+  /**
+   * @brief Register a read of a tag.
+   *
+   * @param tag Value of the tag
+   * @param stamp Time of the read
+   * @param pose Pose of the robot when the tag was read
+   * @return bool True if the tag has just entered, false if it was already present
+   */
+  bool update(uint64_t tag, const rclcpp::Time & stamp, const geometry_msgs::msg::Pose & pose)
+  {
+    auto & record = tags_[tag];
+    bool entered = !record.present;
+    if (entered) {
+      record.first_seen = stamp;
+      record.present = true;
+    }
+    record.last_seen = stamp;
+    record.pose = pose;
+    return entered;
+  }
+
+  /**
+   * @brief Mark as left the tags that have not been read for the debounce interval.
+   *
+   * @param now Current time
+   * @return std::vector<std::pair<uint64_t, RfidTagRecord>> Tags that have just left
+   */
+  std::vector<std::pair<uint64_t, RfidTagRecord>> expire(const rclcpp::Time & now)
+  {
+    std::vector<std::pair<uint64_t, RfidTagRecord>> left;
+    for (auto & [tag, record] : tags_) {
+      if (record.present && (now - record.last_seen) > debounce_interval_) {
+        record.present = false;
+        left.emplace_back(tag, record);
+      }
+    }
+    return left;
+  }
+
+  /**
+   * @brief Find the record of a tag.
+   *
+   * @param tag Value of the tag
+   * @return const RfidTagRecord* Record of the tag or nullptr if it has never been read
+   */
+  const RfidTagRecord * find(uint64_t tag) const
+  {
+    auto it = tags_.find(tag);
+    return it != tags_.end() ? &it->second : nullptr;
+  }
+
+  /**
+   * @brief Number of tags that have ever been read.
+   */
+  size_t size() const {return tags_.size();}
+
+protected:
+  rclcpp::Duration debounce_interval_;
+  std::unordered_map<uint64_t, RfidTagRecord> tags_;
+};
+
+}  // namespace scitos2_modules
+
+#endif  // SCITOS2_MODULES__RFID_REGISTRY_HPP_
@@ -13,6 +13,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// C++
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
 // TF2
 #include <tf2/LinearMath/Quaternion.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
@@ -30,6 +35,17 @@ using rcl_interfaces::msg::ParameterType;
 using std::placeholders::_1;
 using std::placeholders::_2;
 
+// Minimum backoff applied after a failed motor stop reset
+static const rclcpp::Duration MIN_RESET_BACKOFF = rclcpp::Duration::from_seconds(0.1);
+
+// Period of the check for RFID tags that have left
+static const std::chrono::milliseconds RFID_EXPIRY_PERIOD(100);
+
+Drive::~Drive()
+{
+  stopMotorStopResetWorker();
+}
+
 void Drive::configure(const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, std::string name)
 {
   // Declare and read parameters
@@ -94,6 +110,24 @@ void Drive::configure(const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, s
   RCLCPP_INFO(logger_, "The parameter reset_bumper_interval is set to: [%i]", rbi);
   reset_bumper_interval_ = rclcpp::Duration::from_seconds(rbi / 1000.0);
 
+  int rbmb = 10000;
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".reset_bumper_max_backoff",
+    rclcpp::ParameterValue(10000), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The maximum backoff in milliseconds after failed motor stop resets"));
+  node->get_parameter(plugin_name_ + ".reset_bumper_max_backoff", rbmb);
+  RCLCPP_INFO(logger_, "The parameter reset_bumper_max_backoff is set to: [%i]", rbmb);
+  reset_bumper_max_backoff_ = rclcpp::Duration::from_seconds(rbmb / 1000.0);
+
+  int rdi = 1000;
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".rfid_debounce_interval",
+    rclcpp::ParameterValue(1000), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The time in milliseconds without reads after which a RFID tag leaves"));
+  node->get_parameter(plugin_name_ + ".rfid_debounce_interval", rdi);
+  RCLCPP_INFO(logger_, "The parameter rfid_debounce_interval is set to: [%i]", rdi);
+  rfid_registry_.setDebounceInterval(rclcpp::Duration::from_seconds(rdi / 1000.0));
+
   set_mira_param(
     authority_, "MainControlUnit.RearLaser.Enabled", magnetic_barrier_enabled ? "true" : "false");
 
@@ -140,6 +174,8 @@ void Drive::configure(const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, s
   magnetic_barrier_pub_ = node->create_publisher<scitos2_msgs::msg::BarrierStatus>(
     "barrier_status", latched_profile);
   mileage_pub_ = node->create_publisher<scitos2_msgs::msg::Mileage>("mileage", 20);
+  motor_stop_reset_pub_ = node->create_publisher<scitos2_msgs::msg::MotorStopReset>(
+    "motor_stop_reset", 20);
   odometry_pub_ = node->create_publisher<nav_msgs::msg::Odometry>(odom_topic_, 10);
   rfid_pub_ = node->create_publisher<scitos2_msgs::msg::RfidTag>("rfid", 20);
 
@@ -168,6 +204,8 @@ void Drive::configure(const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, s
     "drive/enable_motors", std::bind(&Drive::enableMotors, this, _1, _2));
   enable_rfid_service_ = node->create_service<scitos2_msgs::srv::EnableRfid>(
     "drive/enable_rfid", std::bind(&Drive::enableRfid, this, _1, _2));
+  get_rfid_tag_service_ = node->create_service<scitos2_msgs::srv::GetRfidTag>(
+    "drive/get_rfid_tag", std::bind(&Drive::getRfidTag, this, _1, _2));
   reset_barrier_stop_service_ = node->create_service<scitos2_msgs::srv::ResetBarrierStop>(
     "drive/reset_barrier_stop", std::bind(&Drive::resetBarrierStop, this, _1, _2));
   reset_motor_stop_service_ = node->create_service<scitos2_msgs::srv::ResetMotorStop>(
@@ -177,6 +215,10 @@ void Drive::configure(const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, s
   suspend_bumper_service_ = node->create_service<scitos2_msgs::srv::SuspendBumper>(
     "drive/suspend_bumper", std::bind(&Drive::suspendBumper, this, _1, _2));
 
+  // Create the timer to detect the RFID tags that have left
+  rfid_timer_ = node->create_wall_timer(
+    RFID_EXPIRY_PERIOD, std::bind(&Drive::rfidExpiryCallback, this));
+
   // Callback for monitor changes in parameters
   dyn_params_handler_ = node->add_on_set_parameters_callback(
     std::bind(&Drive::dynamicParametersCallback, this, _1));
@@ -202,16 +244,19 @@ void Drive::cleanup()
   emergency_stop_pub_.reset();
   magnetic_barrier_pub_.reset();
   mileage_pub_.reset();
+  motor_stop_reset_pub_.reset();
   odometry_pub_.reset();
   rfid_pub_.reset();
   change_force_service_.reset();
   emergency_stop_service_.reset();
   enable_motors_service_.reset();
   enable_rfid_service_.reset();
+  get_rfid_tag_service_.reset();
   reset_barrier_stop_service_.reset();
   reset_motor_stop_service_.reset();
   reset_odometry_service_.reset();
   suspend_bumper_service_.reset();
+  rfid_timer_.reset();
   tf_broadcaster_.reset();
 }
 
@@ -225,9 +270,12 @@ void Drive::activate()
   emergency_stop_pub_->on_activate();
   magnetic_barrier_pub_->on_activate();
   mileage_pub_->on_activate();
+  motor_stop_reset_pub_->on_activate();
   odometry_pub_->on_activate();
   rfid_pub_->on_activate();
 
+  startMotorStopResetWorker();
+
   try {
     authority_->start();
     is_active_ = true;
@@ -241,6 +289,7 @@ void Drive::deactivate()
 {
   RCLCPP_INFO(
     logger_, "Deactivating module : %s of type scitos2_module::Drive", plugin_name_.c_str());
+  stopMotorStopResetWorker();
   authority_->checkout();
   bumper_pub_->on_deactivate();
   bumper_markers_pub_->on_deactivate();
@@ -248,6 +297,7 @@ void Drive::deactivate()
   emergency_stop_pub_->on_deactivate();
   magnetic_barrier_pub_->on_deactivate();
   mileage_pub_->on_deactivate();
+  motor_stop_reset_pub_->on_deactivate();
   odometry_pub_->on_deactivate();
   rfid_pub_->on_deactivate();
   is_active_ = false;
@@ -287,8 +337,19 @@ rcl_interfaces::msg::SetParametersResult Drive::dynamicParametersCallback(
     } else if (type == ParameterType::PARAMETER_INTEGER) {
       if (name == plugin_name_ + ".reset_bumper_interval") {
         int rbi = parameter.as_int();
+        std::lock_guard<std::mutex> lock_reset(reset_mutex_);
         reset_bumper_interval_ = rclcpp::Duration::from_seconds(rbi / 1000.0);
         RCLCPP_INFO(logger_, "The parameter reset_bumper_interval is set to: [%i]", rbi);
+      } else if (name == plugin_name_ + ".reset_bumper_max_backoff") {
+        int rbmb = parameter.as_int();
+        std::lock_guard<std::mutex> lock_reset(reset_mutex_);
+        reset_bumper_max_backoff_ = rclcpp::Duration::from_seconds(rbmb / 1000.0);
+        RCLCPP_INFO(logger_, "The parameter reset_bumper_max_backoff is set to: [%i]", rbmb);
+      } else if (name == plugin_name_ + ".rfid_debounce_interval") {
+        int rdi = parameter.as_int();
+        std::lock_guard<std::mutex> lock_rfid(rfid_mutex_);
+        rfid_registry_.setDebounceInterval(rclcpp::Duration::from_seconds(rdi / 1000.0));
+        RCLCPP_INFO(logger_, "The parameter rfid_debounce_interval is set to: [%i]", rdi);
       }
     }
   }
@@ -302,6 +363,12 @@ void Drive::odometryDataCallback(mira::ChannelRead<mira::robot::Odometry2> data)
   auto odom_msg = miraToRosOdometry(data->value(), data->timestamp);
   odometry_pub_->publish(odom_msg);
 
+  // Keep the pose to tag the RFID reads
+  {
+    std::lock_guard<std::mutex> lock_rfid(rfid_mutex_);
+    last_odom_pose_ = odom_msg.pose.pose;
+  }
+
   // Publish the TF
   if (publish_tf_) {
     auto tf_msg = miraToRosTf(data->value(), data->timestamp);
@@ -357,14 +424,51 @@ void Drive::driveStatusCallback(mira::ChannelRead<uint32> data)
 
 void Drive::rfidStatusCallback(mira::ChannelRead<uint64> data)
 {
+  rclcpp::Time stamp = rclcpp::Time(data->timestamp.toUnixNS());
+
+  geometry_msgs::msg::Pose pose;
+  bool entered;
+  {
+    std::lock_guard<std::mutex> lock_rfid(rfid_mutex_);
+    pose = last_odom_pose_;
+    entered = rfid_registry_.update(data->value(), stamp, pose);
+  }
+
+  // Repeated reads of a tag already in range only refresh the registry
+  if (!entered) {
+    return;
+  }
+
   if (isBarrierCode(data->value())) {
     auto barrier_status = miraToRosBarrierStatus(data->value(), data->timestamp);
-    magnetic_barrier_pub_->publish(barrier_status_);
+    {
+      std::lock_guard<std::mutex> lock_barrier(barrier_mutex_);
+      barrier_status_ = barrier_status;
+    }
+    magnetic_barrier_pub_->publish(barrier_status);
   }
 
-  scitos2_msgs::msg::RfidTag tag_msg;
-  tag_msg.tag = data->value();
-  rfid_pub_->publish(tag_msg);
+  rfid_pub_->publish(
+    createRfidTagMsg(data->value(), scitos2_msgs::msg::RfidTag::ENTER, stamp, pose));
+}
+
+void Drive::rfidExpiryCallback()
+{
+  if (!is_active_) {
+    return;
+  }
+
+  // The reads are stamped with the MIRA clock, so the expiry uses the same clock
+  std::vector<std::pair<uint64_t, RfidTagRecord>> left;
+  {
+    std::lock_guard<std::mutex> lock_rfid(rfid_mutex_);
+    left = rfid_registry_.expire(rclcpp::Time(mira::Time::now().toUnixNS()));
+  }
+
+  for (const auto & [tag, record] : left) {
+    rfid_pub_->publish(
+      createRfidTagMsg(tag, scitos2_msgs::msg::RfidTag::LEAVE, record.last_seen, record.pose));
+  }
 }
 
 void Drive::velocityCommandCallback(const geometry_msgs::msg::Twist & msg)
@@ -404,14 +508,35 @@ bool Drive::enableRfid(
     authority_, "MainControlUnit.RearLaser.Enabled", request->enable ? "true" : "false");
 }
 
+bool Drive::getRfidTag(
+  const std::shared_ptr<scitos2_msgs::srv::GetRfidTag::Request> request,
+  std::shared_ptr<scitos2_msgs::srv::GetRfidTag::Response> response)
+{
+  std::lock_guard<std::mutex> lock_rfid(rfid_mutex_);
+  const auto * record = rfid_registry_.find(request->tag);
+  response->found = record != nullptr;
+  if (record) {
+    response->present = record->present;
+    response->last_seen = record->last_seen;
+    response->pose = record->pose;
+  }
+  return true;
+}
+
 bool Drive::resetBarrierStop(
   const std::shared_ptr<scitos2_msgs::srv::ResetBarrierStop::Request> request,
   std::shared_ptr<scitos2_msgs::srv::ResetBarrierStop::Response> response)
 {
-  barrier_status_.header.frame_id = robot_base_frame_;
-  barrier_status_.header.stamp = clock_->now();
-  barrier_status_.barrier_stopped = false;
-  magnetic_barrier_pub_->publish(barrier_status_);
+  // The status is also written by the MIRA callback, so it is published from a copy
+  scitos2_msgs::msg::BarrierStatus barrier_status;
+  {
+    std::lock_guard<std::mutex> lock_barrier(barrier_mutex_);
+    barrier_status_.header.frame_id = robot_base_frame_;
+    barrier_status_.header.stamp = clock_->now();
+    barrier_status_.barrier_stopped = false;
+    barrier_status = barrier_status_;
+  }
+  magnetic_barrier_pub_->publish(barrier_status);
   return true;
 }
 
@@ -488,12 +613,126 @@ bool Drive::isEmergencyStopReleased(scitos2_msgs::msg::EmergencyStopStatus msg)
 
 void Drive::resetMotorStopAfterTimeout(rclcpp::Time current_time)
 {
-  if (bumper_activated_ && (current_time - last_bumper_reset_) > reset_bumper_interval_) {
-    call_mira_service(authority_, "resetMotorStop");
+  // The interval is shared with the parameter callback and the recovery worker
+  rclcpp::Duration reset_bumper_interval(0, 0);
+  {
+    std::lock_guard<std::mutex> lock_reset(reset_mutex_);
+    reset_bumper_interval = reset_bumper_interval_;
+  }
+  if (bumper_activated_ && (current_time - last_bumper_reset_) > reset_bumper_interval) {
+    requestMotorStopReset();
     last_bumper_reset_ = current_time;
   }
 }
 
+bool Drive::requestMotorStopReset()
+{
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock_reset(reset_mutex_);
+    if (reset_requested_) {
+      reset_coalesced_requests_++;
+    } else {
+      reset_requested_ = true;
+      reset_coalesced_requests_ = 1;
+      queued = true;
+    }
+  }
+  reset_cv_.notify_one();
+  return queued;
+}
+
+void Drive::startMotorStopResetWorker()
+{
+  stopMotorStopResetWorker();
+  {
+    std::lock_guard<std::mutex> lock_reset(reset_mutex_);
+    reset_worker_stop_ = false;
+    reset_requested_ = false;
+    reset_consecutive_failures_ = 0;
+  }
+  reset_thread_ = std::thread(&Drive::motorStopResetLoop, this);
+}
+
+void Drive::stopMotorStopResetWorker()
+{
+  {
+    std::lock_guard<std::mutex> lock_reset(reset_mutex_);
+    reset_worker_stop_ = true;
+  }
+  reset_cv_.notify_all();
+  if (reset_thread_.joinable()) {
+    reset_thread_.join();
+  }
+}
+
+void Drive::motorStopResetLoop()
+{
+  std::unique_lock<std::mutex> lock_reset(reset_mutex_);
+  while (!reset_worker_stop_) {
+    reset_cv_.wait(lock_reset, [this]() {return reset_worker_stop_ || reset_requested_;});
+    if (reset_worker_stop_) {
+      break;
+    }
+
+    // Wait for the backoff of the previous failures. New requests arriving meanwhile are
+    // coalesced into the pending one
+    auto backoff = computeResetBackoff(reset_consecutive_failures_);
+    if (reset_cv_.wait_for(
+        lock_reset, backoff.to_chrono<std::chrono::nanoseconds>(),
+        [this]() {return reset_worker_stop_;}))
+    {
+      break;
+    }
+
+    // Take the pending request. Only one reset is in flight at any time
+    reset_requested_ = false;
+    reset_in_flight_ = true;
+    unsigned int coalesced = reset_coalesced_requests_;
+    reset_coalesced_requests_ = 0;
+
+    // Do not hold the lock during the RPC so the bumper callback never blocks
+    lock_reset.unlock();
+    bool success = call_mira_service(authority_, "resetMotorStop");
+    lock_reset.lock();
+
+    reset_in_flight_ = false;
+    reset_consecutive_failures_ = success ? 0 : reset_consecutive_failures_ + 1;
+
+    scitos2_msgs::msg::MotorStopReset reset_msg;
+    reset_msg.header.frame_id = robot_base_frame_;
+    reset_msg.header.stamp = clock_->now();
+    reset_msg.success = success;
+    reset_msg.coalesced_requests = coalesced;
+    reset_msg.consecutive_failures = reset_consecutive_failures_;
+    reset_msg.backoff = computeResetBackoff(reset_consecutive_failures_);
+    motor_stop_reset_pub_->publish(reset_msg);
+
+    // The worker does not retry on its own, the next request of the bumper waits the backoff
+    if (!success) {
+      RCLCPP_WARN(
+        logger_,
+        "Failed to reset the motor stop (%u consecutive failures). The next reset waits %f s",
+        reset_consecutive_failures_, reset_msg.backoff.sec + reset_msg.backoff.nanosec * 1e-9);
+    }
+  }
+}
+
+rclcpp::Duration Drive::computeResetBackoff(unsigned int failures) const
+{
+  if (failures == 0) {
+    return rclcpp::Duration(0, 0);
+  }
+
+  // Exponential backoff starting at the reset interval and capped at the maximum backoff
+  auto base = std::max(reset_bumper_interval_, MIN_RESET_BACKOFF);
+  auto backoff = base;
+  for (unsigned int i = 1; i < failures && backoff < reset_bumper_max_backoff_; i++) {
+    backoff = backoff * 2.0;
+  }
+  return std::min(backoff, reset_bumper_max_backoff_);
+}
+
 nav_msgs::msg::Odometry Drive::miraToRosOdometry(
   const mira::robot::Odometry2 & odometry, const mira::Time & timestamp)
 {
@@ -573,6 +812,19 @@ scitos2_msgs::msg::BarrierStatus Drive::miraToRosBarrierStatus(
   return barrier;
 }
 
+scitos2_msgs::msg::RfidTag Drive::createRfidTagMsg(
+  const uint64 & tag, uint8_t event, const rclcpp::Time & stamp,
+  const geometry_msgs::msg::Pose & pose)
+{
+  scitos2_msgs::msg::RfidTag tag_msg;
+  tag_msg.header.frame_id = odom_frame_;
+  tag_msg.header.stamp = stamp;
+  tag_msg.tag = tag;
+  tag_msg.event = event;
+  tag_msg.pose = pose;
+  return tag_msg;
+}
+
 }  // namespace scitos2_modules
 
 #include "pluginlib/class_list_macros.hpp"  // NOLINT
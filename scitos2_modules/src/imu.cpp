@@ -14,7 +14,10 @@
 // limitations under the License.
 
 // C++
+#include <algorithm>
+#include <cstdlib>
 #include <limits>
+#include <utility>
 
 #include "scitos2_modules/imu.hpp"
 
@@ -46,8 +49,37 @@ void IMU::configure(
   node->get_parameter(plugin_name_ + ".robot_base_frame", robot_base_frame_);
   RCLCPP_INFO(logger_, "The parameter robot_base_frame is set to: [%s]", robot_base_frame_.c_str());
 
+  int sync_tolerance = 5;
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".sync_tolerance",
+    rclcpp::ParameterValue(5), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description(
+      "The maximum time difference in milliseconds to pair acceleration and gyroscope samples"));
+  node->get_parameter(plugin_name_ + ".sync_tolerance", sync_tolerance);
+  RCLCPP_INFO(logger_, "The parameter sync_tolerance is set to: [%i]", sync_tolerance);
+  sync_tolerance_ = rclcpp::Duration::from_seconds(sync_tolerance / 1000.0);
+
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".batch_size",
+    rclcpp::ParameterValue(0), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The number of samples of each batch. Zero disables the limit"));
+  node->get_parameter(plugin_name_ + ".batch_size", batch_size_);
+  RCLCPP_INFO(logger_, "The parameter batch_size is set to: [%i]", batch_size_);
+
+  int batch_period = 0;
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".batch_period",
+    rclcpp::ParameterValue(0), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The time in milliseconds covered by each batch. Zero disables the limit"));
+  node->get_parameter(plugin_name_ + ".batch_period", batch_period);
+  RCLCPP_INFO(logger_, "The parameter batch_period is set to: [%i]", batch_period);
+  batch_period_ = rclcpp::Duration::from_seconds(batch_period / 1000.0);
+
   // Create ROS publishers
   imu_pub_ = node->create_publisher<sensor_msgs::msg::Imu>("imu", 1);
+  if (isBatchEnabled()) {
+    imu_batch_pub_ = node->create_publisher<scitos2_msgs::msg::ImuBatch>("imu/batch", 10);
+  }
 
   // Create MIRA subscribers
   authority_->subscribe<mira::Point3f>(
@@ -61,12 +93,6 @@ void IMU::configure(
   imu_msg_.header.frame_id = robot_base_frame_;
   imu_msg_.orientation_covariance[0] = -1;
   imu_msg_.angular_velocity_covariance[0] = -1;
-
-  timer_ = node->create_wall_timer(
-    std::chrono::milliseconds(10), [this]() {
-      std::lock_guard<std::mutex> lock_data(mutex_);
-      imu_pub_->publish(imu_msg_);
-    });
 }
 
 void IMU::cleanup()
@@ -75,7 +101,8 @@ void IMU::cleanup()
     logger_, "Cleaning up module : %s of type scitos2_module::IMU", plugin_name_.c_str());
   authority_.reset();
   imu_pub_.reset();
-  timer_.reset();
+  imu_batch_pub_.reset();
+  batch_msg_.reset();
 }
 
 void IMU::activate()
@@ -83,6 +110,9 @@ void IMU::activate()
   RCLCPP_INFO(
     logger_, "Activating module : %s of type scitos2_module::IMU", plugin_name_.c_str());
   imu_pub_->on_activate();
+  if (imu_batch_pub_) {
+    imu_batch_pub_->on_activate();
+  }
 
   try {
     authority_->start();
@@ -98,21 +128,132 @@ void IMU::deactivate()
     logger_, "Deactivating module : %s of type scitos2_module::IMU", plugin_name_.c_str());
   authority_->checkout();
   imu_pub_->on_deactivate();
-  timer_.reset();
+  if (imu_batch_pub_) {
+    imu_batch_pub_->on_deactivate();
+  }
+
+  // No callback is running after the checkout, so the pending samples can be discarded
+  acceleration_sample_.valid = false;
+  gyroscope_sample_.valid = false;
+  batch_msg_.reset();
 }
 
 void IMU::accelerationDataCallback(mira::ChannelRead<mira::Point3f> data)
 {
-  std::lock_guard<std::mutex> lock_data(mutex_);
-  imu_msg_.header.stamp = rclcpp::Time(data->timestamp.toUnixNS());
-  imu_msg_.linear_acceleration = miraToRosAcceleration(*data);
+  addAcceleration(rclcpp::Time(data->timestamp.toUnixNS()), miraToRosAcceleration(*data));
 }
 
 void IMU::gyroscopeDataCallback(mira::ChannelRead<mira::Point3f> data)
 {
-  std::lock_guard<std::mutex> lock_data(mutex_);
-  imu_msg_.header.stamp = rclcpp::Time(data->timestamp.toUnixNS());
-  imu_msg_.angular_velocity = miraToRosGyroscope(*data);
+  addGyroscope(rclcpp::Time(data->timestamp.toUnixNS()), miraToRosGyroscope(*data));
+}
+
+bool IMU::addAcceleration(
+  const rclcpp::Time & stamp, const geometry_msgs::msg::Vector3 & acceleration)
+{
+  if (!storeSample(
+      acceleration_sample_, last_acceleration_stamp_, gyroscope_sample_, stamp, acceleration))
+  {
+    return false;
+  }
+  publishSample();
+  return true;
+}
+
+bool IMU::addGyroscope(
+  const rclcpp::Time & stamp, const geometry_msgs::msg::Vector3 & angular_velocity)
+{
+  if (!storeSample(
+      gyroscope_sample_, last_gyroscope_stamp_, acceleration_sample_, stamp, angular_velocity))
+  {
+    return false;
+  }
+  publishSample();
+  return true;
+}
+
+bool IMU::storeSample(
+  ImuSample & sample, rclcpp::Time & last_stamp, ImuSample & other,
+  const rclcpp::Time & stamp, const geometry_msgs::msg::Vector3 & value)
+{
+  // Samples repeated or out of order are published only once
+  if (stamp <= last_stamp) {
+    duplicate_samples_++;
+    return false;
+  }
+  last_stamp = stamp;
+
+  // The previous sample of this sensor never found its partner
+  if (sample.valid) {
+    dropped_samples_++;
+  }
+  sample.stamp = stamp;
+  sample.value = value;
+  sample.valid = true;
+
+  if (!other.valid) {
+    return false;
+  }
+
+  if (std::llabs((stamp - other.stamp).nanoseconds()) <= sync_tolerance_.nanoseconds()) {
+    return true;
+  }
+
+  // The oldest sample cannot be paired with this one nor with any later one
+  if (other.stamp < stamp) {
+    other.valid = false;
+  } else {
+    sample.valid = false;
+  }
+  dropped_samples_++;
+  return false;
+}
+
+void IMU::publishSample()
+{
+  auto imu_msg = std::make_unique<sensor_msgs::msg::Imu>(imu_msg_);
+  imu_msg->header.stamp = std::max(acceleration_sample_.stamp, gyroscope_sample_.stamp);
+  imu_msg->linear_acceleration = acceleration_sample_.value;
+  imu_msg->angular_velocity = gyroscope_sample_.value;
+  acceleration_sample_.valid = false;
+  gyroscope_sample_.valid = false;
+
+  if (imu_batch_pub_) {
+    addToBatch(*imu_msg);
+  }
+
+  imu_pub_->publish(std::move(imu_msg));
+  published_samples_++;
+}
+
+bool IMU::addToBatch(const sensor_msgs::msg::Imu & imu_msg)
+{
+  if (!batch_msg_) {
+    batch_msg_ = std::make_unique<scitos2_msgs::msg::ImuBatch>();
+    batch_msg_->header.frame_id = robot_base_frame_;
+    batch_msg_->header.stamp = imu_msg.header.stamp;
+    if (batch_size_ > 0) {
+      batch_msg_->stamps.reserve(batch_size_);
+      batch_msg_->linear_acceleration.reserve(batch_size_);
+      batch_msg_->angular_velocity.reserve(batch_size_);
+    }
+  }
+
+  batch_msg_->stamps.push_back(imu_msg.header.stamp);
+  batch_msg_->linear_acceleration.push_back(imu_msg.linear_acceleration);
+  batch_msg_->angular_velocity.push_back(imu_msg.angular_velocity);
+
+  // The batch is complete when it reaches either the size or the period
+  const bool full = batch_size_ > 0 &&
+    batch_msg_->stamps.size() >= static_cast<size_t>(batch_size_);
+  const bool expired = batch_period_.nanoseconds() > 0 &&
+    rclcpp::Time(imu_msg.header.stamp) - rclcpp::Time(batch_msg_->header.stamp) >= batch_period_;
+  if (!full && !expired) {
+    return false;
+  }
+
+  imu_batch_pub_->publish(std::move(batch_msg_));
+  return true;
 }
 
 geometry_msgs::msg::Vector3 IMU::miraToRosAcceleration(const mira::Point3f & acceleration)
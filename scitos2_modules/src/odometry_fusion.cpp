@@ -0,0 +1,305 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// C++
+#include <cmath>
+#include <vector>
+
+// TF2
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
+
+#include "scitos2_modules/odometry_fusion.hpp"
+
+namespace scitos2_modules
+{
+
+using std::placeholders::_1;
+
+void OdometryFusion::configure(
+  const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, std::string name)
+{
+  // Declare and read parameters
+  auto node = parent.lock();
+  if (!node) {
+    throw std::runtime_error("Unable to lock node!");
+  }
+
+  plugin_name_ = name;
+  logger_ = node->get_logger();
+  authority_ = std::make_shared<mira::Authority>();
+  authority_->checkin("/", plugin_name_);
+
+  // Declare and read parameters
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".robot_base_frame",
+    rclcpp::ParameterValue("base_link"), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The name of the base frame of the robot"));
+  node->get_parameter(plugin_name_ + ".robot_base_frame", robot_base_frame_);
+  RCLCPP_INFO(logger_, "The parameter robot_base_frame is set to: [%s]", robot_base_frame_.c_str());
+
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".odom_frame",
+    rclcpp::ParameterValue("odom"), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The name of the odometry frame"));
+  node->get_parameter(plugin_name_ + ".odom_frame", odom_frame_);
+  RCLCPP_INFO(logger_, "The parameter odom_frame is set to: [%s]", odom_frame_.c_str());
+
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".odom_topic",
+    rclcpp::ParameterValue("odometry/filtered"), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The name of the fused odometry topic"));
+  node->get_parameter(plugin_name_ + ".odom_topic", odom_topic_);
+  RCLCPP_INFO(logger_, "The parameter odom_topic is set to: [%s]", odom_topic_.c_str());
+
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".publish_tf",
+    rclcpp::ParameterValue(false), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("Publish the fused odometry as a tf2 transform"));
+  node->get_parameter(plugin_name_ + ".publish_tf", publish_tf_);
+  RCLCPP_INFO(
+    logger_, "The parameter publish_tf is set to: [%s]", publish_tf_ ? "true" : "false");
+
+  std::vector<double> process_noise;
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".process_noise",
+    rclcpp::ParameterValue(std::vector<double>{0.001, 0.001, 0.001, 0.25, 0.25}),
+    rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The process noise density of the state [x, y, theta, v, omega]"));
+  node->get_parameter(plugin_name_ + ".process_noise", process_noise);
+  if (process_noise.size() != static_cast<size_t>(STATE_SIZE)) {
+    RCLCPP_ERROR(
+      logger_, "The parameter process_noise must have %i elements, using the default values",
+      STATE_SIZE);
+    process_noise = {0.001, 0.001, 0.001, 0.25, 0.25};
+  }
+  process_noise_ = Eigen::Map<const StateVector>(process_noise.data()).asDiagonal();
+
+  std::vector<double> odometry_noise;
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".odometry_noise",
+    rclcpp::ParameterValue(std::vector<double>{0.01, 0.05}),
+    rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The variance of the wheel odometry velocities [v, omega]"));
+  node->get_parameter(plugin_name_ + ".odometry_noise", odometry_noise);
+  if (odometry_noise.size() != 2) {
+    RCLCPP_ERROR(
+      logger_, "The parameter odometry_noise must have 2 elements, using the default values");
+    odometry_noise = {0.01, 0.05};
+  }
+  odometry_noise_ = Eigen::Vector2d(odometry_noise[0], odometry_noise[1]).asDiagonal();
+
+  double gyroscope_noise = 0.001;
+  declare_parameter_if_not_declared(
+    node, plugin_name_ + ".gyroscope_noise",
+    rclcpp::ParameterValue(0.001), rcl_interfaces::msg::ParameterDescriptor()
+    .set__description("The variance of the gyroscope yaw rate"));
+  node->get_parameter(plugin_name_ + ".gyroscope_noise", gyroscope_noise);
+  RCLCPP_INFO(logger_, "The parameter gyroscope_noise is set to: [%f]", gyroscope_noise);
+  gyroscope_noise_(0, 0) = gyroscope_noise;
+
+  resetFilter();
+
+  // Create ROS publishers
+  odometry_pub_ = node->create_publisher<nav_msgs::msg::Odometry>(odom_topic_, 10);
+
+  // Create MIRA subscribers
+  authority_->subscribe<mira::robot::Odometry2>(
+    "/robot/Odometry", std::bind(&OdometryFusion::odometryDataCallback, this, _1));
+  authority_->subscribe<mira::Point3f>(
+    "/robot/Gyroscope", std::bind(&OdometryFusion::gyroscopeDataCallback, this, _1));
+
+  // Initialize the transform broadcaster
+  if (publish_tf_) {
+    tf_broadcaster_ = std::make_unique<tf2_ros::TransformBroadcaster>(node);
+  }
+
+  RCLCPP_INFO(logger_, "Configured module : %s", plugin_name_.c_str());
+}
+
+void OdometryFusion::cleanup()
+{
+  RCLCPP_INFO(
+    logger_, "Cleaning up module : %s of type scitos2_module::OdometryFusion",
+    plugin_name_.c_str());
+  authority_.reset();
+  odometry_pub_.reset();
+  tf_broadcaster_.reset();
+}
+
+void OdometryFusion::activate()
+{
+  RCLCPP_INFO(
+    logger_, "Activating module : %s of type scitos2_module::OdometryFusion",
+    plugin_name_.c_str());
+  odometry_pub_->on_activate();
+
+  try {
+    authority_->start();
+  } catch (const mira::Exception & ex) {
+    RCLCPP_ERROR(
+      logger_, "Failed to start scitos2_module::OdometryFusion. Exception: %s", ex.what());
+    return;
+  }
+}
+
+void OdometryFusion::deactivate()
+{
+  RCLCPP_INFO(
+    logger_, "Deactivating module : %s of type scitos2_module::OdometryFusion",
+    plugin_name_.c_str());
+  authority_->checkout();
+  odometry_pub_->on_deactivate();
+}
+
+void OdometryFusion::odometryDataCallback(mira::ChannelRead<mira::robot::Odometry2> data)
+{
+  rclcpp::Time stamp = rclcpp::Time(data->timestamp.toUnixNS());
+
+  nav_msgs::msg::Odometry odom_msg;
+  geometry_msgs::msg::TransformStamped tf_msg;
+  {
+    std::lock_guard<std::mutex> lock_filter(mutex_);
+    predict(stamp);
+    updateOdometry(data->value().velocity.x(), data->value().velocity.phi());
+    odom_msg = stateToRosOdometry(stamp);
+    if (publish_tf_) {
+      tf_msg = stateToRosTf(stamp);
+    }
+  }
+
+  // The fused state is published at the rate of the wheel odometry
+  odometry_pub_->publish(odom_msg);
+  if (publish_tf_) {
+    tf_broadcaster_->sendTransform(tf_msg);
+  }
+}
+
+void OdometryFusion::gyroscopeDataCallback(mira::ChannelRead<mira::Point3f> data)
+{
+  std::lock_guard<std::mutex> lock_filter(mutex_);
+  predict(rclcpp::Time(data->timestamp.toUnixNS()));
+  updateGyroscope(data->value().z() * M_PI / 180.0);
+}
+
+void OdometryFusion::resetFilter()
+{
+  state_.setZero();
+  // The pose starts at the origin, the velocities are unknown
+  covariance_.setZero();
+  covariance_.diagonal() << 1e-9, 1e-9, 1e-9, 1.0, 1.0;
+  initialized_ = false;
+}
+
+void OdometryFusion::predict(const rclcpp::Time & stamp)
+{
+  if (!initialized_) {
+    last_stamp_ = stamp;
+    initialized_ = true;
+    return;
+  }
+
+  const double dt = (stamp - last_stamp_).seconds();
+  if (dt <= 0.0) {
+    return;
+  }
+  last_stamp_ = stamp;
+
+  const double theta = state_(THETA);
+  const double v = state_(V);
+  const double cos_theta = std::cos(theta);
+  const double sin_theta = std::sin(theta);
+
+  // Unicycle model with constant velocities
+  state_(X) += v * cos_theta * dt;
+  state_(Y) += v * sin_theta * dt;
+  state_(THETA) = std::atan2(
+    std::sin(theta + state_(OMEGA) * dt), std::cos(theta + state_(OMEGA) * dt));
+
+  StateMatrix jacobian = StateMatrix::Identity();
+  jacobian(X, THETA) = -v * sin_theta * dt;
+  jacobian(X, V) = cos_theta * dt;
+  jacobian(Y, THETA) = v * cos_theta * dt;
+  jacobian(Y, V) = sin_theta * dt;
+  jacobian(THETA, OMEGA) = dt;
+
+  covariance_ = jacobian * covariance_ * jacobian.transpose() + process_noise_ * dt;
+}
+
+void OdometryFusion::updateOdometry(double v, double omega)
+{
+  Eigen::Matrix<double, 2, STATE_SIZE> h = Eigen::Matrix<double, 2, STATE_SIZE>::Zero();
+  h(0, V) = 1.0;
+  h(1, OMEGA) = 1.0;
+  update<2>(Eigen::Vector2d(v, omega), h, odometry_noise_);
+}
+
+void OdometryFusion::updateGyroscope(double omega)
+{
+  Eigen::Matrix<double, 1, STATE_SIZE> h = Eigen::Matrix<double, 1, STATE_SIZE>::Zero();
+  h(0, OMEGA) = 1.0;
+  update<1>(Eigen::Matrix<double, 1, 1>(omega), h, gyroscope_noise_);
+}
+
+nav_msgs::msg::Odometry OdometryFusion::stateToRosOdometry(const rclcpp::Time & stamp)
+{
+  nav_msgs::msg::Odometry odom_msg;
+  odom_msg.header.frame_id = odom_frame_;
+  odom_msg.header.stamp = stamp;
+  odom_msg.child_frame_id = robot_base_frame_;
+
+  // Set the position
+  odom_msg.pose.pose.position.x = state_(X);
+  odom_msg.pose.pose.position.y = state_(Y);
+  odom_msg.pose.pose.orientation = tf2::toMsg(tf2::Quaternion({0, 0, 1}, state_(THETA)));
+
+  // Set the velocity
+  odom_msg.twist.twist.linear.x = state_(V);
+  odom_msg.twist.twist.angular.z = state_(OMEGA);
+
+  // Set the covariances of the planar components: x, y and yaw are 0, 1 and 5 in ROS
+  const int pose_index[3] = {0, 1, 5};
+  const int pose_state[3] = {X, Y, THETA};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      odom_msg.pose.covariance[pose_index[i] * 6 + pose_index[j]] =
+        covariance_(pose_state[i], pose_state[j]);
+    }
+  }
+  odom_msg.twist.covariance[0] = covariance_(V, V);
+  odom_msg.twist.covariance[5] = covariance_(V, OMEGA);
+  odom_msg.twist.covariance[30] = covariance_(OMEGA, V);
+  odom_msg.twist.covariance[35] = covariance_(OMEGA, OMEGA);
+
+  return odom_msg;
+}
+
+geometry_msgs::msg::TransformStamped OdometryFusion::stateToRosTf(const rclcpp::Time & stamp)
+{
+  geometry_msgs::msg::TransformStamped tf_msg;
+  tf_msg.header.frame_id = odom_frame_;
+  tf_msg.header.stamp = stamp;
+  tf_msg.child_frame_id = robot_base_frame_;
+  tf_msg.transform.translation.x = state_(X);
+  tf_msg.transform.translation.y = state_(Y);
+  tf_msg.transform.translation.z = 0.0;
+  tf_msg.transform.rotation = tf2::toMsg(tf2::Quaternion({0, 0, 1}, state_(THETA)));
+  return tf_msg;
+}
+
+}  // namespace scitos2_modules
+
+#include "pluginlib/class_list_macros.hpp"  // NOLINT
+PLUGINLIB_EXPORT_CLASS(scitos2_modules::OdometryFusion, scitos2_core::Module)
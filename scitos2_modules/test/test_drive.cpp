@@ -85,11 +85,39 @@ public:
     return scitos2_modules::Drive::isBarrierCode(code);
   }
 
+  bool updateRfidTag(
+    uint64_t tag, const rclcpp::Time & stamp, const geometry_msgs::msg::Pose & pose)
+  {
+    std::lock_guard<std::mutex> lock(rfid_mutex_);
+    return rfid_registry_.update(tag, stamp, pose);
+  }
+
   void resetMotorStopAfterTimeout(rclcpp::Time current_time)
   {
     scitos2_modules::Drive::resetMotorStopAfterTimeout(current_time);
   }
 
+  bool requestMotorStopReset()
+  {
+    return scitos2_modules::Drive::requestMotorStopReset();
+  }
+
+  bool isMotorStopResetPending()
+  {
+    std::lock_guard<std::mutex> lock(reset_mutex_);
+    return reset_requested_;
+  }
+
+  void setResetBumperMaxBackoff(const rclcpp::Duration & max_backoff)
+  {
+    reset_bumper_max_backoff_ = max_backoff;
+  }
+
+  rclcpp::Duration computeResetBackoff(unsigned int failures)
+  {
+    return scitos2_modules::Drive::computeResetBackoff(failures);
+  }
+
   nav_msgs::msg::Odometry miraToRosOdometry(
     const mira::robot::Odometry2 & odometry, const mira::Time & timestamp)
   {
@@ -171,7 +199,9 @@ TEST(ScitosDriveTest, dynamicParameters) {
       rclcpp::Parameter("test.odom_topic", "odom_test_topic"),
       rclcpp::Parameter("test.magnetic_barrier_enabled", true),
       rclcpp::Parameter("test.publish_tf", false),
-      rclcpp::Parameter("test.reset_bumper_interval", 20)});
+      rclcpp::Parameter("test.reset_bumper_interval", 20),
+      rclcpp::Parameter("test.reset_bumper_max_backoff", 500),
+      rclcpp::Parameter("test.rfid_debounce_interval", 200)});
 
   // Spin
   rclcpp::spin_until_future_complete(node->get_node_base_interface(), results);
@@ -183,6 +213,8 @@ TEST(ScitosDriveTest, dynamicParameters) {
   EXPECT_EQ(node->get_parameter("test.magnetic_barrier_enabled").as_bool(), true);
   EXPECT_EQ(node->get_parameter("test.publish_tf").as_bool(), false);
   EXPECT_EQ(node->get_parameter("test.reset_bumper_interval").as_int(), 20);
+  EXPECT_EQ(node->get_parameter("test.reset_bumper_max_backoff").as_int(), 500);
+  EXPECT_EQ(node->get_parameter("test.rfid_debounce_interval").as_int(), 200);
 
   // Cleaning up
   module->deactivate();
@@ -333,6 +365,54 @@ TEST(ScitosDriveTest, enableRfid) {
   rclcpp::shutdown();
 }
 
+TEST(ScitosDriveTest, getRfidTag) {
+  rclcpp::init(0, nullptr);
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("testDrive");
+
+  // Create the module
+  auto module = std::make_shared<DriveFixture>();
+  module->configure(node, "test");
+  module->activate();
+
+  // Register a tag
+  geometry_msgs::msg::Pose pose;
+  pose.position.x = 1.0;
+  pose.position.y = 2.0;
+  module->updateRfidTag(42, rclcpp::Time(10, 0), pose);
+
+  // Create the client service
+  auto req = std::make_shared<scitos2_msgs::srv::GetRfidTag::Request>();
+  req->tag = 42;
+  auto client = node->create_client<scitos2_msgs::srv::GetRfidTag>("drive/get_rfid_tag");
+
+  // Wait for the service to be available
+  ASSERT_TRUE(client->wait_for_service());
+
+  // Call the service
+  auto result = client->async_send_request(req);
+
+  // Wait for the result
+  auto resp = std::make_shared<scitos2_msgs::srv::GetRfidTag::Response>();
+  if (rclcpp::spin_until_future_complete(node, result) == rclcpp::FutureReturnCode::SUCCESS) {
+    RCLCPP_INFO(node->get_logger(), "Service call successful");
+    resp = result.get();
+  } else {
+    RCLCPP_ERROR(node->get_logger(), "Service call failed");
+  }
+
+  // Check the response
+  EXPECT_TRUE(resp->found);
+  EXPECT_TRUE(resp->present);
+  EXPECT_EQ(resp->last_seen.sec, 10);
+  EXPECT_DOUBLE_EQ(resp->pose.position.x, 1.0);
+  EXPECT_DOUBLE_EQ(resp->pose.position.y, 2.0);
+
+  // Cleaning up
+  module->deactivate();
+  module->cleanup();
+  rclcpp::shutdown();
+}
+
 TEST(ScitosDriveTest, resetBarrierStop) {
   rclcpp::init(0, nullptr);
   auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("testDrive");
@@ -555,6 +635,42 @@ TEST(ScitosDriveTest, isBarrierCode) {
   EXPECT_FALSE(module->isBarrierCode(0));
 }
 
+TEST(ScitosDriveTest, rfidTagRegistry) {
+  scitos2_modules::RfidTagRegistry registry(rclcpp::Duration::from_seconds(1.0));
+  geometry_msgs::msg::Pose pose;
+
+  // Unknown tags are not found
+  EXPECT_EQ(registry.find(1), nullptr);
+
+  // The first read is an enter event and the repeated ones are debounced
+  EXPECT_TRUE(registry.update(1, rclcpp::Time(10, 0), pose));
+  pose.position.x = 3.0;
+  EXPECT_FALSE(registry.update(1, rclcpp::Time(10, 500000000), pose));
+  EXPECT_EQ(registry.size(), 1u);
+
+  // The record keeps the first and last read and the last pose
+  auto record = registry.find(1);
+  ASSERT_NE(record, nullptr);
+  EXPECT_TRUE(record->present);
+  EXPECT_EQ(record->first_seen, rclcpp::Time(10, 0));
+  EXPECT_EQ(record->last_seen, rclcpp::Time(10, 500000000));
+  EXPECT_DOUBLE_EQ(record->pose.position.x, 3.0);
+
+  // The tag does not leave within the debounce interval
+  EXPECT_TRUE(registry.expire(rclcpp::Time(11, 0)).empty());
+
+  // But it leaves once, after the debounce interval
+  auto left = registry.expire(rclcpp::Time(12, 0));
+  ASSERT_EQ(left.size(), 1u);
+  EXPECT_EQ(left.front().first, 1u);
+  EXPECT_FALSE(registry.find(1)->present);
+  EXPECT_TRUE(registry.expire(rclcpp::Time(13, 0)).empty());
+
+  // And enters again with the next read
+  EXPECT_TRUE(registry.update(1, rclcpp::Time(14, 0), pose));
+  EXPECT_EQ(registry.find(1)->first_seen, rclcpp::Time(14, 0));
+}
+
 TEST(ScitosDriveTest, resetMotorStopAfterTimeout) {
   // Create the module
   auto module = std::make_shared<DriveFixture>();
@@ -604,6 +720,42 @@ TEST(ScitosDriveTest, resetMotorStopAfterTimeout) {
   EXPECT_TRUE(module->getLastBumperReset() == rclcpp::Time(0, 0));
 }
 
+TEST(ScitosDriveTest, requestMotorStopReset) {
+  // Create the module
+  auto module = std::make_shared<DriveFixture>();
+
+  // Without the worker running the first request is queued
+  EXPECT_FALSE(module->isMotorStopResetPending());
+  EXPECT_TRUE(module->requestMotorStopReset());
+  EXPECT_TRUE(module->isMotorStopResetPending());
+
+  // And the repeated ones are coalesced into the pending one
+  EXPECT_FALSE(module->requestMotorStopReset());
+  EXPECT_FALSE(module->requestMotorStopReset());
+  EXPECT_TRUE(module->isMotorStopResetPending());
+}
+
+TEST(ScitosDriveTest, computeResetBackoff) {
+  // Create the module
+  auto module = std::make_shared<DriveFixture>();
+  module->setResetBumperInterval(rclcpp::Duration::from_seconds(0.5));
+  module->setResetBumperMaxBackoff(rclcpp::Duration::from_seconds(3.0));
+
+  // No backoff without failures
+  EXPECT_DOUBLE_EQ(module->computeResetBackoff(0).seconds(), 0.0);
+  // The backoff doubles after each failure
+  EXPECT_DOUBLE_EQ(module->computeResetBackoff(1).seconds(), 0.5);
+  EXPECT_DOUBLE_EQ(module->computeResetBackoff(2).seconds(), 1.0);
+  EXPECT_DOUBLE_EQ(module->computeResetBackoff(3).seconds(), 2.0);
+  // Until the maximum is reached
+  EXPECT_DOUBLE_EQ(module->computeResetBackoff(4).seconds(), 3.0);
+  EXPECT_DOUBLE_EQ(module->computeResetBackoff(100).seconds(), 3.0);
+
+  // Without interval, the minimum backoff is used
+  module->setResetBumperInterval(rclcpp::Duration(0, 0));
+  EXPECT_DOUBLE_EQ(module->computeResetBackoff(1).seconds(), 0.1);
+}
+
 TEST(ScitosDriveTest, odometryTest) {
   // Create the module
   auto module = std::make_shared<DriveFixture>();
@@ -33,6 +33,33 @@ public:
   {
     return scitos2_modules::IMU::miraToRosGyroscope(gyroscope);
   }
+
+  bool addAcceleration(const rclcpp::Time & stamp)
+  {
+    return scitos2_modules::IMU::addAcceleration(stamp, geometry_msgs::msg::Vector3());
+  }
+
+  bool addGyroscope(const rclcpp::Time & stamp)
+  {
+    return scitos2_modules::IMU::addGyroscope(stamp, geometry_msgs::msg::Vector3());
+  }
+
+  bool addToBatch(const rclcpp::Time & stamp)
+  {
+    sensor_msgs::msg::Imu imu_msg;
+    imu_msg.header.stamp = stamp;
+    return scitos2_modules::IMU::addToBatch(imu_msg);
+  }
+
+  size_t getBatchLength()
+  {
+    return batch_msg_ ? batch_msg_->stamps.size() : 0;
+  }
+
+  bool isBatchEnabled()
+  {
+    return scitos2_modules::IMU::isBatchEnabled();
+  }
 };
 
 TEST(ScitosIMUTest, configure) {
@@ -111,12 +138,14 @@ TEST(ScitosIMUTest, acceSubPub) {
     });
   auto sub_thread = std::thread([&]() {rclcpp::spin(sub_node->get_node_base_interface());});
 
-  // Publish the messages
+  // Publish the messages with the same timestamp
+  mira::Time stamp = mira::Time::now();
   mira::Point3f acceleration;
   acceleration.x() = 1.0;
   acceleration.y() = 2.0;
   acceleration.z() = 3.0;
   auto acc_writer = acc_pub.write();
+  acc_writer->timestamp = stamp;
   acc_writer->value() = acceleration;
   acc_writer.finish();
 
@@ -125,6 +154,7 @@ TEST(ScitosIMUTest, acceSubPub) {
   gyroscope.y() = 2.0;
   gyroscope.z() = 3.0;
   auto gyro_writer = gyro_pub.write();
+  gyro_writer->timestamp = stamp;
   gyro_writer->value() = gyroscope;
   gyro_writer.finish();
 
@@ -134,6 +164,7 @@ TEST(ScitosIMUTest, acceSubPub) {
   // Check the received message
   EXPECT_EQ(sub->get_publisher_count(), 1);
   EXPECT_TRUE(received_msg);
+  EXPECT_EQ(module->getPublishedSamples(), 1u);
 
   // Cleaning up
   module->deactivate();
@@ -148,6 +179,101 @@ TEST(ScitosIMUTest, acceSubPub) {
   sub_thread.join();
 }
 
+TEST(ScitosIMUTest, synchronization) {
+  rclcpp::init(0, nullptr);
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("testIMU");
+
+  // Create the module with a tolerance of 5 ms
+  auto module = std::make_shared<IMUFixture>();
+  module->configure(node, "test");
+  module->activate();
+  EXPECT_FALSE(module->isBatchEnabled());
+
+  // A single sample is not published
+  EXPECT_FALSE(module->addAcceleration(rclcpp::Time(1, 0)));
+  EXPECT_EQ(module->getPublishedSamples(), 0u);
+
+  // But it is as soon as its partner arrives within the tolerance
+  EXPECT_TRUE(module->addGyroscope(rclcpp::Time(1, 2000000)));
+  EXPECT_EQ(module->getPublishedSamples(), 1u);
+
+  // Repeated samples are not published again
+  EXPECT_FALSE(module->addAcceleration(rclcpp::Time(1, 0)));
+  EXPECT_FALSE(module->addGyroscope(rclcpp::Time(1, 2000000)));
+  EXPECT_EQ(module->getDuplicateSamples(), 2u);
+  EXPECT_EQ(module->getPublishedSamples(), 1u);
+
+  // A sample too old to be paired is dropped
+  EXPECT_FALSE(module->addAcceleration(rclcpp::Time(2, 0)));
+  EXPECT_FALSE(module->addGyroscope(rclcpp::Time(2, 10000000)));
+  EXPECT_EQ(module->getDroppedSamples(), 1u);
+
+  // And the newest one is paired with the next sample of the other sensor
+  EXPECT_TRUE(module->addAcceleration(rclcpp::Time(2, 11000000)));
+  EXPECT_EQ(module->getPublishedSamples(), 2u);
+
+  // A sample replaced before finding its partner is dropped too
+  EXPECT_FALSE(module->addGyroscope(rclcpp::Time(3, 0)));
+  EXPECT_FALSE(module->addGyroscope(rclcpp::Time(3, 10000000)));
+  EXPECT_EQ(module->getDroppedSamples(), 2u);
+
+  // Cleaning up
+  module->deactivate();
+  module->cleanup();
+  rclcpp::shutdown();
+}
+
+TEST(ScitosIMUTest, batchSize) {
+  rclcpp::init(0, nullptr);
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("testIMU");
+  node->declare_parameter("test.batch_size", rclcpp::ParameterValue(3));
+
+  // Create the module
+  auto module = std::make_shared<IMUFixture>();
+  module->configure(node, "test");
+  module->activate();
+  EXPECT_TRUE(module->isBatchEnabled());
+
+  // The batch is published when it has 3 samples
+  EXPECT_FALSE(module->addToBatch(rclcpp::Time(1, 0)));
+  EXPECT_FALSE(module->addToBatch(rclcpp::Time(1, 1000000)));
+  EXPECT_EQ(module->getBatchLength(), 2u);
+  EXPECT_TRUE(module->addToBatch(rclcpp::Time(1, 2000000)));
+  EXPECT_EQ(module->getBatchLength(), 0u);
+
+  // And a new one starts with the next sample
+  EXPECT_FALSE(module->addToBatch(rclcpp::Time(1, 3000000)));
+  EXPECT_EQ(module->getBatchLength(), 1u);
+
+  // Cleaning up
+  module->deactivate();
+  module->cleanup();
+  rclcpp::shutdown();
+}
+
+TEST(ScitosIMUTest, batchPeriod) {
+  rclcpp::init(0, nullptr);
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("testIMU");
+  node->declare_parameter("test.batch_period", rclcpp::ParameterValue(10));
+
+  // Create the module
+  auto module = std::make_shared<IMUFixture>();
+  module->configure(node, "test");
+  module->activate();
+  EXPECT_TRUE(module->isBatchEnabled());
+
+  // The batch is published when it covers 10 ms
+  EXPECT_FALSE(module->addToBatch(rclcpp::Time(1, 0)));
+  EXPECT_FALSE(module->addToBatch(rclcpp::Time(1, 5000000)));
+  EXPECT_TRUE(module->addToBatch(rclcpp::Time(1, 10000000)));
+  EXPECT_EQ(module->getBatchLength(), 0u);
+
+  // Cleaning up
+  module->deactivate();
+  module->cleanup();
+  rclcpp::shutdown();
+}
+
 TEST(ScitosIMUTest, accelerationTest) {
   // Create the module
   auto module = std::make_shared<IMUFixture>();
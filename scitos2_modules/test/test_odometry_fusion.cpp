@@ -0,0 +1,267 @@
+// Copyright (c) 2024 Alberto J. Tudela Roldán
+// Copyright (c) 2024 Grupo Avispa, DTE, Universidad de Málaga
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gtest/gtest.h"
+#include "rclcpp/rclcpp.hpp"
+#include "tf2/utils.h"
+#include "tf2_geometry_msgs/tf2_geometry_msgs.hpp"
+#include "scitos2_modules/odometry_fusion.hpp"
+
+class OdometryFusionFixture : public scitos2_modules::OdometryFusion
+{
+public:
+  OdometryFusionFixture()
+  : scitos2_modules::OdometryFusion()
+  {}
+
+  void setNoise(double process, double odometry_v, double odometry_omega, double gyroscope)
+  {
+    process_noise_ = StateMatrix::Identity() * process;
+    odometry_noise_ = Eigen::Vector2d(odometry_v, odometry_omega).asDiagonal();
+    gyroscope_noise_(0, 0) = gyroscope;
+  }
+
+  void resetFilter()
+  {
+    scitos2_modules::OdometryFusion::resetFilter();
+  }
+
+  void predict(const rclcpp::Time & stamp)
+  {
+    scitos2_modules::OdometryFusion::predict(stamp);
+  }
+
+  void updateOdometry(double v, double omega)
+  {
+    scitos2_modules::OdometryFusion::updateOdometry(v, omega);
+  }
+
+  void updateGyroscope(double omega)
+  {
+    scitos2_modules::OdometryFusion::updateGyroscope(omega);
+  }
+
+  StateVector getState()
+  {
+    return state_;
+  }
+
+  StateMatrix getCovariance()
+  {
+    return covariance_;
+  }
+
+  nav_msgs::msg::Odometry stateToRosOdometry(const rclcpp::Time & stamp)
+  {
+    return scitos2_modules::OdometryFusion::stateToRosOdometry(stamp);
+  }
+
+  geometry_msgs::msg::TransformStamped stateToRosTf(const rclcpp::Time & stamp)
+  {
+    return scitos2_modules::OdometryFusion::stateToRosTf(stamp);
+  }
+};
+
+TEST(ScitosOdometryFusionTest, configure) {
+  rclcpp::init(0, nullptr);
+  auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("testOdometryFusion");
+
+  // Create the module
+  auto module = std::make_shared<OdometryFusionFixture>();
+  module->configure(node, "test");
+  module->activate();
+
+  // Cleaning up
+  module->deactivate();
+  module->cleanup();
+
+  // Now, we set invalid noises to show the error
+  node->set_parameter(rclcpp::Parameter("test.process_noise", std::vector<double>{1.0}));
+  node->set_parameter(rclcpp::Parameter("test.odometry_noise", std::vector<double>{1.0}));
+
+  // Configure the module
+  module->configure(node, "test");
+  module->activate();
+
+  // Cleaning up
+  module->deactivate();
+  module->cleanup();
+  rclcpp::shutdown();
+}
+
+TEST(ScitosOdometryFusionTest, straightLine) {
+  auto module = std::make_shared<OdometryFusionFixture>();
+  module->setNoise(0.01, 0.01, 0.05, 0.001);
+  module->resetFilter();
+
+  // Drive at 1 m/s during 1 second
+  for (int i = 0; i <= 100; i++) {
+    module->predict(rclcpp::Time(0, i * 10000000));
+    module->updateOdometry(1.0, 0.0);
+    module->updateGyroscope(0.0);
+  }
+
+  auto state = module->getState();
+  EXPECT_NEAR(state(0), 1.0, 0.05);
+  EXPECT_NEAR(state(1), 0.0, 1e-6);
+  EXPECT_NEAR(state(2), 0.0, 1e-6);
+  EXPECT_NEAR(state(3), 1.0, 0.01);
+  EXPECT_NEAR(state(4), 0.0, 1e-6);
+}
+
+TEST(ScitosOdometryFusionTest, rotation) {
+  auto module = std::make_shared<OdometryFusionFixture>();
+  module->setNoise(0.01, 0.01, 0.05, 0.001);
+  module->resetFilter();
+
+  // Rotate in place at 0.5 rad/s during 1 second
+  for (int i = 0; i <= 100; i++) {
+    module->predict(rclcpp::Time(0, i * 10000000));
+    module->updateOdometry(0.0, 0.5);
+    module->updateGyroscope(0.5);
+  }
+
+  auto state = module->getState();
+  EXPECT_NEAR(state(0), 0.0, 1e-6);
+  EXPECT_NEAR(state(1), 0.0, 1e-6);
+  EXPECT_NEAR(state(2), 0.5, 0.02);
+  EXPECT_NEAR(state(4), 0.5, 0.01);
+
+  // The orientation is published as a quaternion
+  auto odom_msg = module->stateToRosOdometry(rclcpp::Time(1, 0));
+  EXPECT_NEAR(tf2::getYaw(odom_msg.pose.pose.orientation), state(2), 1e-6);
+  auto tf_msg = module->stateToRosTf(rclcpp::Time(1, 0));
+  EXPECT_NEAR(tf2::getYaw(tf_msg.transform.rotation), state(2), 1e-6);
+}
+
+TEST(ScitosOdometryFusionTest, gyroscopeWeight) {
+  auto module = std::make_shared<OdometryFusionFixture>();
+  // The gyroscope is much more accurate than the wheels
+  module->setNoise(0.01, 0.01, 0.1, 0.001);
+  module->resetFilter();
+
+  // The wheels slip and overestimate the rotation
+  for (int i = 0; i <= 100; i++) {
+    module->predict(rclcpp::Time(0, i * 10000000));
+    module->updateOdometry(0.0, 0.2);
+    module->updateGyroscope(0.1);
+  }
+
+  // The fused yaw rate is close to the gyroscope
+  auto state = module->getState();
+  EXPECT_LT(std::abs(state(4) - 0.1), std::abs(state(4) - 0.2));
+  EXPECT_NEAR(state(4), 0.1, 0.02);
+}
+
+TEST(ScitosOdometryFusionTest, covariance) {
+  auto module = std::make_shared<OdometryFusionFixture>();
+  module->setNoise(0.01, 0.01, 0.05, 0.001);
+  module->resetFilter();
+
+  for (int i = 0; i <= 100; i++) {
+    module->predict(rclcpp::Time(0, i * 10000000));
+    module->updateOdometry(1.0, 0.3);
+  }
+
+  // Without absolute measurements the position uncertainty grows
+  auto covariance = module->getCovariance();
+  EXPECT_GT(covariance(0, 0), 1e-9);
+  EXPECT_TRUE(covariance.isApprox(covariance.transpose()));
+
+  // Measurements older than the state do not move it backwards
+  auto state = module->getState();
+  module->predict(rclcpp::Time(0, 500000000));
+  EXPECT_TRUE(module->getState().isApprox(state));
+
+  // And the covariance is published in the ROS layout
+  auto odom_msg = module->stateToRosOdometry(rclcpp::Time(1, 0));
+  EXPECT_DOUBLE_EQ(odom_msg.pose.covariance[0], covariance(0, 0));
+  EXPECT_DOUBLE_EQ(odom_msg.pose.covariance[35], covariance(2, 2));
+  EXPECT_DOUBLE_EQ(odom_msg.twist.covariance[0], covariance(3, 3));
+  EXPECT_DOUBLE_EQ(odom_msg.twist.covariance[35], covariance(4, 4));
+}
+
+TEST(ScitosOdometryFusionTest, odometryPublisher) {
+  rclcpp::init(0, nullptr);
+  // Create the MIRA authority
+  mira::Authority authority("/", "test_odometry_fusion");
+  authority.start();
+  // Create the MIRA publishers
+  auto odom_publisher = authority.publish<mira::robot::Odometry2>("/robot/Odometry");
+  auto gyro_publisher = authority.publish<mira::Point3f>("/robot/Gyroscope");
+
+  // Create and configure the module
+  auto fusion_node = std::make_shared<rclcpp_lifecycle::LifecycleNode>("testOdometryFusion");
+  auto module = std::make_shared<OdometryFusionFixture>();
+  module->configure(fusion_node, "test");
+  module->activate();
+  auto fusion_thread = std::thread(
+    [&]() {rclcpp::spin(fusion_node->get_node_base_interface());});
+
+  // Create the susbcriber node
+  auto sub_node =
+    std::make_shared<rclcpp_lifecycle::LifecycleNode>("testOdometryFusionSubscriber");
+  sub_node->configure();
+  sub_node->activate();
+
+  // Create the subscriber
+  bool received_msg = false;
+  auto sub = sub_node->create_subscription<nav_msgs::msg::Odometry>(
+    "odometry/filtered", 1,
+    [&](const nav_msgs::msg::Odometry & /* msg */) {
+      RCLCPP_INFO(sub_node->get_logger(), "Received message");
+      received_msg = true;
+    });
+  auto sub_thread = std::thread([&]() {rclcpp::spin(sub_node->get_node_base_interface());});
+
+  // Publish the messages
+  auto gyro_writer = gyro_publisher.write();
+  gyro_writer->value() = mira::Point3f(0.0, 0.0, 10.0);
+  gyro_writer.finish();
+
+  mira::robot::Odometry2 odometry;
+  odometry.velocity.x() = 0.5;
+  odometry.velocity.phi() = 0.2;
+  auto odom_writer = odom_publisher.write();
+  odom_writer->value() = odometry;
+  odom_writer.finish();
+
+  // Wait for the message to be received
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  // Check the received message
+  EXPECT_EQ(sub->get_publisher_count(), 1);
+  EXPECT_TRUE(received_msg);
+
+  // Cleaning up
+  module->deactivate();
+  sub_node->deactivate();
+  module->cleanup();
+  sub_node->cleanup();
+  sub_node->shutdown();
+  rclcpp::shutdown();
+  // Have to join thread after rclcpp is shut down otherwise test hangs
+  fusion_thread.join();
+  sub_thread.join();
+}
+
+int main(int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  mira::Framework framework(0, nullptr);
+  framework.start();
+  bool success = RUN_ALL_TESTS();
+  return success;
+}